@@ -2,36 +2,14 @@
 #ifndef AGENTSTATS_H
 #define AGENTSTATS_H
 
+#include <string.h>
+
 #include <vector>
 #include <array>
 #include <iostream>
+#include <string>
 
-#include "LogHistogramSampler.h"
-
-#ifdef STATIC_ALLOC_SAMPLER
-// Static allocation
-
-  class AgentStats {
-  public:
-    // Base stats
-    uint64_t rx_bytes, tx_bytes;
-    uint64_t gets, sets, get_misses;
-    uint64_t skips;
-    double start, stop;
-
-
-    // Dynamic stats
-    uint64_t gets_dyn[MAX_INTERVALS], sets_dyn[MAX_INTERVALS];
-
-    // Sampler stats
-    uint64_t get_bins[MAX_INTERVALS][LOGSAMPLER_BINS];
-    double get_sum[MAX_INTERVALS];
-    double get_sum_sq[MAX_INTERVALS];
-    
-  };
-
-#else
-// Dynamic allocation
+#include "HdrHistogramSampler.h"
 
   class BaseStats {
   public:
@@ -40,51 +18,46 @@
     uint64_t gets, sets, get_misses;
     uint64_t skips;
     double start, stop;
+    double client_cpu;  // Load-generator thread CPU seconds.
   };
 
+// Histograms shipped from agents, by wire id.  Ids are part of the
+// wire format: append new ones, never renumber.
+enum agent_hist_id {
+  AGENT_HIST_GET = 0,
+  AGENT_HIST_GET_CO = 1,
+  AGENT_HIST_SET = 2,
+  AGENT_HIST_SET_CO = 3,
+  AGENT_HIST_OP = 4,
+  AGENT_HIST_TX_LAG = 5,
+  AGENT_HIST_MAX,
+};
+
+  // Stats sent from an agent to the master.  Histograms are kept in
+  // HdrHistogramSampler form, indexed by agent_hist_id, so a new
+  // per-op-type sampler only needs an id and an entry in
+  // ConnectionStats::agent_sampler().
   class AgentStats {
   public:
     int n_intervals;
+    int counts_len;  // Histogram layout shared by master and agents.
 
     // Base stats
     BaseStats bs;
 
     // Dynamic stats
-    uint64_t *gets_dyn, *sets_dyn;
+    std::vector<uint64_t> gets_dyn, sets_dyn;
 
     // Sampler stats
-    uint64_t **get_bins;
-    double *get_sum;
-    double *get_sum_sq;
-    
-    // Constructor
-    AgentStats(int n_intervals) {
-      this->n_intervals = n_intervals;
-
-      gets_dyn = new uint64_t[n_intervals];
-      sets_dyn = new uint64_t[n_intervals];
-
-      get_bins = new uint64_t*[n_intervals];
-      for(int i = 0; i < n_intervals; i++) {
-        get_bins[i] = new uint64_t[LOGSAMPLER_BINS];
-      }
-
-      get_sum = new double[n_intervals];
-      get_sum_sq = new double[n_intervals];
-    };
+    std::vector<HdrHistogramSampler> hists;
 
-    // Destructor
-    ~AgentStats() {
-      delete[] gets_dyn;
-      delete[] sets_dyn;
-
-      for(int i = 0; i < n_intervals; i++) {
-        delete[] get_bins[i];
-      }
-      delete[] get_bins;
-
-      delete[] get_sum;
-      delete[] get_sum_sq;
+    // Constructor
+    AgentStats(int n_intervals, int counts_len) :
+      n_intervals(n_intervals), counts_len(counts_len),
+      gets_dyn(n_intervals, 0), sets_dyn(n_intervals, 0) {
+      memset(&bs, 0, sizeof(bs));
+      for (int i = 0; i < AGENT_HIST_MAX; i++)
+        hists.push_back(HdrHistogramSampler(n_intervals));
     }
 
     void print_base() {
@@ -97,24 +70,193 @@
         std::cout << i << "- gets_dyn: " << gets_dyn[i] << ", sets_dyn: " << sets_dyn[i] << std::endl;
       }
     }
+  };
 
-    void print_bins() {
-      for(int i = 0; i < n_intervals; i++) {
-        std::cout << "bin: " << i << std::endl;
-        for(int j = 0; j < LOGSAMPLER_BINS; j++) {
-          std::cout << get_bins[i][j] << std::endl;
+/*
+ * Wire format used to ship AgentStats from an agent to the master in a
+ * single message.  Integers are LEB128 varints unless noted.
+ *
+ *   "MCAS" | version (1 byte) | body length (4 bytes, little endian)
+ *   n_intervals, counts_len
+ *   rx_bytes, tx_bytes, gets, sets, get_misses, skips
+ *   start, stop, client_cpu                      (raw doubles)
+ *   gets_dyn[n_intervals], sets_dyn[n_intervals]
+ *   n_histograms, then for each histogram:
+ *     id, then for each interval:
+ *       sum, sum_sq                              (raw doubles)
+ *       n_nonzero, then n_nonzero x (gap, count)
+ *
+ * Histogram counts are sparse: gap is the number of zero bins skipped
+ * since the previous non-zero bin.  Unknown histogram ids are skipped
+ * by the decoder, so agents may ship histograms a master ignores.
+ */
+
+#define AGENT_STATS_MAGIC   "MCAS"
+#define AGENT_STATS_VERSION 2
+#define AGENT_STATS_HEADER  9
+
+class AgentStatsWire {
+public:
+  // Serialize as into out (replacing its contents).
+  static void encode(const AgentStats &as, std::string &out) {
+    out.assign(AGENT_STATS_MAGIC, 4);
+    out.push_back((char) AGENT_STATS_VERSION);
+    out.append(4, '\0');  // Patched below.
+
+    put_varint(out, as.n_intervals);
+    put_varint(out, as.counts_len);
+
+    put_varint(out, as.bs.rx_bytes);
+    put_varint(out, as.bs.tx_bytes);
+    put_varint(out, as.bs.gets);
+    put_varint(out, as.bs.sets);
+    put_varint(out, as.bs.get_misses);
+    put_varint(out, as.bs.skips);
+    put_double(out, as.bs.start);
+    put_double(out, as.bs.stop);
+    put_double(out, as.bs.client_cpu);
+
+    for (int i = 0; i < as.n_intervals; i++) put_varint(out, as.gets_dyn[i]);
+    for (int i = 0; i < as.n_intervals; i++) put_varint(out, as.sets_dyn[i]);
+
+    put_varint(out, AGENT_HIST_MAX);
+    for (int id = 0; id < AGENT_HIST_MAX; id++)
+      put_hist(out, id, as.hists[id]);
+
+    uint32_t len = out.size() - AGENT_STATS_HEADER;
+    for (int i = 0; i < 4; i++) out[5 + i] = (char) (len >> (8 * i));
+  }
+
+  // Parse a message produced by encode().  Returns NULL on success, or
+  // a description of what is wrong with the message.
+  static const char *decode(AgentStats &as, const void *data, size_t size) {
+    const uint8_t *p = (const uint8_t *) data;
+    const uint8_t *end = p + size;
+
+    if (size < AGENT_STATS_HEADER || memcmp(p, AGENT_STATS_MAGIC, 4))
+      return "not an AgentStats message";
+    if (p[4] != AGENT_STATS_VERSION) return "unsupported AgentStats version";
+
+    uint32_t len = 0;
+    for (int i = 0; i < 4; i++) len |= (uint32_t) p[5 + i] << (8 * i);
+    if (len != size - AGENT_STATS_HEADER) return "truncated AgentStats message";
+    p += AGENT_STATS_HEADER;
+
+    uint64_t n_intervals, counts_len;
+    if (!get_varint(p, end, n_intervals) || !get_varint(p, end, counts_len))
+      return "truncated AgentStats message";
+    if ((int) n_intervals != as.n_intervals)
+      return "interval count differs from master";
+    if ((int) counts_len != as.counts_len)
+      return "histogram layout differs from master";
+
+    if (!get_varint(p, end, as.bs.rx_bytes) ||
+        !get_varint(p, end, as.bs.tx_bytes) ||
+        !get_varint(p, end, as.bs.gets) ||
+        !get_varint(p, end, as.bs.sets) ||
+        !get_varint(p, end, as.bs.get_misses) ||
+        !get_varint(p, end, as.bs.skips) ||
+        !get_double(p, end, as.bs.start) ||
+        !get_double(p, end, as.bs.stop) ||
+        !get_double(p, end, as.bs.client_cpu))
+      return "truncated AgentStats message";
+
+    for (int i = 0; i < as.n_intervals; i++)
+      if (!get_varint(p, end, as.gets_dyn[i])) return "truncated AgentStats message";
+    for (int i = 0; i < as.n_intervals; i++)
+      if (!get_varint(p, end, as.sets_dyn[i])) return "truncated AgentStats message";
+
+    uint64_t n_hist;
+    std::vector<uint64_t> row;
+    if (!get_varint(p, end, n_hist)) return "truncated AgentStats message";
+
+    for (uint64_t h = 0; h < n_hist; h++) {
+      uint64_t id;
+      if (!get_varint(p, end, id)) return "truncated AgentStats message";
+
+      HdrHistogramSampler *hist = id < AGENT_HIST_MAX ? &as.hists[id] : NULL;
+      if (hist && hist->counts_len != as.counts_len)
+        return "histogram layout differs from master";
+
+      for (int i = 0; i < as.n_intervals; i++) {
+        double s, s_sq;
+        if (!get_double(p, end, s) || !get_double(p, end, s_sq))
+          return "truncated AgentStats message";
+
+        row.assign(as.counts_len, 0);
+
+        uint64_t n_nonzero, gap, count;
+        int64_t j = -1;
+        if (!get_varint(p, end, n_nonzero)) return "truncated AgentStats message";
+        for (uint64_t k = 0; k < n_nonzero; k++) {
+          if (!get_varint(p, end, gap) || !get_varint(p, end, count))
+            return "truncated AgentStats message";
+          j += gap + 1;
+          if (j >= as.counts_len) return "histogram bin out of range";
+          row[j] = count;
         }
+
+        if (hist) hist->accumulate(row.data(), s, s_sq, i);
       }
     }
 
-    void print_sum() {
-      for(int i = 0; i < n_intervals; i++) {
-        std::cout << i << "- sum: " << get_sum[i] << ", sum_sq: " << get_sum_sq[i] << std::endl;
+    return NULL;
+  }
+
+private:
+  static void put_hist(std::string &out, int id, const HdrHistogramSampler &h) {
+    put_varint(out, id);
+
+    for (int i = 0; i < h.n_intervals; i++) {
+      const std::vector<uint64_t> &row = h.counts[i];
+      int n_nonzero = 0;
+
+      put_double(out, h.sum[i]);
+      put_double(out, h.sum_sq[i]);
+
+      for (int j = 0; j < h.counts_len; j++)
+        if (row[j]) n_nonzero++;
+      put_varint(out, n_nonzero);
+
+      int last = -1;
+      for (int j = 0; j < h.counts_len; j++) {
+        if (!row[j]) continue;
+        put_varint(out, j - last - 1);
+        put_varint(out, row[j]);
+        last = j;
       }
     }
+  }
 
-  };
+  static void put_varint(std::string &out, uint64_t v) {
+    while (v >= 0x80) {
+      out.push_back((char) (v | 0x80));
+      v >>= 7;
+    }
+    out.push_back((char) v);
+  }
+
+  static void put_double(std::string &out, double d) {
+    out.append((const char *) &d, sizeof(d));
+  }
+
+  static bool get_varint(const uint8_t *&p, const uint8_t *end, uint64_t &v) {
+    v = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+      if (p >= end) return false;
+      uint8_t b = *p++;
+      v |= (uint64_t) (b & 0x7f) << shift;
+      if (!(b & 0x80)) return true;
+    }
+    return false;
+  }
 
-#endif
+  static bool get_double(const uint8_t *&p, const uint8_t *end, double &d) {
+    if (end - p < (ptrdiff_t) sizeof(d)) return false;
+    memcpy(&d, p, sizeof(d));
+    p += sizeof(d);
+    return true;
+  }
+};
 
 #endif // AGENTSTATS_H
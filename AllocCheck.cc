@@ -0,0 +1,319 @@
+// Check that the request path does not allocate.
+//
+// Run with "make check", or build with "make alloccheck" and run
+// ./alloccheck [n_requests].
+// malloc() and operator new are counted while an unpaced Connection
+// of each protocol (ascii, binary and meta) issues gets, sets and
+// multi-gets, and a canned server answers them in its input buffer:
+// hits and misses, STORED, binary GET/GETKQ/NOOP, meta VA/MN with
+// quiet misses and sets.  read_callback() then parses the replies,
+// samples the ops into the ConnectionStats and issues the next ones,
+// as on a socket read.  After a warmup that fills the key cache,
+// samplers and buffers, any allocation in the measured requests fails
+// the check.  libevent's own evbuffer chains are tallied separately
+// and only reported.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <new>
+
+#include <event2/buffer.h>
+#include <event2/event.h>
+
+#include "binary_protocol.h"
+#include "cmdline.h"
+#include "log.h"
+#include "util.h"
+#include "Connection.h"
+#include "TimerWheel.h"
+
+#define WARMUP_REQUESTS 100000
+#define VALUE_LEN       200
+#define BUFFER_LEN      (1 << 20)
+
+gengetopt_args_info args;
+char random_char[2 * 1024 * 1024];
+
+extern "C" void *__libc_malloc(size_t size);
+extern "C" void *__libc_calloc(size_t n, size_t size);
+extern "C" void *__libc_realloc(void *ptr, size_t size);
+extern "C" void __libc_free(void *ptr);
+
+static bool counting = false;
+static long allocs = 0;        // By mcperf while counting.
+static long event_allocs = 0;  // By libevent while counting.
+
+extern "C" void *malloc(size_t size) {
+  if (counting) allocs++;
+  return __libc_malloc(size);
+}
+
+extern "C" void *calloc(size_t n, size_t size) {
+  if (counting) allocs++;
+  return __libc_calloc(n, size);
+}
+
+extern "C" void *realloc(void *ptr, size_t size) {
+  if (counting) allocs++;
+  return __libc_realloc(ptr, size);
+}
+
+extern "C" void free(void *ptr) { __libc_free(ptr); }
+
+void *operator new(size_t size) {
+  if (counting) allocs++;
+  void *p = __libc_malloc(size ? size : 1);
+  if (p == NULL) throw std::bad_alloc();
+  return p;
+}
+
+void *operator new[](size_t size) { return operator new(size); }
+void operator delete(void *p) noexcept { __libc_free(p); }
+void operator delete[](void *p) noexcept { __libc_free(p); }
+void operator delete(void *p, size_t) noexcept { __libc_free(p); }
+void operator delete[](void *p, size_t) noexcept { __libc_free(p); }
+
+static void *event_malloc(size_t size) {
+  if (counting) event_allocs++;
+  return __libc_malloc(size);
+}
+
+static void *event_realloc(void *ptr, size_t size) {
+  if (counting) event_allocs++;
+  return __libc_realloc(ptr, size);
+}
+
+static void event_free(void *ptr) { __libc_free(ptr); }
+
+static void init_options(options_t &options, enum protocol_t protocol) {
+  memset(&options, 0, sizeof(options));
+  options.connections = 1;
+  options.lambda = 0.0;  // Unpaced: issue up to depth on every drive.
+  options.records = 10000;
+  options.protocol = protocol;
+  strcpy(options.keysize, "30");
+  strcpy(options.valuesize, "200");
+  strcpy(options.keyorder, "none");
+  strcpy(options.ia, "exponential");
+  options.update = 0.1;
+  options.getq_freq = 0.05;
+  options.getq_size = 8;
+  options.time = 1000000;
+  options.depth = 16;
+  options.engine = ENGINE_LIBEVENT;
+  options.clock = CLOCK_SOURCE_MONOTONIC;
+  options.seed = 1;
+  options.threads = options.total_threads = 1;
+  options.hdr_digits = HDR_SIG_DIGITS;
+  options.hdr_max_us = HDR_MAX_US;
+  options.n_intervals = 1;
+}
+
+/*
+ * The canned server.  Requests are moved out of the Connection's
+ * output into requests[], and the replies built in replies[] are
+ * appended to its input.  Every fourth key misses.
+ */
+static char requests[BUFFER_LEN], replies[BUFFER_LEN];
+static char value[VALUE_LEN + 2];
+static long served = 0;
+
+static bool hit() { return ++served % 4 != 0; }
+
+// End of the line at p, which must be complete.
+static const char *line_end(const char *p, const char *end) {
+  const char *e = (const char *) memmem(p, end - p, "\r\n", 2);
+  if (e == NULL) DIE("Partial request line");
+  return e;
+}
+
+static char *add_value(char *out) {
+  memcpy(out, value, VALUE_LEN + 2);
+  return out + VALUE_LEN + 2;
+}
+
+static char *serve_ascii(const char *p, const char *end, char *out) {
+  while (p < end) {
+    const char *e = line_end(p, end);
+
+    if (!strncmp(p, "get ", 4)) {
+      for (const char *k = p + 4; k < e; ) {
+        const char *ke = (const char *) memchr(k, ' ', e - k);
+        if (ke == NULL) ke = e;
+        if (ke > k && hit()) {
+          out += sprintf(out, "VALUE %.*s 0 %d\r\n", (int) (ke - k), k,
+                         VALUE_LEN);
+          out = add_value(out);
+        }
+        k = ke + 1;
+      }
+      out += sprintf(out, "END\r\n");
+      p = e + 2;
+    } else if (!strncmp(p, "set ", 4)) {
+      const char *len = e;
+      while (len[-1] != ' ') len--;
+      p = e + 2 + atoi(len) + 2;
+      out += sprintf(out, "STORED\r\n");
+    } else {
+      DIE("Unexpected request %.*s", (int) (e - p), p);
+    }
+  }
+  return out;
+}
+
+static char *binary_reply(char *out, uint8_t opcode, uint16_t status,
+                          uint32_t opaque, bool with_value) {
+  binary_header_t h;
+  memset(&h, 0, sizeof(h));
+  h.magic = 0x81;
+  h.opcode = opcode;
+  h.extra_len = with_value ? 4 : 0;
+  h.status = htons(status);
+  h.body_len = htonl(with_value ? 4 + VALUE_LEN : 0);
+  h.opaque = opaque;  // Still in network order.
+  memcpy(out, &h, 24);
+  out += 24;
+  if (with_value) {
+    memset(out, 0, 4);  // Flags.
+    memcpy(out + 4, value, VALUE_LEN);
+    out += 4 + VALUE_LEN;
+  }
+  return out;
+}
+
+static char *serve_binary(const char *p, const char *end, char *out) {
+  while (p < end) {
+    binary_header_t h;
+    memcpy(&h, p, 24);
+    p += 24 + ntohl(h.body_len);
+
+    switch (h.opcode) {
+    case CMD_GET:
+      if (hit()) out = binary_reply(out, CMD_GET, 0, h.opaque, true);
+      else out = binary_reply(out, CMD_GET, 1, h.opaque, false);
+      break;
+    case CMD_GETKQ:
+      if (hit()) out = binary_reply(out, CMD_GETKQ, 0, h.opaque, true);
+      break;
+    case CMD_SET:
+    case CMD_NOOP:
+      out = binary_reply(out, h.opcode, 0, h.opaque, false);
+      break;
+    default: DIE("Unexpected opcode %d", h.opcode);
+    }
+  }
+  return out;
+}
+
+// Quiet requests only: misses and stored sets go unanswered.
+static char *serve_meta(const char *p, const char *end, char *out) {
+  while (p < end) {
+    const char *e = line_end(p, end);
+    const char *o = (const char *) memmem(p, e - p, " O", 2);
+
+    if (!strncmp(p, "mg ", 3)) {
+      if (o == NULL) DIE("mg without an opaque");
+      if (hit()) {
+        out += sprintf(out, "VA %d s%d%.*s\r\n", VALUE_LEN, VALUE_LEN,
+                       (int) (e - o), o);
+        out = add_value(out);
+      }
+      p = e + 2;
+    } else if (!strncmp(p, "ms ", 3)) {
+      p = e + 2 + atoi(p + 3 + strcspn(p + 3, " ")) + 2;
+    } else if (!strncmp(p, "mn", 2)) {
+      out += sprintf(out, "MN\r\n");
+      p = e + 2;
+    } else {
+      DIE("Unexpected request %.*s", (int) (e - p), p);
+    }
+  }
+  return out;
+}
+
+// Answer everything conn has sent so far.
+static void serve(Connection *conn) {
+  size_t len = evbuffer_get_length(conn->output);
+  if (len > sizeof(requests)) DIE("Requests overflow the canned server");
+  evbuffer_remove(conn->output, requests, len);
+
+  char *out = replies;
+  switch (conn->options.protocol) {
+  case PROTOCOL_ASCII: out = serve_ascii(requests, requests + len, out); break;
+  case PROTOCOL_BINARY: out = serve_binary(requests, requests + len, out); break;
+  case PROTOCOL_META: out = serve_meta(requests, requests + len, out); break;
+  }
+  evbuffer_add(conn->input, replies, out - replies);
+}
+
+// Complete n requests on conn.
+static void run(Connection *conn, long n) {
+  ConnectionStats &stats = conn->stats;
+  uint64_t done = stats.gets + stats.sets + n;
+
+  while (stats.gets + stats.sets < done) {
+    if (evbuffer_get_length(conn->output) == 0) DIE("No requests issued");
+    serve(conn);
+    conn->read_callback();
+  }
+}
+
+// Warm up, then count allocations over n requests of protocol.
+static long check(const char *name, enum protocol_t protocol,
+                  struct event_base *base, long n) {
+  options_t options;
+  init_options(options, protocol);
+
+  TimerWheel *wheel = new TimerWheel(base);
+  ThreadState *thread = new ThreadState(options, 0);
+  Connection *conn =
+    new Connection(thread, base, NULL, "127.0.0.1", "11211", 0);
+  wheel->attach(conn);
+
+  conn->start_time = get_time();
+  conn->read_state = Connection::IDLE;
+  thread->stats.start = conn->start_time;
+  conn->drive_write_machine();
+
+  run(conn, WARMUP_REQUESTS);
+
+  ConnectionStats &stats = thread->stats;
+  uint64_t gets = stats.gets, sets = stats.sets, misses = stats.get_misses;
+
+  allocs = event_allocs = 0;
+  counting = true;
+  run(conn, n);
+  counting = false;
+
+  printf("%-6s %" PRIu64 " gets (%" PRIu64 " misses), %" PRIu64 " sets: "
+         "%ld allocations, %ld by libevent\n", name, stats.gets - gets,
+         stats.get_misses - misses, stats.sets - sets, allocs, event_allocs);
+  long found = allocs;
+
+  delete conn;
+  delete thread;
+  delete wheel;
+  return found;
+}
+
+int main(int argc, char **argv) {
+  long n = argc > 1 ? atol(argv[1]) : 1000000;
+
+  event_set_mem_functions(event_malloc, event_realloc, event_free);
+  clock_init(CLOCK_SOURCE_MONOTONIC);
+  memset(value, 'x', VALUE_LEN);
+  memcpy(value + VALUE_LEN, "\r\n", 2);
+
+  struct event_base *base = event_base_new();
+  long found = 0;
+  found += check("ascii", PROTOCOL_ASCII, base, n);
+  found += check("binary", PROTOCOL_BINARY, base, n);
+  found += check("meta", PROTOCOL_META, base, n);
+  event_base_free(base);
+
+  if (found > 0) DIE("The request path allocated %ld times", found);
+  printf("ok\n");
+  return 0;
+}
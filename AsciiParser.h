@@ -0,0 +1,100 @@
+// -*- c++-mode -*-
+#ifndef ASCIIPARSER_H
+#define ASCIIPARSER_H
+
+#include <stddef.h>
+#include <string.h>
+
+#include <event2/buffer.h>
+
+/*
+ * Zero-copy line scanning for the text protocols (ASCII and meta).
+ *
+ * evbuffer_readln() mallocs and copies every reply line, and the get
+ * path then ran sscanf() over the copy just to find the value length.
+ * Here lines are found with memchr() directly in the evbuffer's chains
+ * (glibc's memchr is already SSE2/AVX2 vectorized) and parsed in place.
+ * Only a line that straddles two chains is linearized, by
+ * evbuffer_pullup().  Value bytes are never looked at: the caller
+ * drains them along with the line.
+ */
+
+#define ASCII_PEEK_CHAINS 4
+
+/**
+ * Locate the first line of buf without consuming it.
+ *
+ * @param line  Set to the start of the line.
+ * @param len   Set to the line length, without its CRLF (or bare LF).
+ * @return      Bytes to drain to consume the line including its EOL, or
+ *              0 if buf does not hold a complete line yet.
+ */
+static inline size_t ascii_peek_line(struct evbuffer *buf, const char **line,
+                                     size_t *len) {
+  struct evbuffer_iovec v[ASCII_PEEK_CHAINS];
+  int n = evbuffer_peek(buf, -1, NULL, v, ASCII_PEEK_CHAINS);
+  if (n > ASCII_PEEK_CHAINS) n = ASCII_PEEK_CHAINS;
+  size_t total = 0, off = 0;
+
+  for (int i = 0; i < n && total == 0; i++) {
+    const char *p = (const char *) v[i].iov_base;
+    const char *lf = (const char *) memchr(p, '\n', v[i].iov_len);
+    if (lf != NULL) total = off + (lf - p) + 1;
+    off += v[i].iov_len;
+  }
+
+  if (total == 0) {
+    // The line runs past the chains we peeked at; let libevent find it.
+    if (off == evbuffer_get_length(buf)) return 0;
+    size_t eol_len;
+    struct evbuffer_ptr eol =
+      evbuffer_search_eol(buf, NULL, &eol_len, EVBUFFER_EOL_LF);
+    if (eol.pos < 0) return 0;
+    total = eol.pos + eol_len;
+  }
+
+  const char *s = total <= v[0].iov_len ? (const char *) v[0].iov_base :
+    (const char *) evbuffer_pullup(buf, total);
+  size_t l = total - 1;
+  if (l > 0 && s[l - 1] == '\r') l--;
+
+  *line = s;
+  *len = l;
+  return total;
+}
+
+// Parse the decimal at p.  Returns -1 if there is none.
+static inline long ascii_parse_uint(const char *p, const char *end) {
+  if (p >= end || (unsigned) (*p - '0') > 9) return -1;
+
+  long v = 0;
+  while (p < end && (unsigned) (*p - '0') <= 9) v = v * 10 + (*p++ - '0');
+  return v;
+}
+
+// True if line is exactly s.
+static inline bool ascii_line_is(const char *line, size_t len,
+                                 const char *s, size_t slen) {
+  return len == slen && !memcmp(line, s, slen);
+}
+
+/**
+ * Parse "VALUE <key> <flags> <bytes> [<cas>]".
+ *
+ * @return  <bytes>, or -1 if line is not a VALUE line.
+ */
+static inline long ascii_value_length(const char *line, size_t len) {
+  const char *end = line + len;
+  if (len < 6 || memcmp(line, "VALUE ", 6)) return -1;
+
+  const char *p = line + 6;
+  for (int field = 0; field < 2; field++) {  // Skip <key> and <flags>.
+    p = (const char *) memchr(p, ' ', end - p);
+    if (p == NULL) return -1;
+    p++;
+  }
+
+  return ascii_parse_uint(p, end);
+}
+
+#endif // ASCIIPARSER_H
@@ -0,0 +1,130 @@
+// Accuracy check and microbenchmark for --cdf_tables, the interpolated
+// inverse-CDF tables behind Exponential, GPareto and GEV.
+//
+// Build with "make cdfbench" and run ./cdfbench [n_samples];
+// ./cdfbench --check (run by "make check") skips the timing.
+// For each distribution mcperf draws inter-arrival times or sizes
+// from, the tabulated inverse CDF is compared with the analytic one
+// over a dense grid (worst relative error), and its samples are mapped
+// back through the analytic CDF and checked for uniformity by a
+// Kolmogorov-Smirnov test.  Then time per draw is measured both ways.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <math.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "log.h"
+#include "util.h"
+#include "Generator.h"
+
+#define GRID 1000000
+#define MAX_REL_ERR 1e-3
+
+// Survival function of each distribution: the U that generate(U)
+// maps to x.
+struct dist {
+  const char *name;
+  Generator *exact, *table;
+  double loc, scale, shape;
+  double (*survival)(const dist &d, double x);
+};
+
+static double exp_survival(const dist &d, double x) { return exp(-x / d.scale); }
+
+static double pareto_survival(const dist &d, double x) {
+  return pow(1 + d.shape * (x - d.loc) / d.scale, -1 / d.shape);
+}
+
+static double gev_survival(const dist &d, double x) {
+  return exp(-pow(1 + d.shape * (x - d.loc) / d.scale, -1 / d.shape));
+}
+
+static bool check(const dist &d, long samples) {
+  double worst = 0.0, worst_U = 0.0;
+  for (int i = 1; i < GRID; i++) {
+    double U = (double) i / GRID;
+    double a = d.exact->generate(U), t = d.table->generate(U);
+    double err = fabs(t - a) / MAX(fabs(a), 1e-9);
+    if (err > worst) {
+      worst = err;
+      worst_U = U;
+    }
+  }
+
+  Rng rng(0xdeadbeef);
+  d.table->set_rng(&rng);
+  std::vector<double> u(samples);
+  for (long i = 0; i < samples; i++)
+    u[i] = d.survival(d, d.table->generate());
+  std::sort(u.begin(), u.end());
+
+  double ks = 0.0;
+  for (long i = 0; i < samples; i++)
+    ks = std::max(ks, std::max(u[i] - (double) i / samples,
+                               (i + 1.0) / samples - u[i]));
+  double critical = 1.95 / sqrt((double) samples);  // alpha = 0.001
+
+  bool ok = worst < MAX_REL_ERR && ks < critical;
+  printf("%-12s max rel err %.2e (U=%.4f)  KS D=%.5f (< %.5f)  %s\n", d.name,
+         worst, worst_U, ks, critical, ok ? "ok" : "FAIL");
+  return ok;
+}
+
+static double time_draws(Generator *g, long samples, double *mean) {
+  Rng rng(1);
+  g->set_rng(&rng);
+  double sink = 0.0;
+  double start = get_time_accurate();
+  for (long i = 0; i < samples; i++) sink += g->generate();
+  double t = get_time_accurate() - start;
+  *mean = sink / samples;
+  return t / samples * 1e9;
+}
+
+int main(int argc, char **argv) {
+  bool check_only = argc > 1 && !strcmp(argv[1], "--check");
+  if (check_only) argc--, argv++;
+  long samples = argc > 1 ? atol(argv[1]) : 10000000;
+  bool ok = true;
+
+  // Parameters of --iadist=exponential, fb_ia, fb_value's tail, fb_key.
+  dist dists[] = {
+    {"exponential", new Exponential(1.0), new Exponential(1.0),
+     0.0, 1.0, 0.0, exp_survival},
+    {"fb_ia", new GPareto(0, 16.0292, 0.154971),
+     new GPareto(0, 16.0292, 0.154971), 0, 16.0292, 0.154971, pareto_survival},
+    {"fb_value", new GPareto(15.0, 214.476, 0.348238),
+     new GPareto(15.0, 214.476, 0.348238), 15.0, 214.476, 0.348238,
+     pareto_survival},
+    {"fb_key", new GEV(30.7984, 8.20449, 0.078688),
+     new GEV(30.7984, 8.20449, 0.078688), 30.7984, 8.20449, 0.078688,
+     gev_survival},
+  };
+  int n = sizeof(dists) / sizeof(dists[0]);
+
+  for (int i = 0; i < n; i++) {
+    dists[i].table->tabulate();
+    ok &= check(dists[i], samples);
+  }
+
+  if (check_only && !ok)
+    DIE("Tabulated inverse CDFs do not match the analytic ones");
+  if (check_only) return 0;
+
+  for (int i = 0; i < n; i++) {
+    double mean_exact, mean_table;
+    double exact = time_draws(dists[i].exact, samples, &mean_exact);
+    double table = time_draws(dists[i].table, samples, &mean_table);
+    printf("%-12s %6.1f ns/draw analytic  %6.1f ns/draw table  "
+           "(means %.4f %.4f)\n", dists[i].name, exact, table, mean_exact,
+           mean_table);
+  }
+
+  if (!ok) DIE("Tabulated inverse CDFs do not match the analytic ones");
+  return 0;
+}
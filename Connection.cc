@@ -1,4 +1,9 @@
+#include <errno.h>
 #include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
 
 #include <event2/buffer.h>
 #include <event2/bufferevent.h>
@@ -16,31 +21,58 @@
 #include "KeyGenerator.h"
 #include "mcperf.h"
 #include "binary_protocol.h"
+#include "Protocol.h"
+#include "TimerWheel.h"
+#include "Trace.h"
+#include "UringEngine.h"
 #include "util.h"
 
-#define MAX_KEY_LEN 48
-#define MAX_MGET_KEYS 512
-
 int ConnectionStats::details[]={5,10,50,67,75,80,85,90,95,99,999,9999};
 int ConnectionStats::ndetails=sizeof(ConnectionStats::details)/sizeof(int);
 
-Connection::Connection(struct event_base* _base, struct evdns_base* _evdns,
-                       string _hostname, string _port, options_t _options,
-                       bool sampling, 
-					   int key_capacity, int key_reuse, int key_regen) :
-  hostname(_hostname), port(_port), start_time(0),
-  stats(sampling, _options.n_intervals), options(_options), base(_base), evdns(_evdns), read_state(INIT_READ)
+int HdrHistogramSampler::default_digits = HDR_SIG_DIGITS;
+double HdrHistogramSampler::default_max_us = HDR_MAX_US;
+
+ThreadState::ThreadState(const options_t &_options, uint64_t rng_stream,
+                         int key_capacity, int key_reuse, int key_regen) :
+  options(_options), stats(true, _options.n_intervals),
+  rng(_options.seed, rng_stream), trace(NULL)
 {
   valuesize = createGenerator(options.valuesize);
   keysize = createGenerator(options.keysize);
   keyorder = createGenerator(options.keyorder);
+  valuesize->set_rng(&rng);
+  keysize->set_rng(&rng);
+  if (keyorder) keyorder->set_rng(&rng);  // NULL for --keyorder=none.
   if (key_capacity>0) {
-	keygen=new CachingKeyGenerator(keysize, keyorder, options.records, key_capacity, key_reuse, key_regen);
+	keygen=new CachingKeyGenerator(keysize, keyorder, options.protocol, options.records, key_capacity, key_reuse, key_regen);
   } else {
-	keygen=new CachingKeyGenerator(keysize, keyorder, options.records);
+	keygen=new CachingKeyGenerator(keysize, keyorder, options.protocol, options.records);
   }
+  keygen->set_rng(&rng);
   loadgen=new KeyGenerator(keysize,options.records);
 
+  if (options.cdf_tables) valuesize->tabulate();
+}
+
+ThreadState::~ThreadState() {
+  delete loadgen;
+  delete keygen;
+  delete keyorder;
+  delete keysize;
+  delete valuesize;
+}
+
+Connection::Connection(ThreadState *_thread, struct event_base* _base,
+                       struct evdns_base* _evdns, string _hostname,
+                       string _port, uint64_t rng_stream) :
+  hostname(_hostname), port(_port), start_time(0),
+  thread(_thread), stats(_thread->stats), options(_thread->options),
+  op_queue(_thread->options.depth),
+  base(_base), evdns(_evdns), read_state(INIT_READ),
+  fences(_thread->options.depth + 1),
+  rng(_thread->options.seed, rng_stream)
+{
   // DYNAMIC operation
   dyn_agent = options.dyn_agent;
   next_run_time = 0.0;
@@ -49,13 +81,7 @@ Connection::Connection(struct event_base* _base, struct evdns_base* _evdns,
   n_intervals = options.n_intervals;
   curr_id = 0;
   dyn_en = options.dyn_en;
-
-  if(dyn_agent) {
-    lambda_dyn = new double[n_intervals];
-    for(int i = 0; i < n_intervals; i++) {
-      lambda_dyn[i] = options.lambda_dyn[i];
-    }
-  }
+  lambda_dyn = options.lambda_dyn;
 
   if (options.lambda <= 0) {
     iagen = createGenerator("0");
@@ -67,52 +93,79 @@ Connection::Connection(struct event_base* _base, struct evdns_base* _evdns,
     else 
       iagen->set_lambda(options.lambda);
   } 
+  iagen->set_rng(&rng);
+  if (options.cdf_tables) iagen->tabulate();
+
+  // Connections start at different places in the shared key cache.
+  key_cursor = rng.below(thread->keygen->size());
+
+  replay_next = 0;
+  replay_stride = 1;
+  replay_origin = 0.0;
 
   write_state = INIT_WRITE;
 
+  next_opaque = 0;
+  unfenced = false;
+
+  switch (options.protocol) {
+  case PROTOCOL_ASCII: bind_protocol<ProtocolAscii>(); break;
+  case PROTOCOL_BINARY: bind_protocol<ProtocolBinary>(); break;
+  case PROTOCOL_META: bind_protocol<ProtocolMeta>(); break;
+  }
+
   last_tx = last_rx = 0.0;
 
+  fd = -1;
+  uring = NULL;
+  wheel = NULL;
+  timer_deadline = 0.0;
+  bev = NULL;
+
+  if (options.engine == ENGINE_URING) {
+    input = evbuffer_new();
+    output = evbuffer_new();
+    connect_socket();
+    return;
+  }
+
   bev = bufferevent_socket_new(base, -1, BEV_OPT_CLOSE_ON_FREE);
   bufferevent_setcb(bev, bev_read_cb, bev_write_cb, bev_event_cb, this);
   bufferevent_enable(bev, EV_READ | EV_WRITE);
 
+  input = bufferevent_get_input(bev);
+  output = bufferevent_get_output(bev);
+
   if (bufferevent_socket_connect_hostname(bev, evdns, AF_UNSPEC,
                                           hostname.c_str(),
                                           atoi(port.c_str())))
     DIE("bufferevent_socket_connect_hostname()");
-
-  timer = evtimer_new(base, timer_cb, this);
 }
 
 Connection::~Connection() {
-  event_free(timer);
-  timer = NULL;
-
   // FIXME:  W("Drain op_q?");
 
-  bufferevent_free(bev);
+  if (bev) {
+    bufferevent_free(bev);
+  } else {
+    evbuffer_free(input);
+    evbuffer_free(output);
+    if (fd >= 0) close(fd);
+  }
 
   delete iagen;
-  delete keygen;
-  delete keysize;
-  delete valuesize;
-
-  if(dyn_agent) {
-    delete[] lambda_dyn;
-  }
 }
 
 void Connection::reset() {
   // FIXME: Actually check the connection, drain all bufferevents, drain op_q.
   assert(op_queue.size() == 0);
-  evtimer_del(timer);
+  cancel_timer();
   read_state = IDLE;
   write_state = INIT_WRITE;
-  stats = ConnectionStats(stats.sampling, n_intervals);
 }
 
 void Connection::issue_command(char *cmd) {
-	evbuffer_add_printf(bufferevent_get_output(bev), "%s\r\n", cmd);
+	evbuffer_add_printf(output, "%s\r\n", cmd);
 }
 
 void Connection::issue_sasl() {
@@ -125,199 +178,160 @@ void Connection::issue_sasl() {
   header.key_len = htons(5);
   header.body_len = htonl(6 + username.length() + 1 + password.length());
 
-  bufferevent_write(bev, &header, 24);
-  bufferevent_write(bev, "PLAIN\0", 6);
-  bufferevent_write(bev, username.c_str(), username.length() + 1);
-  bufferevent_write(bev, password.c_str(), password.length());
+  evbuffer_add(output, &header, 24);
+  evbuffer_add(output, "PLAIN\0", 6);
+  evbuffer_add(output, username.c_str(), username.length() + 1);
+  evbuffer_add(output, password.c_str(), password.length());
+}
+
+template <class P>
+void Connection::bind_protocol() {
+  read_fn = &Connection::read_replies<P>;
+  write_fn = &Connection::write_requests<P>;
+  load_fn = &Connection::issue_load<P>;
 }
 
-void Connection::issue_get(const char* key, const char *req, double now, int interval) {
-  Operation op;
-  int l;
+template <class P>
+void Connection::issue_get(const char* key, const char *req, double now,
+                           int interval, int key_index) {
+  Operation& op = op_queue.push();
   op.n_req=1;
   op.n_recv=0;
-#if HAVE_CLOCK_GETTIME
-  op.start_time = get_time_accurate();
-#else
-  if (now == 0.0) {
-#if USE_CACHED_TIME
-    struct timeval now_tv;
-    event_base_gettimeofday_cached(base, &now_tv);
-
-    op.start_time = tv_to_double(&now_tv);
-#else
-    op.start_time = get_time();
-#endif
-  } else {
-    op.start_time = now;
-  }
-#endif
+  op.start_time = get_ticks();
+  op.intended_time = op.start_time;
   op.type = Operation::GET;
   op.interval = interval;
-  op.key = string(key);
-  op_queue.push(op);
+  op.key_index = key_index;
+  op.opaque = next_opaque++;
 
   if (read_state == IDLE)
     read_state = WAITING_FOR_GET;
 
-  if (options.binary) {
-    uint16_t keylen = strlen(key);
-    // each line is 4-bytes
-    binary_header_t h = {0x80, CMD_GET, htons(keylen),
-                         0x00, 0x00, {htons(0)}, 
-                         htonl(keylen) };
-
-    bufferevent_write(bev, &h, 24); // size does not include extras
-    bufferevent_write(bev, key, keylen);
-    l = 24 + keylen;
-  } else {
-    if (req == NULL) {
-		l = evbuffer_add_printf(bufferevent_get_output(bev), "get %s\r\n", key);
-    } else {
-    	l = evbuffer_add(bufferevent_get_output(bev), req, strlen(req));
-    }
-  }
+  int l = P::get(*this, key, req);
 
   if (read_state != LOADING) stats.tx_bytes += l;
-
 }
 
+template <class P>
 void Connection::issue_multi_get(int nkeys, double now, int interval) {
-  Operation op;
-  int l=0;
-  char* key;
-  uint16_t keylen ;
+  Operation& op = op_queue.push();
+  op.n_req=nkeys;
   op.n_recv=0;
-  op.n_req=1;
-
-#if HAVE_CLOCK_GETTIME
-  op.start_time = get_time_accurate();
-#else
-  if (now == 0.0) {
-#if USE_CACHED_TIME
-    struct timeval now_tv;
-    event_base_gettimeofday_cached(base, &now_tv);
-
-    op.start_time = tv_to_double(&now_tv);
-#else
-    op.start_time = get_time();
-#endif
-  } else {
-    op.start_time = now;
-  }
-#endif
-
-	op.type = Operation::GET;
+  op.start_time = get_ticks();
+  op.intended_time = op.start_time;
+  op.type = Operation::GET;
   op.interval = interval;
-	op.n_req=nkeys;
-	op_queue.push(op);
-
+  op.key_index = -1;
+  op.opaque = next_opaque++;
 
   if (read_state == IDLE)
     read_state = WAITING_FOR_GET;
 
-  if (options.binary) {
-	int n;
-    // each line is 4-bytes
-    binary_header_t h = {0x80, CMD_MGET, htons(keylen),
-                         0x00, 0x00, {htons(0)}, //TODO(syang0) get actual vbucket?
-                         htonl(keylen) };
-
-    binary_header_t nh = {0x80, CMD_NOOP, 0,
-                         0x00, 0x00, {htons(0)}, //TODO(syang0) get actual vbucket?
-                         0 };
-						 
-	for (n=0; n<nkeys; n++) {
-		op.key = keygen->generate(lrand48() % options.records);
-		keylen=op.key.size();
-		h.key_len=htons(keylen);
-		//op_queue.push(op);
-		bufferevent_write(bev, &h, 24); // size does not include extras
-		bufferevent_write(bev, op.key.c_str(), keylen);
-		l += 24 + keylen;
-	}
-	// Last, flush with NOOP
-		bufferevent_write(bev, &nh, 24); // size does not include extras
-		l += 24;
-  } else {
-	int n,keylen=0;
-	char keys[MAX_KEY_LEN * MAX_MGET_KEYS];
-	char *p=keys;
-	for (n=0; n<nkeys; n++) {
-		op.key = keygen->generate(lrand48() % options.records);
-		int curlen=op.key.size();
-		keylen+=curlen+1;
-		if (keylen > (MAX_KEY_LEN * MAX_MGET_KEYS))
-			break;
-		//op_queue.push(op);
-		sprintf(p,"%s ",op.key.c_str());
-		p+=curlen+1;
-	}
-	op.n_req=nkeys;
-    l = evbuffer_add_printf(bufferevent_get_output(bev), "get %s\r\n", keys);
-  }
+  int l = P::multi_get(*this, nkeys);
 
   if (read_state != LOADING) stats.tx_bytes += l;
 }
 
-void Connection::issue_set(const char* key, const char* value, int length,
-                           double now, int interval) {
-  Operation op;
-  int l;
-  uint16_t keylen = strlen(key);
+template <class P>
+void Connection::issue_set(const char* key, const char *req, const char* value,
+                           int length, double now, int interval,
+                           int key_index, int ttl) {
+  Operation& op = op_queue.push();
 
-#if HAVE_CLOCK_GETTIME
-  op.start_time = get_time_accurate();
-#else
-  if (now == 0.0) op.start_time = get_time();
-  else op.start_time = now;
-#endif
+  op.start_time = get_ticks();
+  op.intended_time = op.start_time;
 
   op.type = Operation::SET;
   op.interval = interval;
-  op_queue.push(op);
+  op.n_req = 1;
+  op.n_recv = 0;
+  op.key_index = key_index;
+  op.opaque = next_opaque++;
 
   if (read_state == IDLE)
     read_state = WAITING_FOR_SET;
 
-  if (options.binary) {
-    // each line is 4-bytes
-    binary_header_t h = { 0x80, CMD_SET, htons(keylen),
-                          0x08, 0x00, {htons(0)}, //TODO(syang0) get actual vbucket?
-                          htonl(keylen + 8 + length)};
-
-    bufferevent_write(bev, &h, 32); // With extras
-    bufferevent_write(bev, key, keylen);
-    bufferevent_write(bev, value, length);
-    l = 24 + h.body_len;
-  } else {
-    l = evbuffer_add_printf(bufferevent_get_output(bev),
-                                "set %s 0 0 %d\r\n", key, length);
-    bufferevent_write(bev, value, length);
-    bufferevent_write(bev, "\r\n", 2);
-    l += length + 2;
-  }
+  int l = P::set(*this, key, req, value, length, ttl);
 
   if (read_state != LOADING) stats.tx_bytes += l;
 }
 
+template <class P>
 void Connection::issue_something(double now, int interval) {
-	const char *key = keygen->generate_next();
+	CachingKeyGenerator *keygen = thread->keygen;
+	uint32_t slot = keygen->next(key_cursor);
+	const char *key = keygen->key(slot);
 	if ((options.update > 0) || (options.getq_freq > 0)) {
-  	if (drand48() < options.update) {
-	    int index = lrand48() % (1024 * 1024);
-			issue_set(key, &random_char[index], valuesize->generate(), now, interval);
+  	if (rng.uniform() < options.update) {
+	    int index = rng.below(1024 * 1024);
+			issue_set<P>(key, keygen->set_req(slot), &random_char[index],
+			             thread->valuesize->generate(), now, interval, slot);
 			return;
 		} else {
-			if (drand48() < options.getq_freq) {
-				issue_multi_get(options.getq_size, now, interval);
+			if (rng.uniform() < options.getq_freq) {
+				issue_multi_get<P>(options.getq_size, now, interval);
 				return;
 			}
 		}
 		//Otherwise fall through to simple get
 	} 
-	const char *req = keygen->current_get_req();
-	issue_get(key, req, now, interval);
+	issue_get<P>(key, keygen->get_req(slot), now, interval, slot);
+}
+
+// Issue the trace record at replay_next.  Key ids are named as the
+// loader names them, unless the record gives a key size.
+template <class P>
+void Connection::issue_record(double now, int interval) {
+  const trace_record_t &r = thread->trace->records[replay_next];
+  char key[max_memcached_len];
+
+  if (r.key_size) KeyGenerator::name(r.key, r.key_size, key);
+  else thread->loadgen->generate(r.key, key);
+
+  if (r.op == TRACE_SET) {
+    int index = rng.below(1024 * 1024);
+    int length = std::min(r.value_size, (uint32_t) 1024 * 1024);
+    issue_set<P>(key, NULL, &random_char[index], length, now, interval, -1,
+                 r.ttl);
+  } else {
+    issue_get<P>(key, NULL, now, interval);
+  }
+}
+
+void Connection::replay(uint64_t first, uint64_t stride) {
+  replay_next = first;
+  replay_stride = stride;
+}
+
+void Connection::set_lambda(double lambda, double now) {
+  // Unpaced connections run the fixed "0" generator; pacing needs
+  // --iadist, and dropping it needs "0" again.
+  if ((lambda > 0.0) != (options.lambda > 0.0)) {
+    delete iagen;
+    iagen = createGenerator(lambda > 0.0 ? options.ia : "0");
+    iagen->set_rng(&rng);
+    if (options.cdf_tables) iagen->tabulate();
+  }
+  iagen->set_lambda(lambda);
+
+  // A send scheduled at the old rate may be far off, or far behind
+  // after running unpaced; start the new schedule now.
+  if (write_state == INIT_WRITE || write_state == REPLAY_DONE) return;
+  next_time = now + iagen->generate();
+  if (write_state == WAITING_FOR_TIME) arm_timer(next_time - now);
+}
+
+// Point next_time at the record at replay_next; once the trace is
+// exhausted, stop sending for good.
+bool Connection::replay_schedule() {
+  if (replay_next >= thread->trace->count) {
+    write_state = REPLAY_DONE;
+    return false;
+  }
+
+  next_time = replay_origin + thread->trace->records[replay_next].time_us /
+    1000000.0 / options.replay_speed;
+  return true;
 }
 
 void Connection::pop_op() {
@@ -352,11 +366,17 @@ bool Connection::check_exit_condition(double now) {
 // command.  Note that this function loops.  Be wary of break
 // vs. return.
 
-void Connection::drive_write_machine(double now) {
+template <class P>
+void Connection::write_requests(double now) {
+  drive_writes<P>(now);
+  P::end_burst(*this);
+}
+
+template <class P>
+void Connection::drive_writes(double now) {
   if (now == 0.0) now = get_time();
 
   double delay;
-  struct timeval tv;
 
   if (check_exit_condition(now)) return;
 
@@ -364,22 +384,29 @@ void Connection::drive_write_machine(double now) {
     switch (write_state) {
       
       case INIT_WRITE:
-        delay = iagen->generate();
+        if (thread->trace) {
+          // Restarting after --warmup resumes the trace where the
+          // warmup left it.
+          replay_origin = replay_origin == 0.0 ?
+            start_time : start_time - options.warmup;
+          if (!replay_schedule()) return;
+          delay = next_time - now;
+        } else {
+          delay = iagen->generate();
+          next_time = now + delay;
+        }
 
-        next_time = now + delay;
         next_run_time = delay;
-        double_to_tv(delay, &tv);
-        evtimer_add(timer, &tv);
+        arm_timer(delay);
 
         write_state = WAITING_FOR_TIME;
         break;
 
       case WAITING_FOR_TIME:
         if (now < next_time) {
-          if (!event_pending(timer, EV_TIMEOUT, NULL)) {
+          if (!timer_pending()) {
             delay = next_time - now;
-            double_to_tv(delay, &tv);
-            evtimer_add(timer, &tv);
+            arm_timer(delay);
           }
           return;
         }
@@ -399,22 +426,39 @@ void Connection::drive_write_machine(double now) {
           //                 now < last_rx + 0.25 / options.lambda) {
         } else if (options.moderate && now < last_rx + 0.00025) {
           write_state = WAITING_FOR_TIME;
-          if (!event_pending(timer, EV_TIMEOUT, NULL)) {
+          if (!timer_pending()) {
             //          delay = last_rx + 0.25 / options.lambda - now;
             delay = last_rx + 0.00025 - now;
             //          I("MODERATE %f %f %f %f %f", now - last_rx, 0.25/options.lambda,
               //            1/options.lambda, now-last_tx, delay);
             
-            double_to_tv(delay, &tv);
-            evtimer_add(timer, &tv);
+            arm_timer(delay);
           }
           return;
         }
 
-        issue_something(now, curr_interval);
+        if (thread->trace) issue_record<P>(now, curr_interval);
+        else issue_something<P>(now, curr_interval);
         last_tx = now;
+
+        // Back-date the op to its scheduled send time so that time
+        // spent waiting on the pipeline counts in corrected latency.
+        if (options.lambda > 0.0 || thread->trace) {
+          double lag = now > next_time ? (now - next_time) * 1000000 : 0.0;
+          if (lag > 0.0) {
+            Operation& op = op_queue.back();
+            op.intended_time = op.start_time - us_to_ticks(lag);
+          }
+          stats.log_tx_lag(lag, curr_interval);
+        }
         stats.log_op(op_queue.size());
 
+        if (thread->trace) {
+          replay_next += replay_stride;
+          if (!replay_schedule()) return;
+          break;
+        }
+
         delay = iagen->generate();
         next_time += delay;
         next_run_time += delay;
@@ -433,7 +477,10 @@ void Connection::drive_write_machine(double now) {
           op_queue.size() >= (size_t) options.depth) {
 
           while (next_time < now - 0.004000) {
-            stats.skips++;
+            // Count the dropped send as the get or set it would have been.
+            Operation::type_enum type = rng.uniform() < options.update ?
+              Operation::SET : Operation::GET;
+            stats.log_skip(type, (now - next_time) * 1000000, curr_interval);
 
             delay = iagen->generate();
             next_time += delay;
@@ -457,6 +504,9 @@ void Connection::drive_write_machine(double now) {
         write_state = ISSUING;
         break;
 
+      case REPLAY_DONE:
+        return;
+
       default: DIE("Not implemented");
 
     }
@@ -471,17 +521,7 @@ void Connection::event_callback(short events) {
     int fd = bufferevent_getfd(bev);
     if (fd < 0) DIE("bufferevent_getfd");
 
-    if (!options.no_nodelay) {
-      int one = 1;
-      if (setsockopt(fd, IPPROTO_TCP, TCP_NODELAY,
-                     (void *) &one, sizeof(one)) < 0)
-        DIE("setsockopt()");
-    }
-
-    if (options.sasl)
-      issue_sasl();
-    else
-      read_state = IDLE;  // This is the most important part!
+    setup_socket(fd);
   } else if (events & BEV_EVENT_ERROR) {
     int err = bufferevent_socket_get_dns_error(bev);
     if (err) DIE("DNS error: %s", evutil_gai_strerror(err));
@@ -492,18 +532,66 @@ void Connection::event_callback(short events) {
   }
 }
 
-void Connection::read_callback() {
-  struct evbuffer *input = bufferevent_get_input(bev);
+void Connection::setup_socket(int fd) {
+  if (!options.no_nodelay) {
+    int one = 1;
+    if (setsockopt(fd, IPPROTO_TCP, TCP_NODELAY,
+                   (void *) &one, sizeof(one)) < 0)
+      DIE("setsockopt()");
+  }
+
+  if (options.sasl)
+    issue_sasl();
+  else
+    read_state = IDLE;  // This is the most important part!
+}
+
+/**
+ * Synchronously connect a raw socket for ENGINE_URING.  The
+ * UringEngine takes over the descriptor once attached.
+ */
+void Connection::connect_socket() {
+  struct evutil_addrinfo hints;
+  struct evutil_addrinfo *answer = NULL;
+
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  hints.ai_protocol = IPPROTO_TCP;
+
+  int err = evutil_getaddrinfo(hostname.c_str(), port.c_str(), &hints, &answer);
+  if (err) DIE("DNS error: %s", evutil_gai_strerror(err));
+
+  fd = socket(answer->ai_family, SOCK_STREAM, IPPROTO_TCP);
+  if (fd < 0) DIE("socket(): %s", strerror(errno));
+
+  if (connect(fd, answer->ai_addr, answer->ai_addrlen))
+    DIE("connect() to %s:%s : %s", hostname.c_str(), port.c_str(), strerror(errno));
+  evutil_freeaddrinfo(answer);
+
+  if (evutil_make_socket_nonblocking(fd)) DIE("evutil_make_socket_nonblocking()");
+
+  D("Connected to %s:%s.", hostname.c_str(), port.c_str());
+  setup_socket(fd);
+}
+
+std::atomic<uint64_t> Connection::keys_to_load(0);
+std::atomic<uint64_t> Connection::keys_loaded(0);
+
+template <class P>
+void Connection::read_replies() {
+  consume_replies<P>();
+  P::end_burst(*this);
+}
+
+template <class P>
+void Connection::consume_replies() {
 #if USE_CACHED_TIME
   struct timeval now_tv;
   event_base_gettimeofday_cached(base, &now_tv);
 #endif
 
-  char *buf = NULL;
   Operation *op = NULL;
-  int length;
-  size_t n_read_out;
-
   double now;
 
   // Protocol processing loop.
@@ -517,219 +605,85 @@ void Connection::read_callback() {
     case INIT_READ: DIE("event from uninitialized connection");
     case IDLE: return;  // We munched all the data we expected?
 
-    // Note: for binary, the whole get suite (GET, GET_DATA, END) is collapsed
-    // into one state
     case WAITING_FOR_GET:
-      assert(op_queue.size() > 0);
-
-      if (options.binary) {
-        if (consume_binary_response(input)) {
-#if USE_CACHED_TIME
-            now = tv_to_double(&now_tv);
-#else
-            now = get_time();
-#endif
-#if HAVE_CLOCK_GETTIME
-            op->end_time = get_time_accurate();
-#else
-            op->end_time = now;
-#endif
-            stats.log_get(*op);
-
-            last_rx = now;
-            pop_op();
-            drive_write_machine(now);
-            break;
-        } else {
-          return;
-        }
-      }
-
-      buf = evbuffer_readln(input, &n_read_out, EVBUFFER_EOL_CRLF);
-      if (buf == NULL) return;  // A whole line not received yet. Punt.
-
-      stats.rx_bytes += n_read_out; // strlen(buf);
-
-      if (!strcmp(buf, "END")) {
-        //        D("GET (%s) miss.", op->key.c_str());
-        stats.get_misses++;
-
-#if USE_CACHED_TIME
-        now = tv_to_double(&now_tv);
-#else
-        now = get_time();
-#endif
-#if HAVE_CLOCK_GETTIME
-        op->end_time = get_time_accurate();
-#else
-        op->end_time = now;
-#endif
-
-        stats.log_get(*op);
-
-        free(buf);
-
-        last_rx = now;
-        pop_op();
-        drive_write_machine();
-        break;
-      } else if (!strncmp(buf, "VALUE", 5)) {
-        sscanf(buf, "VALUE %*s %*d %d", &length);
-
-        // FIXME: check key name to see if it corresponds to the op at
-        // the head of the op queue?  This will be necessary to
-        // support "gets" where there may be misses.
-
-        data_length = length;
-        read_state = WAITING_FOR_GET_DATA;
-	D("[%s]:%s\n",port.c_str(),buf);
-      } else {
-	D("[%s]: *** GOT %s\n",port.c_str(),buf);
-	free(buf);
-	break;
-	}
-
-      free(buf);
-
     case WAITING_FOR_GET_DATA:
-      assert(op_queue.size() > 0);
-
-      length = evbuffer_get_length(input);
-
-      if (length >= data_length + 2) {
-        // FIXME: Actually parse the value?  Right now we just drain it.
-      	//buf = evbuffer_readln(input, &n_read_out, EVBUFFER_EOL_CRLF);
-        evbuffer_drain(input, data_length + 2);
-        D("[%s]:len=%d datalen=%d\n",port.c_str(),length,data_length);
-	//free(buf);
-        read_state = WAITING_FOR_END;
-
-        stats.rx_bytes += data_length + 2;
-		op->n_recv++;
-      } else {
-        return;
-      }
     case WAITING_FOR_END:
+    case WAITING_FOR_SET:
       assert(op_queue.size() > 0);
 
-      buf = evbuffer_readln(input, &n_read_out, EVBUFFER_EOL_CRLF);
-      if (buf == NULL) return; // Haven't received a whole line yet. Punt.
+      switch (P::read(*this, op)) {
+      case PROTO_INCOMPLETE: return;
+      case PROTO_PROGRESS: break;
+      case PROTO_UNSOLICITED: break;
 
-      stats.rx_bytes += n_read_out;
-	  if (!strncmp(buf, "VALUE", 5)) { /* We are in the middle of multi get */
-        sscanf(buf, "VALUE %*s %*d %d", &length);
-        /* FIXME: check key name since this is gets, may be a miss... */
-        data_length = length;
-        read_state = WAITING_FOR_GET_DATA;
+      case PROTO_VALUE:  // Another value of a multi-get.
 #if USE_CACHED_TIME
         now = tv_to_double(&now_tv);
 #else
         now = get_time();
 #endif
-#if HAVE_CLOCK_GETTIME
-        op->end_time = get_time_accurate();
-#else
-        op->end_time = now;
-#endif
+        op->end_time = get_ticks();
         stats.log_get(*op);
-		
-	D("[%s]: - %s\n",port.c_str(),buf);
-	free(buf);
-        drive_write_machine(now);
-		break;
-	  }
-
+        drive_writes<P>(now);
+        break;
 
-      if (!strcmp(buf, "END")) {
-	D("[%s]: END \n",port.c_str());
+      case PROTO_DONE:
+      case PROTO_FAILED:
 #if USE_CACHED_TIME
         now = tv_to_double(&now_tv);
 #else
         now = get_time();
 #endif
-#if HAVE_CLOCK_GETTIME
-        op->end_time = get_time_accurate();
-#else
-        op->end_time = now;
-#endif
-
-        stats.log_get(*op);
-
-        free(buf);
+        op->end_time = get_ticks();
+        if (op->type == Operation::GET) stats.log_get(*op);
+        else stats.log_set(*op);
 
         last_rx = now;
         pop_op();
-        drive_write_machine(now);
+        drive_writes<P>(now);
         break;
-      } else {
-	D("Wanted END got %s\n",buf);
-        DIE("Unexpected result when waiting for END");
       }
-
-    case WAITING_FOR_SET:
-      assert(op_queue.size() > 0);
-
-      if (options.binary) {
-        if (!consume_binary_response(input)) return;
-      } else {
-        buf = evbuffer_readln(input, &n_read_out, EVBUFFER_EOL_CRLF);
-        if (buf == NULL) return; // Haven't received a whole line yet. Punt.
-        stats.rx_bytes += n_read_out;
-      }
-
-      now = get_time();
-
-#if HAVE_CLOCK_GETTIME
-      op->end_time = get_time_accurate();
-#else
-      op->end_time = now;
-#endif
-
-      stats.log_set(*op);
-
-      if (!options.binary)
-        free(buf);
-
-      last_rx = now;
-      pop_op();
-      drive_write_machine(now);
       break;
 
     case LOADING:
       assert(op_queue.size() > 0);
 
-      if (options.binary) {
-        if (!consume_binary_response(input)) return;
-      } else {
-        buf = evbuffer_readln(input, NULL, EVBUFFER_EOL_CRLF);
-        if (buf == NULL) return; // Haven't received a whole line yet.
-        free(buf);
-      }
+      switch (P::read(*this, op)) {
+      case PROTO_INCOMPLETE: return;
+      case PROTO_PROGRESS:
+      case PROTO_VALUE: break;
 
-      loader_completed++;
-      pop_op();
-
-      if (loader_completed == options.records) {
-        D("Finished loading.");
-        read_state = IDLE;
-      } else {
-        while (loader_issued < loader_completed + LOADER_CHUNK) {
-          if (loader_issued >= options.records) break;
-
-          char key[256];
-          string keystr = loadgen->generate(loader_issued);
-          strcpy(key, keystr.c_str());
-          int index = lrand48() % (1024 * 1024);
-          issue_set(key, &random_char[index], valuesize->generate());
-          loader_issued++;
+      case PROTO_UNSOLICITED:
+        // Only failed quiet sets are answered.
+        loader_errors++;
+        break;
+
+      case PROTO_FAILED:
+        loader_errors++;
+        // Fall through.
+      case PROTO_DONE:
+        loader_completed += op->n_req;
+        keys_loaded += op->n_req;
+        pop_op();
+
+        if (loader_completed == loader_count) {
+          D("Finished loading.");
+          if (loader_errors)
+            W("%d of %d sets failed while loading %s:%s.", loader_errors,
+              loader_count, hostname.c_str(), port.c_str());
+          read_state = IDLE;
+          op_queue.resize(options.depth);
+          fences.resize(options.depth + 1);
+        } else {
+          issue_load<P>();
         }
+        break;
       }
-
       break;
 
     case WAITING_FOR_SASL:
-      assert(options.binary);
-      if (!consume_binary_response(input)) return;
+      assert(options.protocol == PROTOCOL_BINARY);
+      if (P::read(*this, NULL) == PROTO_INCOMPLETE) return;
       read_state = IDLE;
       break;
 
@@ -738,45 +692,6 @@ void Connection::read_callback() {
   }
 }
 
-/**
- * Tries to consume a binary response (in its entirety) from an evbuffer.
- *
- * @param input evBuffer to read response from
- * @return  true if consumed, false if not enough data in buffer.
- */
-bool Connection::consume_binary_response(evbuffer *input) {
-  // Read the first 24 bytes as a header
-  int length = evbuffer_get_length(input);
-  if (length < 24) return false;
-  binary_header_t* h =
-          reinterpret_cast<binary_header_t*>(evbuffer_pullup(input, 24));
-  assert(h);
-
-  // Not whole response
-  int targetLen = 24 + ntohl(h->body_len);
-  if (length < targetLen) {
-    return false;
-  }
-
-  // if something other than success, count it as a miss
-  if (h->opcode == CMD_GET && h->status) {
-      stats.get_misses++;
-  }
-
-  #define unlikely(x)     __builtin_expect((x),0)
-  if (unlikely(h->opcode == CMD_SASL)) {
-    if (h->status == RESP_OK) {
-      V("SASL authentication succeeded");
-    } else {
-      DIE("SASL authentication failed");
-    }
-  }
-
-  evbuffer_drain(input, targetLen);
-  stats.rx_bytes += targetLen;
-  return true;
-}
-
 void Connection::write_callback() {}
 void Connection::timer_callback() { drive_write_machine(); }
 
@@ -796,30 +711,80 @@ void bev_write_cb(struct bufferevent *bev, void *ptr) {
   conn->write_callback();
 }
 
-void timer_cb(evutil_socket_t fd, short what, void *ptr) {
-  Connection* conn = (Connection*) ptr;
-  conn->timer_callback();
-}
-
 void Connection::set_priority(int pri) {
+  if (bev == NULL) return;
   if (bufferevent_priority_set(bev, pri))
     DIE("bufferevent_set_priority(bev, %d) failed", pri);
 }
 
-void Connection::start_loading() {
+void Connection::arm_timer(double delay) {
+  timer_deadline = get_time() + delay;
+  wheel->add(this, timer_deadline);
+}
+
+bool Connection::timer_pending() { return timer_deadline > 0.0; }
+
+void Connection::cancel_timer() { timer_deadline = 0.0; }
+
+void Connection::start_loading(int first, int count) {
   read_state = LOADING;
-  loader_issued = loader_completed = 0;
-
-  for (int i = 0; i < LOADER_CHUNK; i++) {
-    if (loader_issued >= options.records) break;
-
-    char key[256];
-    int index = lrand48() % (1024 * 1024);
-    string keystr = loadgen->generate(loader_issued);
-    strcpy(key, keystr.c_str());
-          //    generate_key(loader_issued, options.keysize, key);
-    //    issue_set(key, &random_char[index], options.valuesize);
-    issue_set(key, &random_char[index], valuesize->generate());
-    loader_issued++;
+  loader_first = first;
+  loader_count = count;
+  loader_issued = loader_completed = loader_errors = 0;
+
+  if (count <= 0) {
+    read_state = IDLE;
+    return;
   }
+
+  keys_to_load += count;
+  op_queue.resize(LOADER_CHUNK);
+  fences.resize(LOADER_CHUNK + 1);
+  (this->*load_fn)();
+}
+
+/**
+ * Keep up to LOADER_CHUNK loader sets in flight.  Protocols with quiet
+ * sets (SETQ) follow every LOADER_BATCH of them with a NOOP, so the
+ * server only answers once per batch (plus once per failed set).
+ */
+template <class P>
+void Connection::issue_load() {
+  while (loader_issued < loader_count &&
+         loader_issued < loader_completed + LOADER_CHUNK) {
+    int n = P::quiet_load ?
+      std::min(LOADER_BATCH, loader_count - loader_issued) : 1;
+
+    for (int i = 0; i < n; i++) {
+      const string &key =
+        thread->loadgen->generate(loader_first + loader_issued + i);
+      int index = rng.below(1024 * 1024);
+      if (P::quiet_load)
+        P::setq(*this, key.c_str(), &random_char[index],
+                thread->valuesize->generate());
+      else
+        issue_set<P>(key.c_str(), NULL, &random_char[index],
+                     thread->valuesize->generate());
+    }
+
+    if (P::quiet_load) issue_noop<P>(n);
+    loader_issued += n;
+  }
+}
+
+// Close a batch of nkeys quiet sets; its reply completes the batch.
+template <class P>
+void Connection::issue_noop(int nkeys) {
+  Operation& op = op_queue.push();
+
+  op.start_time = get_ticks();
+  op.intended_time = op.start_time;
+  op.type = Operation::SET;
+  op.interval = 0;
+  op.n_req = nkeys;
+  op.n_recv = 0;
+  op.key_index = -1;
+  op.opaque = next_opaque++;
+
+  P::noop(*this);
 }
@@ -1,6 +1,8 @@
 // -*- c++-mode -*-
+#ifndef CONNECTION_H
+#define CONNECTION_H
 
-#include <queue>
+#include <atomic>
 #include <string>
 #include <random>
 #include <chrono>
@@ -18,6 +20,8 @@
 #include "Generator.h"
 #include "KeyGenerator.h"
 #include "Operation.h"
+#include "Random.h"
+#include "Trace.h"
 #include "util.h"
 
 using namespace std;
@@ -25,14 +29,54 @@ using namespace std;
 void bev_event_cb(struct bufferevent *bev, short events, void *ptr);
 void bev_read_cb(struct bufferevent *bev, void *ptr);
 void bev_write_cb(struct bufferevent *bev, void *ptr);
-void timer_cb(evutil_socket_t fd, short what, void *ptr);
+
+class TimerWheel;
+class UringEngine;
+class ProtocolAscii;
+class ProtocolBinary;
+class ProtocolMeta;
+
+/*
+ * ThreadState: what all Connections of one thread share -- options,
+ * stats, the key cache and the key and value size generators, which
+ * draw from the thread's own Rng.  A Connection keeps only what must
+ * differ per socket (buffers, in-flight queue, read and write state,
+ * its send schedule), a few KB, so 100k of them fit in a few hundred
+ * MB.  Under --seed the thread's key and value size sequence stays
+ * reproducible; which connection sends which key depends on timing.
+ */
+class ThreadState {
+public:
+  ThreadState(const options_t &_options, uint64_t rng_stream,
+              int key_capacity = 0, int key_reuse = 100, int key_regen = 1);
+  ~ThreadState();
+
+  options_t options;
+  ConnectionStats stats;
+
+  Rng rng;
+  Generator *valuesize;
+  Generator *keysize;
+  Generator *keyorder;
+  KeyGenerator *loadgen;
+  CachingKeyGenerator *keygen;
+  const Trace *trace;  // --replay, else NULL.
+
+private:
+  ThreadState(const ThreadState&) = delete;
+  ThreadState& operator=(const ThreadState&) = delete;
+};
 
 class Connection {
+  // Wire protocol policies, see Protocol.h.
+  friend class ProtocolAscii;
+  friend class ProtocolBinary;
+  friend class ProtocolMeta;
+
 public:
-  Connection(struct event_base* _base, struct evdns_base* _evdns,
-             string _hostname, string _port, options_t options,
-             bool sampling = true,
-			 int key_capacity=0, int key_reuse=100, int key_regen=1);
+  Connection(ThreadState *_thread, struct event_base* _base,
+             struct evdns_base* _evdns, string _hostname, string _port,
+             uint64_t rng_stream);
   ~Connection();
 
   string hostname;
@@ -57,13 +101,15 @@ public:
     ISSUING,
     WAITING_FOR_TIME,
     WAITING_FOR_OPQ,
+    REPLAY_DONE,
     MAX_WRITE_STATE,
   };
 
   read_state_enum read_state;
   write_state_enum write_state;
 
-  ConnectionStats stats;
+  ThreadState *thread;
+  ConnectionStats &stats;  // The thread's.
 
   // Dynamic
   int dyn_agent;
@@ -75,40 +121,76 @@ public:
   int n_intervals;
   int dyn_en;
 
-  void issue_get(const char* key, const char *req, double now = 0.0, int interval = 0);
+  // Request issuers, specialized per protocol policy P.
+  template <class P>
+  void issue_get(const char* key, const char *req, double now = 0.0,
+                 int interval = 0, int key_index = -1);
+  template <class P>
   void issue_multi_get(int nkeys=50, double now=0.0, int interval = 0);
-  void issue_set(const char* key, const char* value, int length,
-                 double now = 0.0, int interval = 0);
+  template <class P>
+  void issue_set(const char* key, const char *req, const char* value,
+                 int length, double now = 0.0, int interval = 0, int key_index = -1,
+                 int ttl = 0);
+  template <class P>
   void issue_something(double now = 0.0, int interval = 0);
+  template <class P>
+  void issue_record(double now = 0.0, int interval = 0);
   void issue_command(char *cmd);
   void issue_command(char const *cmd) { issue_command(const_cast<char *>(cmd)); }
   void pop_op();
   bool check_exit_condition(double now = 0.0);
-  void drive_write_machine(double now = 0.0);
+  void drive_write_machine(double now = 0.0) { (this->*write_fn)(now); }
 
-  void start_loading();
+  // Load keys [first, first + count) into the server.
+  void start_loading(int first, int count);
+
+  // Under --replay, send trace records first, first + stride, ... at
+  // their recorded times instead of generating requests.
+  void replay(uint64_t first, uint64_t stride);
+  // Switch to lambda requests/s from now on, drawing the next send
+  // time afresh.  options.lambda must still hold the old rate.
+  void set_lambda(double lambda, double now);
+  // Keys assigned to and stored by all loading Connections in this
+  // process.
+  static std::atomic<uint64_t> keys_to_load, keys_loaded;
 
   void reset();
   void issue_sasl();
 
   void event_callback(short events);
-  void read_callback();
+  void read_callback() { (this->*read_fn)(); }
   void write_callback();
   void timer_callback();
-  bool consume_binary_response(evbuffer *input);
 
   void set_priority(int pri);
 
-  options_t options;
+  // Timer used to control inter-transmission time, kept in the
+  // thread's TimerWheel.
+  void arm_timer(double delay);
+  bool timer_pending();
+  void cancel_timer();
+
+  options_t &options;  // The thread's.
+
+  OpQueue op_queue;
 
-  std::queue<Operation> op_queue;
+  // Under ENGINE_URING the socket and buffers are owned by the
+  // Connection and driven by the thread's UringEngine.
+  int fd;
+  UringEngine *uring;
+  TimerWheel *wheel;
+  double timer_deadline;  // 0.0 when no timer is armed.
+
+  struct evbuffer *input;
+  struct evbuffer *output;
 
 private:
   struct event_base *base;
   struct evdns_base *evdns;
   struct bufferevent *bev;
 
-  struct event *timer;  // Used to control inter-transmission time.
+  void connect_socket();
+  void setup_socket(int fd);
   //  double lambda;
   double next_time; // Inter-transmission time parameters.
   double last_rx; // Used to moderate transmission rate.
@@ -116,14 +198,43 @@ private:
 
   int data_length;  // When waiting for data, how much we're peeking for.
 
-  // Parameters to track progress of the data loader.
-  int loader_issued, loader_completed;
+  uint32_t key_cursor;  // Next slot of the thread's key cache.
 
-  Generator *valuesize;
-  Generator *keysize;
-  Generator *keyorder;
-  KeyGenerator *loadgen;
-  CachingKeyGenerator *keygen;
+  // --replay: the next trace record to send, and the wall time the
+  // trace's time 0 corresponds to.
+  uint64_t replay_next, replay_stride;
+  double replay_origin;
+  bool replay_schedule();
+
+  // For protocols that match replies by opaque (meta): the opaque of
+  // the next op, and of the last op before each batch terminator in
+  // flight.  unfenced is set while quiet requests await a terminator.
+  uint32_t next_opaque;
+  OpaqueQueue fences;
+  bool unfenced;
+
+  // Parameters to track progress of the data loader.  Counts are
+  // relative to loader_first.
+  int loader_first, loader_count;
+  int loader_issued, loader_completed;
+  int loader_errors;
+
+  // Protocol-specific paths, bound once by bind_protocol().
+  void (Connection::*read_fn)();
+  void (Connection::*write_fn)(double now);
+  void (Connection::*load_fn)();
+
+  template <class P> void bind_protocol();
+  template <class P> void read_replies();
+  template <class P> void consume_replies();
+  template <class P> void write_requests(double now);
+  template <class P> void drive_writes(double now);
+  template <class P> void issue_load();
+  template <class P> void issue_noop(int nkeys);
+
+  Rng rng;  // Drives iagen and this Connection's other draws.
   Generator *iagen;
 
 };
+
+#endif // CONNECTION_H
@@ -2,23 +2,40 @@
 #define CONNECTIONOPTIONS_H
 
 #include "distributions.h"
+#include "util.h"
 
 #define MAX_DYN   32
 
+// Wire protocol spoken by Connections (--protocol).
+enum protocol_t { PROTOCOL_ASCII, PROTOCOL_BINARY, PROTOCOL_META };
+
+// Event engine driving a thread's Connections (--engine).
+enum engine_t { ENGINE_LIBEVENT, ENGINE_URING };
+
 typedef struct {
   int connections;
   bool blocking;
+  double timer_spin;  // Seconds.
   double lambda;
   int qps;
   int records;
+  int load_first, load_count;  // This instance's share of the records.
+  // This instance's threads are thread_offset .. thread_offset +
+  // threads - 1 of total_threads over the master and all agents.
+  int thread_offset, total_threads;
+
+  char replay[256];     // Trace to replay (--replay), "" if none.
+  double replay_speed;
 
-  bool binary;
+  enum protocol_t protocol;
+  bool meta_replies;  // meta: no q flags, so no mn batching.
+  bool meta_base64;
   bool sasl;
   char username[32];
   char password[32];
 
-  char keysize[32];
-  char valuesize[32];
+  char keysize[256];    // Distributions; file:<path> needs the room.
+  char valuesize[256];
   char keyorder[32];
   // int keysize;
   //  int valuesize;
@@ -32,8 +49,14 @@ typedef struct {
   bool loadonly;
   int depth;
   bool no_nodelay;
+  enum engine_t engine;
+  enum clock_source_t clock;
   bool noload;
   int threads;
+  // Connections seed their Rng from seed and their (agent, thread,
+  // connection) position.  agent_id is 0 on the master.
+  uint64_t seed;
+  int agent_id;
   enum distribution_t iadist;
   int warmup;
   bool skip;
@@ -45,9 +68,19 @@ typedef struct {
   bool oob_thread;
 
   bool moderate;
+  bool cdf_tables;
   double getq_freq;
   int getq_size;
 
+  // Latency histogram layout; agents must match the master.
+  int hdr_digits;
+  double hdr_max_us;
+
+  int live_ms;  // Live reporting period (--live), 0 if disabled.
+  // Measurement window of the online QPS controller (--search_window),
+  // 0 if the offered QPS is fixed for the run.
+  int control_ms;
+
   int dyn_agent;
   int dyn_en;
   int trace_en;
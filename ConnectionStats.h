@@ -8,9 +8,10 @@
 #include <iostream>
 
 #include "AgentStats.h"
+#include "LiveStats.h"
 #include "Operation.h"
 
-#include "LogHistogramSampler.h"
+#include "HdrHistogramSampler.h"
 
 using namespace std;
 
@@ -22,9 +23,14 @@ using namespace std;
         static int details[];
         static int ndetails;
 
-        LogHistogramSampler get_sampler;
-        LogHistogramSampler set_sampler;
-        LogHistogramSampler op_sampler;
+        HdrHistogramSampler get_sampler;
+        HdrHistogramSampler set_sampler;
+        // Latency from the scheduled (not actual) send time.
+        HdrHistogramSampler get_co_sampler;
+        HdrHistogramSampler set_co_sampler;
+        HdrHistogramSampler op_sampler;
+        // How late each send went out after its scheduled time.
+        HdrHistogramSampler tx_lag_sampler;
 
         uint64_t rx_bytes, tx_bytes;
         uint64_t gets, sets, get_misses;
@@ -32,6 +38,8 @@ using namespace std;
         uint64_t gets_dyn[MAX_INTERVALS], sets_dyn[MAX_INTERVALS];
 
         double start, stop;
+        double client_cpu;  // Load-generator thread CPU seconds while measuring.
+        LiveRecorder *live;  // Per-thread --live recorder, or NULL.
 
         bool sampling;
         bool plotall;
@@ -40,8 +48,10 @@ using namespace std;
 
         // Constructor
         ConnectionStats(bool _sampling = true, int n_intervals = 1) :
-            get_sampler(LOGSAMPLER_BINS, n_intervals), set_sampler(LOGSAMPLER_BINS, n_intervals), op_sampler(LOGSAMPLER_BINS, n_intervals),
-            rx_bytes(0), tx_bytes(0), gets(0), sets(0), start(0), stop(0), plotall(false),
+            get_sampler(n_intervals), set_sampler(n_intervals),
+            get_co_sampler(n_intervals), set_co_sampler(n_intervals), op_sampler(n_intervals),
+            tx_lag_sampler(n_intervals),
+            rx_bytes(0), tx_bytes(0), gets(0), sets(0), start(0), stop(0), client_cpu(0), live(NULL), plotall(false),
             get_misses(0), skips(0), sampling(_sampling) {
                 
                 this->n_intervals = n_intervals;
@@ -52,9 +62,34 @@ using namespace std;
         }
 
         // Logging functions
-        void log_get(Operation& op) { if (sampling) get_sampler.sample(op); gets++; gets_dyn[op.interval]++;}
-        void log_set(Operation& op) { if (sampling) set_sampler.sample(op); sets++; sets_dyn[op.interval]++;}
+        void log_get(Operation& op) {
+            if (sampling) {
+                get_sampler.sample(op);
+                get_co_sampler.sample(op.corrected_time(), op.interval);
+            }
+            if (live) live->sample_get(op.time());
+            gets++; gets_dyn[op.interval]++;
+        }
+        void log_set(Operation& op) {
+            if (sampling) {
+                set_sampler.sample(op);
+                set_co_sampler.sample(op.corrected_time(), op.interval);
+            }
+            if (live) live->sample_set(op.time());
+            sets++; sets_dyn[op.interval]++;
+        }
+        // A send dropped by --skip, lag us behind its schedule.
+        void log_skip(Operation::type_enum type, double lag, int interval) {
+            if (sampling) {
+                if (type == Operation::SET) set_co_sampler.sample(lag, interval);
+                else get_co_sampler.sample(lag, interval);
+            }
+            skips++;
+        }
         void log_op (double op)     { if (sampling)  op_sampler.sample(op); }
+        void log_tx_lag(double lag, int interval) {
+            if (sampling) tx_lag_sampler.sample(lag, interval);
+        }
     
         // Get overall qps
         double get_qps() {
@@ -79,7 +114,10 @@ using namespace std;
         void accumulate(const ConnectionStats &cs) {
             get_sampler.accumulate(cs.get_sampler);
             set_sampler.accumulate(cs.set_sampler);
+            get_co_sampler.accumulate(cs.get_co_sampler);
+            set_co_sampler.accumulate(cs.set_co_sampler);
             op_sampler.accumulate(cs.op_sampler);
+            tx_lag_sampler.accumulate(cs.tx_lag_sampler);
 
             rx_bytes += cs.rx_bytes;
             tx_bytes += cs.tx_bytes;
@@ -93,6 +131,7 @@ using namespace std;
 
             get_misses += cs.get_misses;
             skips += cs.skips;
+            client_cpu += cs.client_cpu;
 
             start = cs.start;
             stop = cs.stop;
@@ -100,29 +139,58 @@ using namespace std;
 
         // Accumulate - send from agent to master
         void accumulate(const AgentStats &as) {
-            rx_bytes += as.rx_bytes;
-            tx_bytes += as.tx_bytes;
-            gets += as.gets;
-            sets += as.sets;
-            get_misses += as.get_misses;
-            skips += as.skips;
+            rx_bytes += as.bs.rx_bytes;
+            tx_bytes += as.bs.tx_bytes;
+            gets += as.bs.gets;
+            sets += as.bs.sets;
+            get_misses += as.bs.get_misses;
+            skips += as.bs.skips;
+            client_cpu += as.bs.client_cpu;
 
-            start = as.start;
-            stop = as.stop;
+            start = as.bs.start;
+            stop = as.bs.stop;
 
             for(int i = 0; i < n_intervals; i++) {
                 gets_dyn[i] += as.gets_dyn[i];
                 sets_dyn[i] += as.sets_dyn[i];
             }
 
-        #ifdef LOGSAMPLER_BINS
-            for (int i = 0; i < n_intervals; i++) {
-                for (int j=0; j<LOGSAMPLER_BINS; j++) 
-                    get_sampler.bins[i][j]	+=	as.get_bins[i][j];
-                get_sampler.sum[i] 	+=	as.get_sum[i];
-                get_sampler.sum_sq[i]	+=	as.get_sum_sq[i];
+            for (int id = 0; id < AGENT_HIST_MAX; id++)
+                agent_sampler(id).accumulate(as.hists[id]);
+        }
+
+        // Fill as to be sent from agent to master
+        void export_stats(AgentStats &as) {
+            as.bs.rx_bytes = rx_bytes;
+            as.bs.tx_bytes = tx_bytes;
+            as.bs.gets = gets;
+            as.bs.sets = sets;
+            as.bs.get_misses = get_misses;
+            as.bs.skips = skips;
+            as.bs.client_cpu = client_cpu;
+            as.bs.start = start;
+            as.bs.stop = stop;
+
+            for(int i = 0; i < n_intervals; i++) {
+                as.gets_dyn[i] = gets_dyn[i];
+                as.sets_dyn[i] = sets_dyn[i];
+            }
+
+            for (int id = 0; id < AGENT_HIST_MAX; id++)
+                as.hists[id].accumulate(agent_sampler(id));
+        }
+
+        // Sampler carried in AgentStats under wire id
+        HdrHistogramSampler &agent_sampler(int id) {
+            switch (id) {
+            case AGENT_HIST_GET:    return get_sampler;
+            case AGENT_HIST_GET_CO: return get_co_sampler;
+            case AGENT_HIST_SET:    return set_sampler;
+            case AGENT_HIST_SET_CO: return set_co_sampler;
+            case AGENT_HIST_OP:     return op_sampler;
+            case AGENT_HIST_TX_LAG: return tx_lag_sampler;
             }
-        #endif
+            DIE("Unknown agent histogram %d", id);
         }
 
         static void print_header(bool newline=true) {
@@ -138,7 +206,7 @@ using namespace std;
                     printf("\n");
         }
 
-        void print_stats(const char *tag, LogHistogramSampler &sampler,
+        void print_stats(const char *tag, HdrHistogramSampler &sampler,
                         bool newline = true, bool plotit=false, int interval = 0) {
             int i;
             
@@ -178,16 +246,23 @@ using namespace std;
         static int details[];
         static int ndetails;
 
-        LogHistogramSampler get_sampler;
-        LogHistogramSampler set_sampler;
-        LogHistogramSampler op_sampler;
+        HdrHistogramSampler get_sampler;
+        HdrHistogramSampler set_sampler;
+        // Latency from the scheduled (not actual) send time.
+        HdrHistogramSampler get_co_sampler;
+        HdrHistogramSampler set_co_sampler;
+        HdrHistogramSampler op_sampler;
+        // How late each send went out after its scheduled time.
+        HdrHistogramSampler tx_lag_sampler;
 
         uint64_t rx_bytes, tx_bytes;
         uint64_t gets, sets, get_misses;
         uint64_t skips;
-        uint64_t *gets_dyn, *sets_dyn;
+        std::vector<uint64_t> gets_dyn, sets_dyn;
 
         double start, stop;
+        double client_cpu;  // Load-generator thread CPU seconds while measuring.
+        LiveRecorder *live;  // Per-thread --live recorder, or NULL.
 
         bool sampling;
         bool plotall;
@@ -196,25 +271,46 @@ using namespace std;
 
         // Constructor
         ConnectionStats(bool _sampling = true, int n_intervals = 1) :
-            get_sampler(LOGSAMPLER_BINS, n_intervals), set_sampler(LOGSAMPLER_BINS, n_intervals), op_sampler(LOGSAMPLER_BINS, n_intervals),
-            rx_bytes(0), tx_bytes(0), gets(0), sets(0), start(0), stop(0), plotall(false),
+            get_sampler(n_intervals), set_sampler(n_intervals),
+            get_co_sampler(n_intervals), set_co_sampler(n_intervals), op_sampler(n_intervals),
+            tx_lag_sampler(n_intervals),
+            rx_bytes(0), tx_bytes(0), gets(0), sets(0), start(0), stop(0), client_cpu(0), live(NULL), plotall(false),
             get_misses(0), skips(0), sampling(_sampling) {
                 
                 this->n_intervals = n_intervals;
-                gets_dyn = new uint64_t[n_intervals] ();
-                sets_dyn = new uint64_t[n_intervals] ();
-        }
-
-        // Destructor
-        ~ConnectionStats() {
-            delete[] gets_dyn;
-            delete[] sets_dyn;
+                gets_dyn.assign(n_intervals, 0);
+                sets_dyn.assign(n_intervals, 0);
         }
 
         // Logging functions
-        void log_get(Operation& op) { if (sampling) get_sampler.sample(op); gets++; gets_dyn[op.interval]++;}
-        void log_set(Operation& op) { if (sampling) set_sampler.sample(op); sets++; sets_dyn[op.interval]++;}
+        void log_get(Operation& op) {
+            if (sampling) {
+                get_sampler.sample(op);
+                get_co_sampler.sample(op.corrected_time(), op.interval);
+            }
+            if (live) live->sample_get(op.time());
+            gets++; gets_dyn[op.interval]++;
+        }
+        void log_set(Operation& op) {
+            if (sampling) {
+                set_sampler.sample(op);
+                set_co_sampler.sample(op.corrected_time(), op.interval);
+            }
+            if (live) live->sample_set(op.time());
+            sets++; sets_dyn[op.interval]++;
+        }
+        // A send dropped by --skip, lag us behind its schedule.
+        void log_skip(Operation::type_enum type, double lag, int interval) {
+            if (sampling) {
+                if (type == Operation::SET) set_co_sampler.sample(lag, interval);
+                else get_co_sampler.sample(lag, interval);
+            }
+            skips++;
+        }
         void log_op (double op)     { if (sampling)  op_sampler.sample(op); }
+        void log_tx_lag(double lag, int interval) {
+            if (sampling) tx_lag_sampler.sample(lag, interval);
+        }
     
         // Get overall qps
         double get_qps() {
@@ -239,7 +335,10 @@ using namespace std;
         void accumulate(const ConnectionStats &cs) {
             get_sampler.accumulate(cs.get_sampler);
             set_sampler.accumulate(cs.set_sampler);
+            get_co_sampler.accumulate(cs.get_co_sampler);
+            set_co_sampler.accumulate(cs.set_co_sampler);
             op_sampler.accumulate(cs.op_sampler);
+            tx_lag_sampler.accumulate(cs.tx_lag_sampler);
 
             rx_bytes += cs.rx_bytes;
             tx_bytes += cs.tx_bytes;
@@ -253,6 +352,7 @@ using namespace std;
 
             get_misses += cs.get_misses;
             skips += cs.skips;
+            client_cpu += cs.client_cpu;
 
             start = cs.start;
             stop = cs.stop;
@@ -266,6 +366,7 @@ using namespace std;
             sets += as.bs.sets;
             get_misses += as.bs.get_misses;
             skips += as.bs.skips;
+            client_cpu += as.bs.client_cpu;
 
             start = as.bs.start;
             stop = as.bs.stop;
@@ -275,14 +376,42 @@ using namespace std;
                 sets_dyn[i] += as.sets_dyn[i];
             }
 
-        #ifdef LOGSAMPLER_BINS
-            for (int i = 0; i < n_intervals; i++) {
-                for (int j=0; j<LOGSAMPLER_BINS; j++) 
-                    get_sampler.bins[i][j]	+=	as.get_bins[i][j];
-                get_sampler.sum[i] 	+=	as.get_sum[i];
-                get_sampler.sum_sq[i]	+=	as.get_sum_sq[i];
+            for (int id = 0; id < AGENT_HIST_MAX; id++)
+                agent_sampler(id).accumulate(as.hists[id]);
+        }
+
+        // Fill as to be sent from agent to master
+        void export_stats(AgentStats &as) {
+            as.bs.rx_bytes = rx_bytes;
+            as.bs.tx_bytes = tx_bytes;
+            as.bs.gets = gets;
+            as.bs.sets = sets;
+            as.bs.get_misses = get_misses;
+            as.bs.skips = skips;
+            as.bs.client_cpu = client_cpu;
+            as.bs.start = start;
+            as.bs.stop = stop;
+
+            for(int i = 0; i < n_intervals; i++) {
+                as.gets_dyn[i] = gets_dyn[i];
+                as.sets_dyn[i] = sets_dyn[i];
+            }
+
+            for (int id = 0; id < AGENT_HIST_MAX; id++)
+                as.hists[id].accumulate(agent_sampler(id));
+        }
+
+        // Sampler carried in AgentStats under wire id
+        HdrHistogramSampler &agent_sampler(int id) {
+            switch (id) {
+            case AGENT_HIST_GET:    return get_sampler;
+            case AGENT_HIST_GET_CO: return get_co_sampler;
+            case AGENT_HIST_SET:    return set_sampler;
+            case AGENT_HIST_SET_CO: return set_co_sampler;
+            case AGENT_HIST_OP:     return op_sampler;
+            case AGENT_HIST_TX_LAG: return tx_lag_sampler;
             }
-        #endif
+            DIE("Unknown agent histogram %d", id);
         }
 
         static void print_header(bool newline=true) {
@@ -298,7 +427,7 @@ using namespace std;
                     printf("\n");
         }
 
-        void print_stats(const char *tag, LogHistogramSampler &sampler,
+        void print_stats(const char *tag, HdrHistogramSampler &sampler,
                         bool newline = true, bool plotit=false, int interval = 0) {
             int i;
             
@@ -2,8 +2,34 @@
 
 #include "config.h"
 
+#include <errno.h>
+#include <stdio.h>
+
+#include <map>
+#include <mutex>
+
 #include "Generator.h"
 
+InverseCDF::InverseCDF(fn_t _f, double _shape) :
+  f(_f), shape(_shape),
+  step_inv(CDF_TABLE_SIZE / (1.0 - 2 * CDF_TABLE_TAIL)),
+  table(CDF_TABLE_SIZE + 1) {
+  for (int i = 0; i <= CDF_TABLE_SIZE; i++)
+    table[i] = f(CDF_TABLE_TAIL + i / step_inv, shape);
+}
+
+// Connections tabulate their generators from several threads at once;
+// tables live until exit.
+const InverseCDF *InverseCDF::get(fn_t f, double shape) {
+  static std::mutex lock;
+  static std::map<std::pair<fn_t, double>, const InverseCDF *> tables;
+
+  std::lock_guard<std::mutex> l(lock);
+  const InverseCDF *&t = tables[std::make_pair(f, shape)];
+  if (t == NULL) t = new InverseCDF(f, shape);
+  return t;
+}
+
 Generator* createFacebookKey() { return new GEV(30.7984, 8.20449, 0.078688); }
 
 Generator* createFacebookValue() {
@@ -31,10 +57,47 @@ Generator* createFacebookValue() {
 
 Generator* createFacebookIA() { return new GPareto(0, 16.0292, 0.154971); }
 
+// An empirical distribution: one "<value> <weight>" pair per line
+// (space, tab or comma separated), blank lines and # comments ignored.
+// Weights need not sum to 1.
+Generator* createEmpiricalGenerator(const char *path) {
+  FILE *f = fopen(path, "r");
+  if (f == NULL) DIE("fopen(%s) failed: %s", path, strerror(errno));
+
+  std::vector< std::pair<double,double> > pv;  // (weight, value)
+  double total = 0.0;
+  char line[256];
+  int lineno = 0;
+
+  while (fgets(line, sizeof(line), f)) {
+    lineno++;
+    char *p = line + strspn(line, " \t\r\n");
+    if (*p == '\0' || *p == '#') continue;
+
+    double v, w;
+    if (sscanf(p, "%lf%*[ \t,]%lf", &v, &w) != 2 || w < 0.0)
+      DIE("%s:%d: expected \"<value> <weight>\"", path, lineno);
+    pv.push_back(std::pair<double,double>(w, v));
+    total += w;
+  }
+  fclose(f);
+
+  if (total <= 0.0) DIE("%s: no values with positive weight", path);
+
+  Discrete *d = new Discrete();
+  for (size_t i = 0; i < pv.size(); i++)
+    d->add(pv[i].first / total, pv[i].second);
+
+  D("Empirical(%s, %zu values)", path, pv.size());
+  return d;
+}
+
 Generator* createGenerator(std::string str) {
   if (!strcmp(str.c_str(), "fb_key")) return createFacebookKey();
   else if (!strcmp(str.c_str(), "fb_value")) return createFacebookValue();
   else if (!strcmp(str.c_str(), "fb_ia")) return createFacebookIA();
+  else if (!strncmp(str.c_str(), "file:", 5))
+    return createEmpiricalGenerator(str.c_str() + 5);
 
   char *s_copy = new char[str.length() + 1];
   strcpy(s_copy, str.c_str());
@@ -68,6 +131,7 @@ Generator* createGenerator(std::string str) {
   double a1 = s1 ? atof(s1) : 0.0;
   double a2 = s2 ? atof(s2) : 0.0;
   double a3 = s3 ? atof(s3) : 0.0;
+  int nargs = s3 ? 3 : s2 ? 2 : s1 ? 1 : 0;
 
   delete[] s_copy;
 
@@ -77,6 +141,9 @@ Generator* createGenerator(std::string str) {
   else if (strcasestr(str.c_str(), "pareto")) return new GPareto(a1, a2, a3);
   else if (strcasestr(str.c_str(), "gev")) return new GEV(a1, a2, a3);
   else if (strcasestr(str.c_str(), "uniform")) return new Uniform(a1,a2);
+  else if (strcasestr(str.c_str(), "zipf")) return new Zipf(nargs > 0 ? a1 : 0.99);
+  else if (strcasestr(str.c_str(), "latest"))
+    return new ZipfLatest(nargs > 0 ? a1 : 0.99, nargs > 1 ? a2 : 20.0);
   else if (strcasestr(str.c_str(), "none")) return NULL;
 
   DIE("Unable to create Generator '%s'", str.c_str());
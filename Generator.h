@@ -24,6 +24,7 @@
 #include <string.h>
 
 #include "log.h"
+#include "Random.h"
 #include "util.h"
 
 // Generator syntax:
@@ -33,19 +34,61 @@
 // e[xponential]:lambda
 // p[areto]:scale,shape
 // g[ev]:loc,scale,shape
+// zipf:s, latest:s,step (key order only)
+// file:path (empirical "value weight" lines)
 // fb_value, fb_key, fb_rate
 
+#define CDF_TABLE_SIZE 4096
+#define CDF_TABLE_TAIL (1.0 / 64)
+
+/*
+ * Inverse CDF of a unit-scale continuous distribution, tabulated at
+ * CDF_TABLE_SIZE + 1 points over [CDF_TABLE_TAIL, 1 - CDF_TABLE_TAIL]
+ * and linearly interpolated, so a draw costs a multiply and two loads
+ * instead of a log() or pow().  Draws in either tail, where the curve
+ * is too steep to interpolate, are computed exactly.  Tables depend
+ * only on the distribution's shape and are shared by every generator.
+ */
+class InverseCDF {
+public:
+  typedef double (*fn_t)(double U, double shape);
+  static const InverseCDF *get(fn_t f, double shape);
+
+  double operator()(double U) const {
+    double x = (U - CDF_TABLE_TAIL) * step_inv;
+    if (x < 0.0 || x >= CDF_TABLE_SIZE) return f(U, shape);
+    int i = (int) x;
+    return table[i] + (x - i) * (table[i + 1] - table[i]);
+  }
+
+private:
+  InverseCDF(fn_t _f, double _shape);
+
+  fn_t f;
+  double shape, step_inv;
+  std::vector<double> table;
+};
+
 class Generator {
 public:
-  Generator() {}
+  Generator() : rng(NULL) {}
   //  Generator(const Generator &g) = delete;
   //  virtual Generator& operator=(const Generator &g) = delete;
   virtual ~Generator() {}
 
   virtual double generate(double U = -1.0) = 0;
   virtual void set_lambda(double lambda) {DIE("set_lambda() not implemented");}
+  // Draw from r instead of thread_rng().
+  virtual void set_rng(Rng *r) { rng = r; }
+  // Number of keys, for key-order generators that need it.
+  virtual void set_max(double n) {}
+  // Draw from a shared InverseCDF table, where the distribution has one.
+  virtual void tabulate() {}
 protected:
   std::string type;
+  Rng *rng;
+
+  double uniform() { return rng ? rng->uniform() : thread_rng().uniform(); }
 };
 
 class Fixed : public Generator {
@@ -87,7 +130,7 @@ public:
   }
 
   virtual double generate(double U = -1.0) {
-    if (U < 0.0) U = drand48();
+    if (U < 0.0) U = uniform();
     return scale * U + min;
   }
 
@@ -105,7 +148,7 @@ public:
   }
 
   virtual double generate(double U = -1.0) {
-    if (U < 0.0) U = drand48();
+    if (U < 0.0) U = uniform();
     double V = U; // drand48();
     double N = sqrt(-2 * log(U)) * cos(2 * M_PI * V);
     return mean + sd * N;
@@ -122,33 +165,39 @@ private:
 
 class Exponential : public Generator {
 public:
-  Exponential(double _lambda = 1.0) : lambda(_lambda) {
+  Exponential(double _lambda = 1.0) : lambda(_lambda), cdf(NULL) {
     D("Exponential(lambda=%f)", lambda);
   }
 
   virtual double generate(double U = -1.0) {
     if (lambda <= 0.0) return 0.0;
-    if (U < 0.0) U = drand48();
-    return -log(U) / lambda;
+    if (U < 0.0) U = uniform();
+    if (cdf) return (*cdf)(U) / lambda;
+    return unit(U, 0.0) / lambda;
   }
 
   virtual void set_lambda(double lambda) { this->lambda = lambda; }
+  virtual void tabulate() { cdf = InverseCDF::get(unit, 0.0); }
 
 private:
   double lambda;
+  const InverseCDF *cdf;
+
+  static double unit(double U, double) { return -log(U); }
 };
 
 class GPareto : public Generator {
 public:
   GPareto(double _loc = 0.0, double _scale = 1.0, double _shape = 1.0) :
-    loc(_loc), scale(_scale), shape(_shape) {
+    loc(_loc), scale(_scale), shape(_shape), cdf(NULL) {
     assert(shape != 0.0);
     D("GPareto(loc=%f, scale=%f, shape=%f)", loc, scale, shape);
   }
 
   virtual double generate(double U = -1.0) {
-    if (U < 0.0) U = drand48();
-    return loc + scale * (pow(U, -shape) - 1) / shape;
+    if (U < 0.0) U = uniform();
+    if (cdf) return loc + scale * (*cdf)(U);
+    return loc + scale * unit(U, shape);
   }
 
   virtual void set_lambda(double lambda) {
@@ -156,59 +205,235 @@ public:
     else scale = (1 - shape) / lambda - (1 - shape) * loc;
   }
 
+  virtual void tabulate() { cdf = InverseCDF::get(unit, shape); }
+
 private:
   double loc /* mu */;
   double scale /* sigma */, shape /* k */;
+  const InverseCDF *cdf;
+
+  static double unit(double U, double k) { return (pow(U, -k) - 1) / k; }
 };
 
 class GEV : public Generator {
 public:
   GEV(double _loc = 0.0, double _scale = 1.0, double _shape = 1.0) :
-    e(1.0), loc(_loc), scale(_scale), shape(_shape) {
+    e(1.0), loc(_loc), scale(_scale), shape(_shape), cdf(NULL) {
     assert(shape != 0.0);
     D("GEV(loc=%f, scale=%f, shape=%f)", loc, scale, shape);
   }
 
   virtual double generate(double U = -1.0) {
+    if (cdf) {
+      if (U < 0.0) U = uniform();
+      return loc + scale * (*cdf)(U);
+    }
     return loc + scale * (pow(e.generate(U), -shape) - 1) / shape;
   }
 
+  virtual void set_rng(Rng *r) {
+    Generator::set_rng(r);
+    e.set_rng(r);
+  }
+
+  virtual void tabulate() { cdf = InverseCDF::get(unit, shape); }
+
 private:
   Exponential e;
   double loc /* mu */, scale /* sigma */, shape /* k */;
+  const InverseCDF *cdf;
+
+  static double unit(double U, double k) { return (pow(-log(U), -k) - 1) / k; }
 };
 
+/*
+ * Bounded Zipf: rank k in [1, n] with probability proportional to
+ * k^-s, returned as the key index k - 1.  Sampled by
+ * rejection-inversion (Hormann and Derflinger, "Rejection-inversion to
+ * generate variates from monotone discrete distributions", 1996): O(1)
+ * time and space for any n, with fewer than 1.1 draws per sample on
+ * average.  The key space is set by set_max().
+ */
+class Zipf : public Generator {
+public:
+  Zipf(double _s = 0.99, double _n = 1.0) : s(_s) {
+    if (s < 0.0) DIE("Zipf exponent must be >= 0, got %f", s);
+    set_max(_n);
+    D("Zipf(s=%f)", s);
+  }
+
+  virtual void set_max(double _n) {
+    n = _n < 1.0 ? 1.0 : floor(_n);
+    h_integral_x1 = h_integral(1.5) - 1.0;
+    h_integral_n = h_integral(n + 0.5);
+    squeeze = 2.0 - h_integral_inverse(h_integral(2.5) - h(2.0));
+  }
+
+  virtual double generate(double U = -1.0) {
+    for (;;) {
+      if (U < 0.0) U = uniform();
+      double u = h_integral_n + U * (h_integral_x1 - h_integral_n);
+      double x = h_integral_inverse(u);
+      double k = floor(x + 0.5);
+      if (k < 1.0) k = 1.0;
+      else if (k > n) k = n;
+
+      if (k - x <= squeeze || u >= h_integral(k + 0.5) - h(k)) return k - 1.0;
+      U = -1.0;
+    }
+  }
+
+private:
+  double s, n;
+  double h_integral_x1, h_integral_n, squeeze;
+
+  double h(double x) { return exp(-s * log(x)); }
+
+  // Integral of h, and its inverse, kept accurate as s approaches 1.
+  double h_integral(double x) {
+    double log_x = log(x);
+    return expm1_over((1.0 - s) * log_x) * log_x;
+  }
+
+  double h_integral_inverse(double x) {
+    double t = x * (1.0 - s);
+    if (t < -1.0) t = -1.0;
+    return exp(log1p_over(t) * x);
+  }
+
+  static double log1p_over(double x) {  // log(1 + x) / x
+    if (fabs(x) > 1e-8) return log1p(x) / x;
+    return 1.0 - x * (0.5 - x * (1.0 / 3.0 - 0.25 * x));
+  }
+
+  static double expm1_over(double x) {  // (exp(x) - 1) / x
+    if (fabs(x) > 1e-8) return expm1(x) / x;
+    return 1.0 + x * 0.5 * (1.0 + x / 3.0 * (1.0 + 0.25 * x));
+  }
+};
+
+/*
+ * Zipf over recency: the hottest key is the "latest" one, the next
+ * hottest the one before it, and so on.  The latest key moves forward
+ * by one every step draws, so the hot set drifts through the key space
+ * the way YCSB's "latest" follows inserts.
+ */
+class ZipfLatest : public Zipf {
+public:
+  ZipfLatest(double _s = 0.99, double _step = 20.0) :
+    Zipf(_s), step(_step < 1.0 ? 1 : (uint64_t) _step), draws(0), latest(0),
+    keys(1) {
+    D("ZipfLatest(s=%f, step=%" PRIu64 ")", _s, step);
+  }
+
+  virtual void set_max(double _n) {
+    Zipf::set_max(_n);
+    keys = _n < 1.0 ? 1 : (uint64_t) _n;
+  }
+
+  virtual double generate(double U = -1.0) {
+    uint64_t k = (uint64_t) Zipf::generate(U);
+    if (++draws % step == 0) latest = (latest + 1) % keys;
+    return (double) ((latest + keys - k) % keys);
+  }
+
+private:
+  uint64_t step, draws, latest, keys;
+};
+
+/*
+ * Values v_i with probabilities p_i; with the remaining 1 - sum(p_i),
+ * a draw from def instead.  Draws take O(1) from a Walker/Vose alias
+ * table (one uniform picks a column and flips its biased coin), built
+ * on the first draw after add().
+ */
 class Discrete : public Generator {
 public:
   ~Discrete() { delete def; }
-  Discrete(Generator* _def = NULL) : def(_def) {
+  Discrete(Generator* _def = NULL) : def(_def), built(false) {
     if (def == NULL) def = new Fixed(0.0);
   }
 
   virtual double generate(double U = -1.0) {
+    if (pv.empty()) return def->generate(U);
+    if (!built) build();
+
     double Uc = U;
-    if (pv.size() > 0 && U < 0.0) U = drand48();
+    if (U < 0.0) U = uniform();
 
-    double sum = 0;
-	std::vector< std::pair<double,double> >::iterator p; 
-    for (p= pv.begin(); p!= pv.end(); p++ )  {
-      sum += (*p).first;
-      if (U < sum) return (*p).second;
-    }
+    double x = U * prob.size();
+    size_t i = (size_t) x;
+    if (i >= prob.size()) i = prob.size() - 1;
+    size_t o = x - i < prob[i] ? i : alias[i];
+
+    if (o == pv.size()) return def->generate(Uc);
+    return pv[o].second;
+  }
 
-    return def->generate(Uc);
+  virtual void set_rng(Rng *r) {
+    Generator::set_rng(r);
+    def->set_rng(r);
   }
 
+  virtual void tabulate() { def->tabulate(); }
+
   void add(double p, double v) {
     pv.push_back(std::pair<double,double>(p, v));
+    built = false;
   }
 
 private:
   Generator *def;
   std::vector< std::pair<double,double> > pv;
+
+  // Alias table: column i yields outcome i with probability prob[i],
+  // else alias[i].  Outcome pv.size() stands for def.
+  bool built;
+  std::vector<double> prob;
+  std::vector<size_t> alias;
+
+  void build() {
+    std::vector<double> w;
+    double sum = 0.0;
+    for (size_t i = 0; i < pv.size(); i++) {
+      w.push_back(pv[i].first);
+      sum += pv[i].first;
+    }
+    if (sum < 1.0 - 1e-12) {
+      w.push_back(1.0 - sum);
+      sum = 1.0;
+    }
+
+    size_t n = w.size();
+    prob.assign(n, 1.0);
+    alias.resize(n);
+    for (size_t i = 0; i < n; i++) alias[i] = i;
+
+    std::vector<size_t> small, large;
+    for (size_t i = 0; i < n; i++) {
+      w[i] *= n / sum;
+      (w[i] < 1.0 ? small : large).push_back(i);
+    }
+
+    while (!small.empty() && !large.empty()) {
+      size_t s = small.back(), l = large.back();
+      small.pop_back();
+      prob[s] = w[s];
+      alias[s] = l;
+      w[l] -= 1.0 - w[s];
+      if (w[l] < 1.0) {
+        large.pop_back();
+        small.push_back(l);
+      }
+    }
+    // Whatever is left over is 1.0 up to rounding; prob stays 1.0.
+
+    built = true;
+  }
 };
 
 Generator* createGenerator(std::string str);
+Generator* createEmpiricalGenerator(const char *path);
 Generator* createFacebookKey();
 Generator* createFacebookValue();
 Generator* createFacebookIA();
@@ -0,0 +1,276 @@
+/* -*- c++ -*- */
+#ifndef HDRHISTOGRAMSAMPLER_H
+#define HDRHISTOGRAMSAMPLER_H
+
+#include <assert.h>
+#include <inttypes.h>
+#include <math.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "log.h"
+#include "mcperf.h"
+#include "Operation.h"
+
+#define MAX_INTERVALS 32
+//#define STATIC_ALLOC_SAMPLER
+
+// Samples are recorded as integers in units of 1/HDR_UNITS_PER_US us.
+#define HDR_UNITS_PER_US 10
+#define HDR_SIG_DIGITS   2         // 1% worst-case relative error.
+#define HDR_MAX_US       10000000  // 10s; longer samples are clamped.
+// counts_len for the default digits/max, used by STATIC_ALLOC_SAMPLER.
+#define HDR_STATIC_COUNTS 2688
+
+/*
+ * HdrHistogramSampler: HdrHistogram-style latency histogram.
+ *
+ * Values are split into power-of-two buckets, each holding a linear
+ * array of sub-buckets wide enough for the requested number of
+ * significant digits.  The counts index is found with a clz and a few
+ * shifts, so sample() is O(1) with no floating-point log.  Counts for
+ * every interval share one layout, so accumulate() is a plain vector
+ * add.  Counts are also totalled per block of sub_bucket_half_count
+ * counters, so get_nth() and accumulate() skip whole blocks instead of
+ * scanning all counts_len counters.
+ */
+class HdrHistogramSampler {
+public:
+  // Layout used by newly constructed samplers (see configure()).
+  static int default_digits;
+  static double default_max_us;
+
+  int n_intervals;
+
+  int sig_digits;
+  int64_t highest_value;  // In HDR units.
+
+  int sub_bucket_half_count_magnitude;
+  int64_t sub_bucket_count, sub_bucket_half_count, sub_bucket_mask;
+  int bucket_count;
+  int counts_len;
+  int n_blocks;  // counts_len / sub_bucket_half_count.
+
+  std::vector<Operation> samples;
+
+  std::vector<std::vector<uint64_t> > counts;
+  std::vector<std::vector<uint64_t> > block_totals;
+  std::vector<uint64_t> total_count;
+
+  std::vector<double> sum;
+  std::vector<double> sum_sq;
+
+  // Constructor
+  HdrHistogramSampler(int n_intervals = 1, int digits = default_digits,
+                      double max_us = default_max_us) {
+    assert(n_intervals >= 1);
+    assert(digits >= 1 && digits <= 5);
+
+    this->n_intervals = n_intervals;
+    sig_digits = digits;
+    highest_value = (int64_t) (max_us * HDR_UNITS_PER_US);
+    if (highest_value < 2) highest_value = 2;
+
+    int64_t largest_single_unit = 2 * (int64_t) pow(10, digits);
+    int magnitude = (int) ceil(log2((double) largest_single_unit));
+    sub_bucket_half_count_magnitude = magnitude - 1;
+    sub_bucket_count = (int64_t) 1 << magnitude;
+    sub_bucket_half_count = sub_bucket_count / 2;
+    sub_bucket_mask = sub_bucket_count - 1;
+
+    int64_t smallest_untrackable = sub_bucket_count;
+    bucket_count = 1;
+    while (smallest_untrackable <= highest_value) {
+      smallest_untrackable <<= 1;
+      bucket_count++;
+    }
+    n_blocks = bucket_count + 1;
+    counts_len = n_blocks * sub_bucket_half_count;
+
+    counts.assign(n_intervals, std::vector<uint64_t>(counts_len, 0));
+    block_totals.assign(n_intervals, std::vector<uint64_t>(n_blocks, 0));
+    total_count.assign(n_intervals, 0);
+    sum.assign(n_intervals, 0.0);
+    sum_sq.assign(n_intervals, 0.0);
+  }
+
+  // Set the layout for samplers created from now on.  Samplers that
+  // are merged (threads, agents) must share a layout.
+  static void configure(int digits, double max_us) {
+    default_digits = digits;
+    default_max_us = max_us;
+  }
+
+  // Log
+  void sample(const Operation &op) {
+    sample(op.time(), op.interval);
+    if (args.save_given) samples.push_back(op);
+  }
+
+  // Sample
+  void sample(double s, int interval = 0) {
+    assert(s >= 0);
+
+    sum[interval] += s;
+    sum_sq[interval] += s*s;
+
+    int64_t v = (int64_t) (s * HDR_UNITS_PER_US);
+    if (v > highest_value) v = highest_value;
+
+    int i = counts_index(v);
+    counts[interval][i]++;
+    block_totals[interval][i >> sub_bucket_half_count_magnitude]++;
+    total_count[interval]++;
+  }
+
+  // Statistics
+  uint64_t total(int interval = 0) {
+    return total_count[interval];
+  }
+
+  double average(int interval = 0) {
+    return sum[interval] / total(interval);
+  }
+
+  double stddev(int interval = 0) {
+    return sqrt(sum_sq[interval] / total(interval) - pow(sum[interval] / total(interval), 2.0));
+  }
+
+  double minimum(int interval = 0) {
+    for (int b = 0; b < n_blocks; b++) {
+      if (block_totals[interval][b] == 0) continue;
+      for (int i = b << sub_bucket_half_count_magnitude; ; i++)
+        if (counts[interval][i] > 0) return lowest_equivalent(i) / HDR_UNITS_PER_US;
+    }
+    DIE("Not implemented");
+  }
+
+  double get_nth(double nth, int interval = 0) {
+    uint64_t count = total(interval);
+    uint64_t n = 0;
+    double target = count * nth/100;
+
+    if (nth>100.0) {
+      target = count * nth/1000;
+    }
+    if (nth>1000.0) {
+      target = count * nth/10000;
+    }
+
+    const std::vector<uint64_t> &c = counts[interval];
+    const std::vector<uint64_t> &bt = block_totals[interval];
+    for (int b = 0; b < n_blocks; b++) {
+      if (n + bt[b] <= target) {
+        n += bt[b];
+        continue;
+      }
+
+      // The nth is inside this block.
+      for (int i = b << sub_bucket_half_count_magnitude; ; i++) {
+        n += c[i];
+
+        if (n > target) { // The nth is inside counts[i].
+          double left = target - (n - c[i]);
+          return (lowest_equivalent(i) + left / c[i] * bucket_width(i)) /
+            HDR_UNITS_PER_US;
+        }
+      }
+    }
+
+    return (double) highest_value / HDR_UNITS_PER_US;
+  }
+
+  // Accumulation
+  void accumulate(const HdrHistogramSampler &h) {
+    assert(h.counts_len == counts_len);
+
+    for (int i = 0; i < n_intervals; i++) {
+      std::vector<uint64_t> &dst = counts[i];
+      const std::vector<uint64_t> &src = h.counts[i];
+
+      for (int b = 0; b < n_blocks; b++) {
+        if (h.block_totals[i][b] == 0) continue;
+        block_totals[i][b] += h.block_totals[i][b];
+
+        int j = b << sub_bucket_half_count_magnitude;
+        for (int end = j + sub_bucket_half_count; j < end; j++) dst[j] += src[j];
+      }
+
+      total_count[i] += h.total_count[i];
+      sum[i] += h.sum[i];
+      sum_sq[i] += h.sum_sq[i];
+    }
+
+    samples.insert(samples.end(), h.samples.begin(), h.samples.end());
+  }
+
+  // Merge raw counts (counts_len entries), e.g. received from an agent.
+  void accumulate(const uint64_t *c, double s, double s_sq, int interval) {
+    std::vector<uint64_t> &dst = counts[interval];
+    uint64_t n = 0;
+
+    for (int b = 0; b < n_blocks; b++) {
+      uint64_t block = 0;
+      int j = b << sub_bucket_half_count_magnitude;
+      for (int end = j + sub_bucket_half_count; j < end; j++) {
+        dst[j] += c[j];
+        block += c[j];
+      }
+      block_totals[interval][b] += block;
+      n += block;
+    }
+
+    total_count[interval] += n;
+    sum[interval] += s;
+    sum_sq[interval] += s_sq;
+  }
+
+  // Drop all samples, keeping the layout.
+  void reset() {
+    for (int i = 0; i < n_intervals; i++) {
+      std::fill(counts[i].begin(), counts[i].end(), 0);
+      std::fill(block_totals[i].begin(), block_totals[i].end(), 0);
+      total_count[i] = 0;
+      sum[i] = 0.0;
+      sum_sq[i] = 0.0;
+    }
+    samples.clear();
+  }
+
+  // TODO: Re-enable
+  void plot(const char *tag, double QPS) { }
+
+private:
+  int counts_index(int64_t v) const {
+    int pow2ceiling = 64 - __builtin_clzll(v | sub_bucket_mask);
+    int bucket_index = pow2ceiling - (sub_bucket_half_count_magnitude + 1);
+    int sub_bucket_index = (int) (v >> bucket_index);
+    return ((bucket_index + 1) << sub_bucket_half_count_magnitude) +
+      (sub_bucket_index - (int) sub_bucket_half_count);
+  }
+
+  // Inverse of counts_index(): bucket and sub-bucket of counts[i].
+  void index_to_bucket(int i, int &bucket_index, int &sub_bucket_index) const {
+    bucket_index = (i >> sub_bucket_half_count_magnitude) - 1;
+    sub_bucket_index = (i & (sub_bucket_half_count - 1)) + sub_bucket_half_count;
+    if (bucket_index < 0) {
+      sub_bucket_index -= sub_bucket_half_count;
+      bucket_index = 0;
+    }
+  }
+
+  double lowest_equivalent(int i) const {
+    int b, sb;
+    index_to_bucket(i, b, sb);
+    return (double) ((int64_t) sb << b);
+  }
+
+  double bucket_width(int i) const {
+    int b, sb;
+    index_to_bucket(i, b, sb);
+    return (double) ((int64_t) 1 << b);
+  }
+};
+
+#endif // HDRHISTOGRAMSAMPLER_H
@@ -11,6 +11,7 @@
 
 #include "config.h"
 #include "Generator.h"
+#include <algorithm>
 #include <string>
 #include <vector>
 #include <utility>
@@ -23,7 +24,12 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include <arpa/inet.h>
+
+#include "binary_protocol.h"
+#include "ConnectionOptions.h"
 #include "log.h"
+#include "Random.h"
 #include "util.h"
 
 #define max_memcached_len 250
@@ -33,23 +39,49 @@ public:
   KeyGenerator(Generator* _g, double _max = 10000) : g(_g), max(_max) {
 	mlen=floor(log10(max)) + 1;
   }
+  virtual ~KeyGenerator() {}
   int keysize(uint64_t h) {
     double U = (double) h / ULLONG_MAX;
     double G = g->generate(U);
     int keylen = MAX(round(G), mlen);
 	return keylen;
   }
-  virtual std::string generate(uint64_t ind) {
-    uint64_t h = fnv_64(ind);
-    int keylen = keysize(h);
+  // Write key ind's name, NUL-terminated, into key[max_memcached_len]
+  // and return its length.
+  virtual int generate(uint64_t ind, char *key) {
+    return format(ind, key);
+  }
+  std::string generate(uint64_t ind) {
     char key[max_memcached_len];
-    snprintf(key, max_memcached_len, "%0*" PRIu64, keylen, ind);
-    return std::string(key);
+    int len = generate(ind, key);
+    return std::string(key, len);
+  }
+  // Key ind's name at keylen characters (as long as ind's digits at
+  // least), for keys whose size is given rather than drawn.
+  static int name(uint64_t ind, int keylen, char *key) {
+    char digits[20];
+    int n = 0;
+    do digits[n++] = '0' + ind % 10; while (ind /= 10);
+
+    if (keylen < n) keylen = n;
+    if (keylen > max_memcached_len - 1) keylen = max_memcached_len - 1;
+    if (n > keylen) n = keylen;
+
+    memset(key, '0', keylen - n);
+    for (int i = 0; i < n; i++) key[keylen - 1 - i] = digits[i];
+    key[keylen] = '\0';
+    return keylen;
   }
 protected:
   Generator* g;
   double max;
   int mlen;
+
+  // ind, zero-padded to its key size.  Too long a size keeps the low
+  // digits, so distinct keys stay distinct.
+  int format(uint64_t ind, char *key) {
+    return name(ind, keysize(fnv_64(ind)), key);
+  }
 };
 
 class DistKeyGenerator : public KeyGenerator {
@@ -63,96 +95,227 @@ class DistKeyGenerator : public KeyGenerator {
 	//	ks: distribtuion for key sizes
 	//	max: max number of keys
 public:
-  DistKeyGenerator(Generator* _ks, Generator* _kg, double _max = 10000) : KeyGenerator(_ks,_max), kg(_kg) {  }
-  std::string generate(uint64_t ind) {
-	double ridx = drand48();
-    ind = (uint64_t)kg->generate(ridx) % (uint64_t)max;
-    uint64_t h = fnv_64(ind);
-    int keylen = keysize(h);
-    snprintf(key, max_memcached_len, "%0*" PRIu64, keylen, ind);
-    return std::string(key);
+  DistKeyGenerator(Generator* _ks, Generator* _kg, double _max = 10000) : KeyGenerator(_ks,_max), kg(_kg) {
+    kg->set_max(max);
+  }
+  using KeyGenerator::generate;
+  int generate(uint64_t ind, char *key) {
+    // kg draws from its own Rng.
+    return format((uint64_t)kg->generate() % (uint64_t)max, key);
   }
 private:
   Generator* kg;
-  char key[max_memcached_len];
 };
 
+#define KEY_ARENA_ALIGN 64    // Slots start on a cache line...
+#define KEY_ARENA_GRAIN 16    // ...or on 16 bytes if they are smaller.
+#define KEY_REGEN_BATCH 256   // Keys maintain() regenerates per call.
+
 /*
 	Class: CachingKeyGenerator
 	A key generator that creates a cached pool of keys/requests
 
 	Key generation can become a bottleneck if doing lots of small requests,
 	requiring large number of clients to saturate a server.
-	This class will build up a cache of requests and repeat sending those requests. Each client thread is going to have a different req seq, and the generator will regenerate some of the sequence every max_iterations over the data.
+	This class will build up a cache of requests and repeat sending those requests. Each thread has one, shared by its connections; each connection walks it with its own cursor, and the generator will regenerate some of the pool every max_iterations passes over it.
+
+	The pool is one aligned arena of fixed-stride slots, each holding
+	the ready-made requests for its key for the thread's protocol:
+	  ascii   "get <key>\r\n\0" "set <key> 0 0 \0" "<key>\0"
+	  binary  GET header (opaque left 0), "<key>\0"
+	  meta    "<key>\0"
+	so a request touches one or two cache lines and no heap strings.
+	Regeneration rewrites slots in place; next() only counts draws and
+	flags a regeneration as due, and maintain(), called from the
+	thread's event loop, carries it out KEY_REGEN_BATCH keys at a time.
+	The stride fits the longest key so far; a longer one re-lays the
+	arena out with a wider stride.
 
 	_capacity: size of the cache pool (default 10k)
-	max_iterations: how many times can the pool be reused before regenerating, defaults to 100. Set to 1 to always invoke regen.
+	max_iterations: how many times can the pool be reused before regenerating, defaults to 100. Set to 0 to regenerate after every pass.
 	regen_freedom: controls how much of the pool will be regenerated on each regen. Set to capacity to make each regen update the whole cache. Lower values will update fewer requests each reen cycle. Defaults to 1% of capacity.
 */
 class CachingKeyGenerator {
 private:
-	std::vector< std::string > values;
-	std::vector< std::string > get_req;
-	uint64_t capacity,max;
+	struct record {
+		uint32_t off;      // Slot offset in arena.
+		uint16_t key_len;
+	};
+
+	char *arena;
+	std::vector<record> records;
+	uint32_t stride;
+	int protocol;
+	uint32_t capacity;
+	uint64_t max;
 	KeyGenerator *kg;
+	Rng *rng;
+
+	uint64_t draws, period;    // Regenerate every period draws.
+	uint32_t regen_pos, regen_step;  // regen_pos == capacity: idle.
+
+	// Bytes a slot needs for a key of length l.
+	uint32_t slot_size(int l) const {
+		switch (protocol) {
+		case PROTOCOL_ASCII: return 3 * l + 18;
+		case PROTOCOL_BINARY: return 24 + l + 1;  // Header without extras.
+		default: return l + 1;
+		}
+	}
+
+	void layout(uint32_t need) {
+		uint32_t grain = need > KEY_ARENA_ALIGN / 2 ? KEY_ARENA_ALIGN : KEY_ARENA_GRAIN;
+		uint32_t s = (need + grain - 1) / grain * grain;
+		if ((uint64_t) s * capacity > UINT32_MAX)
+			DIE("Key cache of %u keys too large", capacity);
+
+		char *a;
+		if (posix_memalign((void **) &a, KEY_ARENA_ALIGN, (size_t) s * capacity))
+			DIE("posix_memalign() failed");
+		for (uint32_t i = 0; i < capacity; i++) {
+			if (arena != NULL) memcpy(a + i * s, arena + records[i].off, stride);
+			records[i].off = i * s;
+		}
+		if (arena != NULL) {
+			free(arena);
+			D("Key cache stride %u -> %u", stride, s);
+		}
+		arena = a;
+		stride = s;
+	}
+
+	void fill(uint32_t i) {
+		char key[max_memcached_len];
+		int l = kg->generate(i, key);
+		if (slot_size(l) > stride) layout(slot_size(l));
+
+		record &r = records[i];
+		char *p = arena + r.off;
+		r.key_len = l;
+
+		switch (protocol) {
+		case PROTOCOL_ASCII:
+			memcpy(p, "get ", 4);
+			memcpy(p + 4, key, l);
+			memcpy(p + 4 + l, "\r\n", 3);
+			p += l + 7;
+			memcpy(p, "set ", 4);
+			memcpy(p + 4, key, l);
+			memcpy(p + 4 + l, " 0 0 ", 6);
+			p += l + 10;
+			break;
+		case PROTOCOL_BINARY: {
+			binary_header_t h = {0x80, CMD_GET, htons(l), 0x00, 0x00,
+			                     {htons(0)}, htonl(l), 0};
+			memcpy(p, &h, 24);  // No extras.
+			p += 24;
+			break;
+		}
+		}
+		memcpy(p, key, l + 1);
+	}
+
+	void regen_batch() {
+		for (int n = 0; n < KEY_REGEN_BATCH && regen_pos < capacity; n++) {
+			fill(regen_pos);
+			regen_pos += regen_step;
+		}
+		if (regen_pos >= capacity) regen_pos = capacity;
+	}
+
 	void commonInit(int reuse, int pct_regen) {
 		if (capacity>max)
 			capacity=max;
-		values.resize(capacity);
-		get_req.resize(capacity);
-		step=1;
-		iterations=0;
+		if (capacity == 0)
+			capacity=1;
+		records.resize(capacity);
 		max_iterations=reuse;
+		period=(uint64_t) capacity*(max_iterations+1);
+		draws=0;
 		regen_freedom=capacity*pct_regen/100;
+		rng=&thread_rng();
 		if(regen_freedom == 0) {
 			regen_freedom = 1;
 		}
+		if(regen_freedom > (int) capacity) {
+			regen_freedom = capacity;
+		}
 	}
-	
+
 public:
-	int next,step;
-	int iterations;
 	int max_iterations;
 	int regen_freedom;
 
 public:
-	CachingKeyGenerator(Generator* _ks, Generator* _kg, uint64_t _max=40000, int _capacity=10000, int reuse=100, int pct_regen=1) : capacity(_capacity), max(_max) {
+	CachingKeyGenerator(Generator* _ks, Generator* _kg, int _protocol, uint64_t _max=40000, int _capacity=10000, int reuse=100, int pct_regen=1) : arena(NULL), stride(0), protocol(_protocol), capacity(_capacity), max(_max) {
 		commonInit(reuse,pct_regen);
 		if (_kg != NULL)
 			kg=new DistKeyGenerator(_ks, _kg, max);
 		else
 			kg=new KeyGenerator(_ks, max);
-		regen();
+
+		// Re-laid out, if need be, as longer keys turn up.
+		layout(slot_size(0));
+		for (uint32_t i = 0; i < capacity; i++)
+			fill(i);
+		regen_pos=capacity;
+		regen_step=1;
 	}
 	~CachingKeyGenerator() {
+		free(arena);
 		delete kg;
 	}
-	std::string generate(uint64_t ind) {
-		return values[ind];
+
+	uint32_t size() const { return capacity; }
+
+	// Slot i's key, NUL-terminated.
+	const char *key(uint32_t i) const {
+		const record &r = records[i];
+		switch (protocol) {
+		case PROTOCOL_ASCII: return arena + r.off + 2 * r.key_len + 17;
+		case PROTOCOL_BINARY: return arena + r.off + 24;
+		default: return arena + r.off;
+		}
 	}
-	const char *current_get_req() {
-		return get_req[next].c_str();
+	// Prebuilt get of slot i: NUL-terminated ASCII, or a binary GET
+	// header with the key after it.  NULL under meta.
+	const char *get_req(uint32_t i) const {
+		return protocol == PROTOCOL_META ? NULL : arena + records[i].off;
+	}
+	// "set <key> 0 0 ", NUL-terminated, for ASCII; NULL otherwise.
+	const char *set_req(uint32_t i) const {
+		if (protocol != PROTOCOL_ASCII) return NULL;
+		const record &r = records[i];
+		return arena + r.off + r.key_len + 7;
+	}
+
+	// ind may range over all records; only capacity keys are cached.
+	const char *generate(uint64_t ind) const {
+		return key(ind % capacity);
 	}
-	const char *generate_next() {
-		next+=step;
-		if (next >= capacity) {
-			next=0;
-			iterations++;
-			if (iterations > max_iterations) {
-				unsigned int regen_offset = rand() % (capacity / regen_freedom);
-				unsigned int regen_step = rand() % (capacity / regen_freedom) + 1;
-				regen(regen_step,regen_offset);
-				iterations=0;
+
+	// Pick regen strides from r.  Keys are drawn by the Generators.
+	void set_rng(Rng *r) {
+		rng=r;
+	}
+
+	// Slot at cursor, which is advanced.
+	uint32_t next(uint32_t &cursor) {
+		uint32_t i = cursor;
+		if (++cursor == capacity) cursor = 0;
+		if (__builtin_expect(++draws >= period, 0)) {
+			draws = 0;
+			if (regen_pos == capacity) {
+				regen_pos = rng->below(capacity / regen_freedom);
+				regen_step = rng->below(capacity / regen_freedom) + 1;
 			}
 		}
-		return values[next].c_str();
+		return i;
 	}
-	void regen(unsigned int stepper=1, unsigned int offset=0) {
-		for (uint64_t i=offset ; i<capacity; i+=stepper) {
-			values[i] = kg->generate(i);
-			get_req[i] = std::string("get ") + values[i] + std::string("\r\n"); 
-		}
-		next=0;
+
+	// Carry out part of a due regeneration, if any.
+	void maintain() {
+		if (regen_pos < capacity) regen_batch();
 	}
 };
 
@@ -0,0 +1,128 @@
+#include <string.h>
+#include <time.h>
+
+#include <algorithm>
+#include <mutex>
+#include <vector>
+
+#include "LiveStats.h"
+
+std::atomic<uint64_t> live_epoch(0);
+
+static std::mutex recorders_lock;
+static std::vector<LiveRecorder*> recorders;
+
+LiveRecorder::LiveRecorder() : active(0), seen_epoch(live_epoch.load()) {
+  memset(delta, 0, sizeof(delta));
+  memset(&last, 0, sizeof(last));
+  ready[0] = 0;
+  ready[1] = 0;
+}
+
+void LiveRecorder::publish(const BaseStats &totals) {
+  int other = active ^ 1;
+
+  // The reporter still holds the other buffer; keep filling this one
+  // and try again on the next loop iteration.
+  if (ready[other].load(std::memory_order_acquire)) return;
+
+  BaseStats &d = delta[active];
+  d.rx_bytes = totals.rx_bytes - last.rx_bytes;
+  d.tx_bytes = totals.tx_bytes - last.tx_bytes;
+  d.gets = totals.gets - last.gets;
+  d.sets = totals.sets - last.sets;
+  d.get_misses = totals.get_misses - last.get_misses;
+  d.skips = totals.skips - last.skips;
+  last = totals;
+
+  ready[active].store(1, std::memory_order_release);
+  active = other;
+  seen_epoch = live_epoch.load(std::memory_order_relaxed);
+}
+
+void LiveRecorder::collect(AgentStats &as) {
+  for (int b = 0; b < 2; b++) {
+    if (!ready[b].load(std::memory_order_acquire)) continue;
+
+    as.bs.rx_bytes += delta[b].rx_bytes;
+    as.bs.tx_bytes += delta[b].tx_bytes;
+    as.bs.gets += delta[b].gets;
+    as.bs.sets += delta[b].sets;
+    as.bs.get_misses += delta[b].get_misses;
+    as.bs.skips += delta[b].skips;
+    as.hists[AGENT_HIST_GET].accumulate(get[b]);
+    as.hists[AGENT_HIST_SET].accumulate(set[b]);
+
+    get[b].reset();
+    set[b].reset();
+    ready[b].store(0, std::memory_order_release);
+  }
+}
+
+void live_register(LiveRecorder *r) {
+  std::lock_guard<std::mutex> l(recorders_lock);
+  recorders.push_back(r);
+}
+
+void live_unregister(LiveRecorder *r) {
+  std::lock_guard<std::mutex> l(recorders_lock);
+  recorders.erase(std::remove(recorders.begin(), recorders.end(), r),
+                  recorders.end());
+}
+
+void live_collect(AgentStats &as, int grace_ms) {
+  live_epoch++;
+
+  struct timespec ts = {grace_ms / 1000, (grace_ms % 1000) * 1000000L};
+  nanosleep(&ts, NULL);
+
+  std::lock_guard<std::mutex> l(recorders_lock);
+  for (auto r : recorders) r->collect(as);
+}
+
+void live_merge(AgentStats &dst, const AgentStats &src) {
+  dst.bs.rx_bytes += src.bs.rx_bytes;
+  dst.bs.tx_bytes += src.bs.tx_bytes;
+  dst.bs.gets += src.bs.gets;
+  dst.bs.sets += src.bs.sets;
+  dst.bs.get_misses += src.bs.get_misses;
+  dst.bs.skips += src.bs.skips;
+
+  for (int id = 0; id < AGENT_HIST_MAX; id++)
+    dst.hists[id].accumulate(src.hists[id]);
+}
+
+void live_print_header(FILE *f, bool json) {
+  if (!json)
+    fprintf(f, "#time,qps,gets,sets,miss_rate,p50,p99,p999,rx_mbps,tx_mbps\n");
+  fflush(f);
+}
+
+void live_print(FILE *f, bool json, AgentStats &as, double t, double dt) {
+  HdrHistogramSampler lat = as.hists[AGENT_HIST_GET];
+  lat.accumulate(as.hists[AGENT_HIST_SET]);
+
+  uint64_t ops = as.bs.gets + as.bs.sets;
+  double qps = dt > 0 ? ops / dt : 0.0;
+  double miss = as.bs.gets ? (double) as.bs.get_misses / as.bs.gets : 0.0;
+  double p50 = 0.0, p99 = 0.0, p999 = 0.0;
+  double rx = dt > 0 ? as.bs.rx_bytes / dt / 1024 / 1024 : 0.0;
+  double tx = dt > 0 ? as.bs.tx_bytes / dt / 1024 / 1024 : 0.0;
+
+  if (lat.total() > 0) {
+    p50 = lat.get_nth(50);
+    p99 = lat.get_nth(99);
+    p999 = lat.get_nth(999);
+  }
+
+  if (json)
+    fprintf(f, "{\"time\": %.3f, \"qps\": %.1f, \"gets\": %" PRIu64
+            ", \"sets\": %" PRIu64 ", \"miss_rate\": %.4f, \"p50\": %.1f"
+            ", \"p99\": %.1f, \"p999\": %.1f, \"rx_mbps\": %.2f"
+            ", \"tx_mbps\": %.2f}\n",
+            t, qps, as.bs.gets, as.bs.sets, miss, p50, p99, p999, rx, tx);
+  else
+    fprintf(f, "%.3f,%.1f,%" PRIu64 ",%" PRIu64 ",%.4f,%.1f,%.1f,%.1f,%.2f,%.2f\n",
+            t, qps, as.bs.gets, as.bs.sets, miss, p50, p99, p999, rx, tx);
+  fflush(f);
+}
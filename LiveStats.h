@@ -0,0 +1,78 @@
+/* -*- c++ -*- */
+#ifndef LIVESTATS_H
+#define LIVESTATS_H
+
+#include <stdio.h>
+
+#include <atomic>
+
+#include "AgentStats.h"
+#include "HdrHistogramSampler.h"
+
+/*
+ * Live (--live) reporting.
+ *
+ * Every load-generating thread owns a LiveRecorder with two buffers.
+ * Connections sample latencies into the active buffer; nothing on
+ * that path is shared or locked.  Every --live ms the reporter bumps
+ * live_epoch.  When a thread's event loop notices the new epoch it
+ * stores its counter deltas into the active buffer, marks it ready and
+ * switches to the other one.  The reporter merges the ready buffers,
+ * clears them and hands them back.  A thread that has not published
+ * yet (e.g. blocked in epoll) simply shows up in the next row.
+ *
+ * Deltas are carried as an AgentStats with one interval (reads in
+ * AGENT_HIST_GET, updates in AGENT_HIST_SET), so agents ship theirs
+ * to the master with AgentStatsWire.
+ */
+
+extern std::atomic<uint64_t> live_epoch;
+
+class LiveRecorder {
+public:
+  LiveRecorder();
+
+  // Running counters at the start of the measurement.
+  void set_baseline(const BaseStats &totals) { last = totals; }
+
+  // Hot path, owning thread only.
+  void sample_get(double us) { get[active].sample(us); }
+  void sample_set(double us) { set[active].sample(us); }
+
+  // Owning thread, once per event loop iteration.
+  bool epoch_changed() const {
+    return live_epoch.load(std::memory_order_relaxed) != seen_epoch;
+  }
+  // Hand over the active buffer.  totals are the thread's running
+  // counters; the buffer gets the change since the last hand-over.
+  void publish(const BaseStats &totals);
+
+  // Reporter: add any handed-over buffers into as and release them.
+  void collect(AgentStats &as);
+
+private:
+  HdrHistogramSampler get[2], set[2];
+  BaseStats delta[2];
+  std::atomic<int> ready[2];
+
+  BaseStats last;
+  int active;
+  uint64_t seen_epoch;
+};
+
+void live_register(LiveRecorder *r);
+void live_unregister(LiveRecorder *r);
+
+// Start a new epoch, give threads grace_ms to publish, then collect
+// every registered recorder into as.
+void live_collect(AgentStats &as, int grace_ms);
+
+// Add the counters and histograms of src into dst.
+void live_merge(AgentStats &dst, const AgentStats &src);
+
+// One row of live output; t is seconds since the run started and dt
+// the length of the period the row covers.
+void live_print_header(FILE *f, bool json);
+void live_print(FILE *f, bool json, AgentStats &as, double t, double dt);
+
+#endif // LIVESTATS_H
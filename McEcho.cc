@@ -0,0 +1,562 @@
+// mcperf-echo: minimal memcached stand-in used to measure mcperf's own
+// per-request overhead.
+//
+// Speaks the subset of the ASCII, binary and meta protocols that
+// mcperf issues (get, multi-get, set, SASL, noop, mg, ms, mn).  Nothing
+// is stored: a get hits (unless picked as a --miss) and returns a value
+// of --valuesize bytes, every set is acknowledged.  An optional --service time is spent busy-waiting per
+// request on the serving thread, so the server behaves like a CPU-bound
+// memcached with a known cost.
+//
+// Each thread owns an epoll loop and a SO_REUSEPORT listener, so the
+// kernel spreads connections across threads without any sharing.
+// On SIGINT or SIGTERM the requests served and requests/s of each
+// thread are reported.
+//
+// Build with "make mcperf-echo" and run ./mcperf-echo -p 11211 -T 4.
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <string>
+#include <vector>
+
+#include "binary_protocol.h"
+#include "Generator.h"
+#include "log.h"
+#include "util.h"
+
+#define ECHO_MAX_EVENTS 256
+#define ECHO_READ_SIZE  (64 * 1024)
+#define ECHO_MAX_VALUE  (1024 * 1024)
+
+#define CMD_SASL_LIST 0x20
+
+struct echo_options_t {
+  int port;
+  int threads;
+  const char *service;    // Generator spec, microseconds.
+  const char *valuesize;  // Generator spec, bytes.
+  double miss;            // Fraction of gets that miss.
+};
+
+static echo_options_t eopts = {11211, 1, "0", "200", 0.0};
+
+static char value_data[ECHO_MAX_VALUE + 2];
+
+struct echo_conn_t {
+  int fd;
+  bool binary;
+  bool detected;
+  std::string in;
+  size_t in_off;
+  std::string out;
+};
+
+struct echo_thread_t {
+  pthread_t tid;
+  int epfd;
+  int listen_fd;
+  Generator *service;
+  Generator *valuesize;
+  uint64_t requests;  // Written by the thread only, read on exit.
+  unsigned int seed;
+};
+
+static void spin(Generator *service) {
+  double us = service->generate();
+  if (us <= 0.0) return;
+
+  double deadline = get_time_accurate() + us / 1000000;
+  while (get_time_accurate() < deadline) ;
+}
+
+static void count_request(echo_thread_t *t) {
+  __atomic_store_n(&t->requests, t->requests + 1, __ATOMIC_RELAXED);
+}
+
+static int value_length(echo_thread_t *t) {
+  int len = (int) t->valuesize->generate();
+  if (len < 1) len = 1;
+  if (len > ECHO_MAX_VALUE) len = ECHO_MAX_VALUE;
+  return len;
+}
+
+static bool miss(echo_thread_t *t) {
+  return eopts.miss > 0.0 && rand_r(&t->seed) < eopts.miss * RAND_MAX;
+}
+
+// Append the flags of a meta request that are echoed in its reply.
+static void meta_flags(std::string &out, const char *p, const char *end) {
+  while (p < end) {
+    while (p < end && *p == ' ') p++;
+    const char *e = p;
+    while (e < end && *e != ' ') e++;
+    if (e > p && (*p == 'O' || *p == 'b')) {
+      out.push_back(' ');
+      out.append(p, e - p);
+    }
+    p = e;
+  }
+}
+
+static bool meta_flag(const char *p, const char *end, char flag) {
+  for (; p < end; p++)
+    if (*p == flag && (p + 1 == end || p[1] == ' ') && p[-1] == ' ') return true;
+  return false;
+}
+
+// mg <key> <flags>*
+static void meta_get(echo_thread_t *t, echo_conn_t *c,
+                     const char *p, const char *end) {
+  const char *flags = (const char *) memchr(p, ' ', end - p);
+  if (flags == NULL) flags = end;
+
+  spin(t->service);
+  count_request(t);
+
+  if (miss(t)) {
+    if (meta_flag(flags, end, 'q')) return;
+    c->out.append("EN");
+    meta_flags(c->out, flags, end);
+    c->out.append("\r\n", 2);
+    return;
+  }
+
+  if (!meta_flag(flags, end, 'v')) {
+    c->out.append("HD");
+    meta_flags(c->out, flags, end);
+    c->out.append("\r\n", 2);
+    return;
+  }
+
+  char hdr[64];
+  int len = value_length(t);
+  int l = snprintf(hdr, sizeof(hdr), "VA %d", len);
+  c->out.append(hdr, l);
+  if (meta_flag(flags, end, 's')) {
+    l = snprintf(hdr, sizeof(hdr), " s%d", len);
+    c->out.append(hdr, l);
+  }
+  meta_flags(c->out, flags, end);
+  c->out.append("\r\n", 2);
+  c->out.append(value_data, len);
+  c->out.append("\r\n", 2);
+}
+
+// Returns bytes consumed, or 0 if the request is incomplete.
+static size_t ascii_request(echo_thread_t *t, echo_conn_t *c,
+                            const char *p, size_t avail) {
+  const char *eol = (const char *) memchr(p, '\n', avail);
+  if (eol == NULL) return 0;
+
+  size_t line_len = eol - p + 1;
+  size_t cmd_len = line_len - 1;
+  if (cmd_len > 0 && p[cmd_len - 1] == '\r') cmd_len--;
+
+  if (cmd_len > 4 && !strncmp(p, "get ", 4)) {
+    const char *k = p + 4, *end = p + cmd_len;
+    char hdr[300];
+
+    while (k < end) {
+      while (k < end && *k == ' ') k++;
+      const char *ke = k;
+      while (ke < end && *ke != ' ') ke++;
+      if (ke == k) break;
+
+      if (miss(t)) {
+        spin(t->service);
+        count_request(t);
+        k = ke;
+        continue;
+      }
+
+      int len = value_length(t);
+      int l = snprintf(hdr, sizeof(hdr), "VALUE %.*s 0 %d\r\n",
+                       (int) (ke - k > 250 ? 250 : ke - k), k, len);
+      c->out.append(hdr, l);
+      c->out.append(value_data, len);
+      c->out.append("\r\n", 2);
+      spin(t->service);
+      count_request(t);
+      k = ke;
+    }
+
+    c->out.append("END\r\n", 5);
+    return line_len;
+  } else if (cmd_len > 4 && !strncmp(p, "set ", 4)) {
+    char line[512];
+    int bytes = 0;
+    snprintf(line, sizeof(line), "%.*s",
+             (int) (cmd_len < sizeof(line) - 1 ? cmd_len : sizeof(line) - 1), p);
+    if (sscanf(line, "set %*s %*d %*d %d", &bytes) != 1 || bytes < 0) {
+      c->out.append("CLIENT_ERROR bad command line format\r\n");
+      return line_len;
+    }
+
+    if (avail < line_len + bytes + 2) return 0;
+
+    if (!strstr(line, "noreply")) c->out.append("STORED\r\n", 8);
+    spin(t->service);
+    count_request(t);
+    return line_len + bytes + 2;
+  } else if (cmd_len > 3 && !strncmp(p, "mg ", 3)) {
+    meta_get(t, c, p + 3, p + cmd_len);
+  } else if (cmd_len > 3 && !strncmp(p, "ms ", 3)) {
+    const char *end = p + cmd_len;
+    const char *k = p + 3;
+    const char *ke = (const char *) memchr(k, ' ', end - k);
+    if (ke == NULL) {
+      c->out.append("CLIENT_ERROR bad command line format\r\n");
+      return line_len;
+    }
+
+    int bytes = atoi(ke + 1);
+    if (avail < line_len + bytes + 2) return 0;
+
+    const char *flags = (const char *) memchr(ke + 1, ' ', end - ke - 1);
+    if (flags == NULL) flags = end;
+    if (!meta_flag(flags, end, 'q')) {
+      c->out.append("HD");
+      meta_flags(c->out, flags, end);
+      c->out.append("\r\n", 2);
+    }
+    spin(t->service);
+    count_request(t);
+    return line_len + bytes + 2;
+  } else if (cmd_len == 2 && !strncmp(p, "mn", 2)) {
+    c->out.append("MN\r\n", 4);
+  } else if (cmd_len == 7 && !strncmp(p, "version", 7)) {
+    c->out.append("VERSION mcperf-echo\r\n");
+  } else if (cmd_len == 9 && !strncmp(p, "flush_all", 9)) {
+    c->out.append("OK\r\n", 4);
+  } else if (cmd_len > 0) {
+    c->out.append("ERROR\r\n", 7);
+  }
+
+  return line_len;
+}
+
+static void binary_response(echo_conn_t *c, const binary_header_t *req,
+                            uint16_t status, const char *key, int keylen,
+                            int extlen, const char *value, int vallen) {
+  binary_header_t h;
+  memset(&h, 0, 24);
+  h.magic = 0x81;
+  h.opcode = req->opcode;
+  h.key_len = htons(keylen);
+  h.extra_len = extlen;
+  h.status = htons(status);
+  h.body_len = htonl(keylen + extlen + vallen);
+  h.opaque = req->opaque;
+
+  c->out.append((const char *) &h, 24);
+  if (extlen) c->out.append(4, '\0');  // Flags.
+  if (keylen) c->out.append(key, keylen);
+  if (vallen) c->out.append(value, vallen);
+}
+
+// Returns bytes consumed, or 0 if the request is incomplete.
+static size_t binary_request(echo_thread_t *t, echo_conn_t *c,
+                             const char *p, size_t avail) {
+  if (avail < 24) return 0;
+
+  binary_header_t h;
+  memcpy(&h, p, 24);
+  if (h.magic != 0x80) DIE("bad binary magic 0x%02x", h.magic);
+
+  size_t len = 24 + ntohl(h.body_len);
+  if (avail < len) return 0;
+
+  int keylen = ntohs(h.key_len);
+  const char *key = p + 24 + h.extra_len;
+
+  switch (h.opcode) {
+  case CMD_GET: case CMD_GETQ: case CMD_GETK: case CMD_GETKQ: {
+    bool with_key = h.opcode == CMD_GETK || h.opcode == CMD_GETKQ;
+    bool quiet = h.opcode == CMD_GETQ || h.opcode == CMD_GETKQ;
+    if (miss(t)) {
+      if (!quiet) binary_response(c, &h, 0x01, NULL, 0, 0, NULL, 0);  // Key not found.
+    } else {
+      binary_response(c, &h, RESP_OK, key, with_key ? keylen : 0, 4,
+                      value_data, value_length(t));
+    }
+    spin(t->service);
+    count_request(t);
+    break;
+  }
+  case CMD_SET:
+    binary_response(c, &h, RESP_OK, NULL, 0, 0, NULL, 0);
+    // Fall through.
+  case CMD_SETQ:
+    spin(t->service);
+    count_request(t);
+    break;
+  case CMD_NOOP:
+  case CMD_SASL:
+    binary_response(c, &h, RESP_OK, NULL, 0, 0, NULL, 0);
+    break;
+  case CMD_SASL_LIST:
+    binary_response(c, &h, RESP_OK, NULL, 0, 0, "PLAIN", 5);
+    break;
+  default:
+    binary_response(c, &h, 0x81, NULL, 0, 0, NULL, 0);  // Unknown command.
+  }
+
+  return len;
+}
+
+static bool flush(echo_thread_t *t, echo_conn_t *c) {
+  size_t off = 0;
+
+  while (off < c->out.size()) {
+    ssize_t n = write(c->fd, c->out.data() + off, c->out.size() - off);
+    if (n < 0) {
+      if (errno == EINTR) continue;
+      if (errno == EAGAIN) break;
+      return false;
+    }
+    off += n;
+  }
+  c->out.erase(0, off);
+
+  struct epoll_event ev;
+  ev.events = EPOLLIN | (c->out.empty() ? 0 : EPOLLOUT);
+  ev.data.ptr = c;
+  epoll_ctl(t->epfd, EPOLL_CTL_MOD, c->fd, &ev);
+  return true;
+}
+
+static bool handle_read(echo_thread_t *t, echo_conn_t *c) {
+  char buf[ECHO_READ_SIZE];
+
+  while (1) {
+    ssize_t n = read(c->fd, buf, sizeof(buf));
+    if (n == 0) return false;
+    if (n < 0) {
+      if (errno == EINTR) continue;
+      if (errno == EAGAIN) break;
+      return false;
+    }
+    c->in.append(buf, n);
+    if (n < (ssize_t) sizeof(buf)) break;
+  }
+
+  if (!c->detected && !c->in.empty()) {
+    c->binary = (uint8_t) c->in[0] == 0x80;
+    c->detected = true;
+  }
+
+  while (c->in_off < c->in.size()) {
+    const char *p = c->in.data() + c->in_off;
+    size_t avail = c->in.size() - c->in_off;
+    size_t used = c->binary ? binary_request(t, c, p, avail) :
+      ascii_request(t, c, p, avail);
+    if (used == 0) break;
+    c->in_off += used;
+  }
+
+  if (c->in_off == c->in.size()) {
+    c->in.clear();
+    c->in_off = 0;
+  } else if (c->in_off > ECHO_READ_SIZE) {
+    c->in.erase(0, c->in_off);
+    c->in_off = 0;
+  }
+
+  return flush(t, c);
+}
+
+static int listen_socket(int port) {
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  if (fd < 0) DIE("socket(): %s", strerror(errno));
+
+  int one = 1;
+  setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+  if (setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one)))
+    DIE("setsockopt(SO_REUSEPORT): %s", strerror(errno));
+
+  struct sockaddr_in sin;
+  memset(&sin, 0, sizeof(sin));
+  sin.sin_family = AF_INET;
+  sin.sin_addr.s_addr = htonl(INADDR_ANY);
+  sin.sin_port = htons(port);
+
+  if (bind(fd, (struct sockaddr *) &sin, sizeof(sin)))
+    DIE("bind(%d): %s", port, strerror(errno));
+  if (listen(fd, 1024)) DIE("listen(): %s", strerror(errno));
+  fcntl(fd, F_SETFL, O_NONBLOCK);
+
+  return fd;
+}
+
+static void do_accept(echo_thread_t *t) {
+  while (1) {
+    int fd = accept4(t->listen_fd, NULL, NULL, SOCK_NONBLOCK);
+    if (fd < 0) {
+      if (errno != EAGAIN && errno != EINTR) W("accept(): %s", strerror(errno));
+      if (errno == EINTR) continue;
+      return;
+    }
+
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    echo_conn_t *c = new echo_conn_t;
+    c->fd = fd;
+    c->binary = false;
+    c->detected = false;
+    c->in_off = 0;
+
+    struct epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.ptr = c;
+    if (epoll_ctl(t->epfd, EPOLL_CTL_ADD, fd, &ev))
+      DIE("epoll_ctl(): %s", strerror(errno));
+    V("Accepted connection %d", fd);
+  }
+}
+
+static void close_conn(echo_thread_t *t, echo_conn_t *c) {
+  epoll_ctl(t->epfd, EPOLL_CTL_DEL, c->fd, NULL);
+  close(c->fd);
+  V("Closed connection %d", c->fd);
+  delete c;
+}
+
+static void *echo_thread(void *arg) {
+  echo_thread_t *t = (echo_thread_t *) arg;
+  struct epoll_event events[ECHO_MAX_EVENTS];
+
+  while (1) {
+    int n = epoll_wait(t->epfd, events, ECHO_MAX_EVENTS, -1);
+    if (n < 0) {
+      if (errno == EINTR) continue;
+      DIE("epoll_wait(): %s", strerror(errno));
+    }
+
+    for (int i = 0; i < n; i++) {
+      if (events[i].data.ptr == NULL) {
+        do_accept(t);
+        continue;
+      }
+
+      echo_conn_t *c = (echo_conn_t *) events[i].data.ptr;
+      bool ok = true;
+
+      if (events[i].events & (EPOLLERR | EPOLLHUP)) ok = false;
+      if (ok && (events[i].events & EPOLLIN)) ok = handle_read(t, c);
+      if (ok && (events[i].events & EPOLLOUT)) ok = flush(t, c);
+      if (!ok) close_conn(t, c);
+    }
+  }
+
+  return NULL;
+}
+
+static void usage() {
+  fprintf(stderr,
+          "Usage: mcperf-echo [options]\n"
+          "  -p, --port=INT        TCP port to listen on (default 11211)\n"
+          "  -T, --threads=INT     Server threads (default 1)\n"
+          "  -S, --service=STRING  Per-request service time in us (distribution,\n"
+          "                        e.g. 5, fixed:5, exponential:0.2; default 0)\n"
+          "  -V, --valuesize=STRING Length of returned values (distribution;\n"
+          "                        default 200)\n"
+          "  -m, --miss=FLOAT      Fraction of gets that miss (default 0)\n"
+          "  -v, --verbose         Verbose output\n"
+          "  -h, --help            Print this help\n");
+}
+
+int main(int argc, char **argv) {
+  static struct option long_options[] = {
+    {"port",      required_argument, NULL, 'p'},
+    {"threads",   required_argument, NULL, 'T'},
+    {"service",   required_argument, NULL, 'S'},
+    {"valuesize", required_argument, NULL, 'V'},
+    {"miss",      required_argument, NULL, 'm'},
+    {"verbose",   no_argument,       NULL, 'v'},
+    {"help",      no_argument,       NULL, 'h'},
+    {NULL, 0, NULL, 0}
+  };
+
+  int opt;
+  while ((opt = getopt_long(argc, argv, "p:T:S:V:m:vh", long_options, NULL)) != -1) {
+    switch (opt) {
+    case 'p': eopts.port = atoi(optarg); break;
+    case 'T': eopts.threads = atoi(optarg); break;
+    case 'S': eopts.service = optarg; break;
+    case 'V': eopts.valuesize = optarg; break;
+    case 'm': eopts.miss = atof(optarg); break;
+    case 'v': log_level = VERBOSE; break;
+    case 'h': usage(); return 0;
+    default: usage(); return 1;
+    }
+  }
+
+  if (eopts.threads < 1) DIE("--threads must be >= 1");
+
+  for (int i = 0; i < ECHO_MAX_VALUE + 2; i++) value_data[i] = 'a' + i % 26;
+
+  std::vector<echo_thread_t> threads(eopts.threads);
+
+  for (int i = 0; i < eopts.threads; i++) {
+    echo_thread_t *t = &threads[i];
+    t->epfd = epoll_create1(0);
+    if (t->epfd < 0) DIE("epoll_create1(): %s", strerror(errno));
+    t->listen_fd = listen_socket(eopts.port);
+    t->service = createGenerator(eopts.service);
+    t->valuesize = createGenerator(eopts.valuesize);
+    t->requests = 0;
+    t->seed = i + 1;
+
+    struct epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.ptr = NULL;
+    if (epoll_ctl(t->epfd, EPOLL_CTL_ADD, t->listen_fd, &ev))
+      DIE("epoll_ctl(): %s", strerror(errno));
+  }
+
+  I("mcperf-echo listening on port %d with %d thread(s), service %s us",
+    eopts.port, eopts.threads, eopts.service);
+
+  // The server threads inherit the mask, so the signals go to sigwait().
+  sigset_t signals;
+  sigemptyset(&signals);
+  sigaddset(&signals, SIGINT);
+  sigaddset(&signals, SIGTERM);
+  pthread_sigmask(SIG_BLOCK, &signals, NULL);
+
+  double start = get_time();
+  for (int i = 0; i < eopts.threads; i++)
+    if (pthread_create(&threads[i].tid, NULL, echo_thread, &threads[i]))
+      DIE("pthread_create() failed");
+
+  int sig;
+  sigwait(&signals, &sig);
+  double elapsed = get_time() - start;
+
+  uint64_t total = 0;
+  for (int i = 0; i < eopts.threads; i++) {
+    uint64_t n = __atomic_load_n(&threads[i].requests, __ATOMIC_RELAXED);
+    I("Thread %d: %" PRIu64 " requests, %.1f requests/s", i, n,
+      n / elapsed);
+    total += n;
+  }
+  I("Total: %" PRIu64 " requests, %.1f requests/s over %.1fs", total,
+    total / elapsed, elapsed);
+  exit(0);  // Not return: the server threads still use threads[].
+}
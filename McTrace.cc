@@ -0,0 +1,383 @@
+// mcperf-trace: converts cache request traces in CSV form into the
+// binary trace format mcperf --replay reads (see Trace.h), and
+// summarizes or dumps binary traces.
+//
+// Input columns are named by --columns (time, key, key_size,
+// value_size, op, ttl, or - to skip one), or picked by --format:
+//
+//   twitter  time,key,key_size,value_size,-,op,ttl  (Twitter's
+//            twemcache traces; time in seconds)
+//
+// Keys are mapped to dense ids in order of first appearance.  get and
+// gets become TRACE_GET; set, add, replace, cas, append and prepend
+// become TRACE_SET; other operations are counted and dropped.
+// Requests sharing a timestamp are spread evenly over one tick of it,
+// since a trace with second resolution would otherwise replay in
+// bursts once a second.
+//
+//   zstdcat cluster52.0.zst | ./mcperf-trace -f twitter - c52.trace
+//   ./mcperf-trace --info c52.trace
+//   ./mcperf -s host --replay c52.trace --replay_speed 2 -c 8 -d 4
+
+#include <errno.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "Trace.h"
+#include "log.h"
+
+#define TRACE_MAX_KEY 250
+#define TRACE_MAX_COLUMNS 32
+
+enum column_t { COL_SKIP, COL_TIME, COL_KEY, COL_KEY_SIZE, COL_VALUE_SIZE,
+                COL_OP, COL_TTL };
+
+struct trace_options_t {
+  const char *columns;
+  double unit_us;    // Microseconds per unit of the time column.
+  char delimiter;
+};
+
+static trace_options_t topts = {"time,key,key_size,value_size,op,ttl", 1.0,
+                                ','};
+
+static std::vector<column_t> parse_columns(const char *spec) {
+  std::vector<column_t> cols;
+  std::string s(spec);
+  size_t pos = 0;
+
+  while (pos <= s.size()) {
+    size_t end = s.find(',', pos);
+    if (end == std::string::npos) end = s.size();
+    std::string name = s.substr(pos, end - pos);
+
+    if (name == "-") cols.push_back(COL_SKIP);
+    else if (name == "time") cols.push_back(COL_TIME);
+    else if (name == "key") cols.push_back(COL_KEY);
+    else if (name == "key_size") cols.push_back(COL_KEY_SIZE);
+    else if (name == "value_size") cols.push_back(COL_VALUE_SIZE);
+    else if (name == "op") cols.push_back(COL_OP);
+    else if (name == "ttl") cols.push_back(COL_TTL);
+    else DIE("--columns: unknown column '%s'", name.c_str());
+
+    pos = end + 1;
+  }
+
+  bool time = false, key = false;
+  for (auto c: cols) {
+    time |= c == COL_TIME;
+    key |= c == COL_KEY;
+  }
+  if (!time || !key) DIE("--columns needs at least time and key");
+  if (cols.size() > TRACE_MAX_COLUMNS) DIE("--columns: too many columns");
+  return cols;
+}
+
+// TRACE_GET, TRACE_SET, or -1 for operations replay does not issue.
+static int parse_op(const char *op, size_t len) {
+  static const struct { const char *name; int op; } ops[] = {
+    {"get", TRACE_GET}, {"gets", TRACE_GET},
+    {"set", TRACE_SET}, {"add", TRACE_SET}, {"replace", TRACE_SET},
+    {"cas", TRACE_SET}, {"append", TRACE_SET}, {"prepend", TRACE_SET},
+  };
+
+  for (auto &o: ops)
+    if (strlen(o.name) == len && !strncasecmp(op, o.name, len)) return o.op;
+  return -1;
+}
+
+/**
+ * Buffers the records of one timestamp, so they can be spread over its
+ * tick, and writes them out.
+ */
+class TraceWriter {
+public:
+  TraceWriter(const char *path, double _unit_us) : written(0),
+    unit_us(_unit_us), first(true), last_time(0.0) {
+    if ((out = fopen(path, "w")) == NULL)
+      DIE("Cannot create %s: %s", path, strerror(errno));
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, TRACE_MAGIC, sizeof(header.magic));
+    header.version = TRACE_VERSION;
+    header.record_size = sizeof(trace_record_t);
+    if (fwrite(&header, sizeof(header), 1, out) != 1) DIE("write failed");
+  }
+
+  // time is in units of the input's time column.
+  void add(double time, const trace_record_t &r) {
+    if (first) {
+      start = time;
+      first = false;
+    }
+    if (time < last_time) time = last_time;  // Keep the trace sorted.
+    if (time != last_time) flush();
+    last_time = time;
+    group.push_back(r);
+  }
+
+  void close(uint64_t keys) {
+    flush();
+    header.count = written;
+    header.keys = keys;
+    if (fseek(out, 0, SEEK_SET) ||
+        fwrite(&header, sizeof(header), 1, out) != 1 || fclose(out))
+      DIE("write failed");
+  }
+
+  uint64_t written;
+  trace_header_t header;
+
+private:
+  FILE *out;
+  double unit_us;
+  bool first;
+  double start, last_time;
+  std::vector<trace_record_t> group;
+
+  void flush() {
+    double base = (last_time - start) * unit_us;
+    for (size_t i = 0; i < group.size(); i++) {
+      group[i].time_us = base + unit_us * i / group.size();
+      header.duration_us = group[i].time_us;
+    }
+    if (group.size() &&
+        fwrite(group.data(), sizeof(trace_record_t), group.size(), out) !=
+        group.size())
+      DIE("write failed");
+    written += group.size();
+    group.clear();
+  }
+};
+
+static void convert(const char *in_path, const char *out_path) {
+  std::vector<column_t> cols = parse_columns(topts.columns);
+
+  FILE *in = strcmp(in_path, "-") ? fopen(in_path, "r") : stdin;
+  if (in == NULL) DIE("Cannot open %s: %s", in_path, strerror(errno));
+
+  TraceWriter writer(out_path, topts.unit_us);
+  std::unordered_map<std::string, uint64_t> ids;
+  uint64_t lines = 0, malformed = 0, dropped = 0;
+
+  char *line = NULL;
+  size_t cap = 0;
+  ssize_t len;
+
+  while ((len = getline(&line, &cap, in)) > 0) {
+    lines++;
+    while (len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r'))
+      line[--len] = '\0';
+
+    // Split in place.
+    const char *field[TRACE_MAX_COLUMNS];
+    size_t flen[TRACE_MAX_COLUMNS];
+    size_t n = 0;
+    char *p = line;
+    while (n < cols.size()) {
+      char *e = strchr(p, topts.delimiter);
+      field[n] = p;
+      flen[n] = e ? e - p : strlen(p);
+      n++;
+      if (e == NULL) break;
+      *e = '\0';
+      p = e + 1;
+    }
+    if (n < cols.size()) {
+      malformed++;
+      continue;
+    }
+
+    trace_record_t r;
+    memset(&r, 0, sizeof(r));
+    r.op = TRACE_GET;
+    double time = 0.0;
+    bool ok = true, skip = false;
+    char *end;
+
+    for (size_t i = 0; i < cols.size() && ok; i++) {
+      switch (cols[i]) {
+      case COL_SKIP: break;
+      case COL_TIME:
+        time = strtod(field[i], &end);
+        ok = end != field[i];
+        break;
+      case COL_KEY: {
+        if (flen[i] == 0) {
+          ok = false;
+          break;
+        }
+        std::string key(field[i], flen[i]);
+        auto it = ids.find(key);
+        if (it == ids.end())
+          it = ids.insert(std::make_pair(key, (uint64_t) ids.size())).first;
+        r.key = it->second;
+        if (r.key_size == 0)
+          r.key_size = flen[i] > TRACE_MAX_KEY ? TRACE_MAX_KEY : flen[i];
+        break;
+      }
+      case COL_KEY_SIZE: {
+        long ks = strtol(field[i], &end, 10);
+        if (end != field[i] && ks > 0)
+          r.key_size = ks > TRACE_MAX_KEY ? TRACE_MAX_KEY : ks;
+        break;
+      }
+      case COL_VALUE_SIZE:
+        r.value_size = strtoul(field[i], NULL, 10);
+        break;
+      case COL_OP: {
+        int op = parse_op(field[i], flen[i]);
+        if (op < 0) skip = true;
+        else r.op = op;
+        break;
+      }
+      case COL_TTL:
+        r.ttl = strtoul(field[i], NULL, 10);
+        break;
+      }
+    }
+
+    if (!ok) malformed++;
+    else if (skip) dropped++;
+    else writer.add(time, r);
+  }
+
+  free(line);
+  if (in != stdin) fclose(in);
+  writer.close(ids.size());
+
+  I("%" PRIu64 " lines: %" PRIu64 " requests over %" PRIu64 " keys, "
+    "%.1fs; %" PRIu64 " other operations dropped, %" PRIu64 " malformed.",
+    lines, writer.written, (uint64_t) ids.size(),
+    writer.header.duration_us / 1000000.0, dropped, malformed);
+}
+
+static void info(const char *path) {
+  Trace trace(path);
+  uint64_t gets = 0, sets = 0, get_bytes = 0, set_bytes = 0, key_bytes = 0;
+
+  for (uint64_t i = 0; i < trace.count; i++) {
+    const trace_record_t &r = trace.records[i];
+    key_bytes += r.key_size;
+    if (r.op == TRACE_SET) {
+      sets++;
+      set_bytes += r.value_size;
+    } else {
+      gets++;
+      get_bytes += r.value_size;
+    }
+  }
+
+  printf("records      %" PRIu64 "\n", trace.count);
+  printf("keys         %" PRIu64 "\n", trace.header->keys);
+  printf("duration     %.3f s\n", trace.duration);
+  printf("qps          %.1f\n",
+         trace.duration > 0 ? trace.count / trace.duration : 0.0);
+  printf("gets         %" PRIu64 " (avg value %.1f B)\n", gets,
+         gets ? (double) get_bytes / gets : 0.0);
+  printf("sets         %" PRIu64 " (avg value %.1f B)\n", sets,
+         sets ? (double) set_bytes / sets : 0.0);
+  printf("avg key      %.1f B\n",
+         trace.count ? (double) key_bytes / trace.count : 0.0);
+}
+
+// One line per record, in --columns' default layout.
+static void dump(const char *path) {
+  Trace trace(path);
+
+  for (uint64_t i = 0; i < trace.count; i++) {
+    const trace_record_t &r = trace.records[i];
+    printf("%" PRIu64 ",%" PRIu64 ",%u,%u,%s,%u\n", r.time_us, r.key,
+           r.key_size, r.value_size, r.op == TRACE_SET ? "set" : "get", r.ttl);
+  }
+}
+
+static void usage() {
+  fprintf(stderr,
+          "Usage: mcperf-trace [options] <input.csv|-> <output.trace>\n"
+          "       mcperf-trace --info|--dump <trace>\n"
+          "  -f, --format=STRING   Input layout: twitter\n"
+          "  -c, --columns=STRING  Input columns: time, key, key_size, value_size,\n"
+          "                        op, ttl or - (default\n"
+          "                        time,key,key_size,value_size,op,ttl)\n"
+          "  -u, --unit=STRING     Unit of the time column: s, ms, us or ns\n"
+          "                        (default us; s for twitter)\n"
+          "  -d, --delimiter=CHAR  Column delimiter (default ,)\n"
+          "  -i, --info            Summarize a binary trace\n"
+          "      --dump            Print a binary trace as CSV (time in us)\n"
+          "  -v, --verbose         Verbose output\n"
+          "  -h, --help            Print this help\n");
+}
+
+static double parse_unit(const char *unit) {
+  if (!strcmp(unit, "s")) return 1000000.0;
+  if (!strcmp(unit, "ms")) return 1000.0;
+  if (!strcmp(unit, "us")) return 1.0;
+  if (!strcmp(unit, "ns")) return 0.001;
+  DIE("--unit: unknown unit '%s'", unit);
+}
+
+int main(int argc, char **argv) {
+  static struct option long_options[] = {
+    {"format",    required_argument, NULL, 'f'},
+    {"columns",   required_argument, NULL, 'c'},
+    {"unit",      required_argument, NULL, 'u'},
+    {"delimiter", required_argument, NULL, 'd'},
+    {"info",      no_argument,       NULL, 'i'},
+    {"dump",      no_argument,       NULL, 'D'},
+    {"verbose",   no_argument,       NULL, 'v'},
+    {"help",      no_argument,       NULL, 'h'},
+    {NULL, 0, NULL, 0}
+  };
+
+  const char *unit = NULL;
+  bool show_info = false, show_dump = false;
+
+  int opt;
+  while ((opt = getopt_long(argc, argv, "f:c:u:d:ivh", long_options, NULL)) != -1) {
+    switch (opt) {
+    case 'f':
+      if (strcmp(optarg, "twitter")) DIE("--format: unknown format '%s'", optarg);
+      topts.columns = "time,key,key_size,value_size,-,op,ttl";
+      if (unit == NULL) unit = "s";
+      break;
+    case 'c': topts.columns = optarg; break;
+    case 'u': unit = optarg; break;
+    case 'd':
+      if (strlen(optarg) != 1) DIE("--delimiter must be one character");
+      topts.delimiter = optarg[0];
+      break;
+    case 'i': show_info = true; break;
+    case 'D': show_dump = true; break;
+    case 'v': log_level = VERBOSE; break;
+    case 'h': usage(); return 0;
+    default: usage(); return 1;
+    }
+  }
+  if (unit != NULL) topts.unit_us = parse_unit(unit);
+
+  if (show_info || show_dump) {
+    if (optind + 1 != argc) {
+      usage();
+      return 1;
+    }
+    if (show_info) info(argv[optind]);
+    else dump(argv[optind]);
+    return 0;
+  }
+
+  if (optind + 2 != argc) {
+    usage();
+    return 1;
+  }
+  convert(argv[optind], argv[optind + 1]);
+  return 0;
+}
@@ -2,13 +2,19 @@
 #ifndef OPERATION_H
 #define OPERATION_H
 
+#include <assert.h>
+#include <stddef.h>
+
 #include <string>
 
+#include "util.h"
+
 using namespace std;
 
 class Operation {
 public:
-  double start_time, end_time;
+  uint64_t start_time, end_time;  // Ticks, see get_ticks().
+  uint64_t intended_time;  // Scheduled send time, <= start_time.
 
   enum type_enum {
     GET, SET, SASL
@@ -19,11 +25,111 @@ public:
   int n_recv;
   int interval = 0;
 
-  string key;
-  // string value;
+  int key_index;  // Slot in the Connection's key cache, -1 if none.
+  uint32_t opaque;  // Per-Connection sequence number.
+
+  double time() const { return ticks_to_us(end_time - start_time); }
+
+  // Response time measured from the scheduled send time, corrected for
+  // coordinated omission.
+  double corrected_time() const { return ticks_to_us(end_time - intended_time); }
+};
+
+
+/*
+ * OpQueue: fixed-capacity FIFO of in-flight Operations.
+ *
+ * Storage is allocated once, sized from --depth, so issuing and
+ * retiring a request never touches the allocator.  push() hands back
+ * the tail slot to be filled in place.  The loader, which keeps far
+ * more sets in flight, resizes it while empty and shrinks it back.
+ */
+class OpQueue {
+public:
+  OpQueue(size_t min_capacity) : ops(NULL), head(0), tail(0) {
+    resize(min_capacity);
+  }
+  ~OpQueue() { delete[] ops; }
+
+  void resize(size_t min_capacity) {
+    assert(empty());
+    delete[] ops;
+    capacity = 1;
+    while (capacity < min_capacity) capacity <<= 1;
+    ops = new Operation[capacity];
+    head = tail = 0;
+  }
+
+  size_t size() const { return tail - head; }
+  bool empty() const { return head == tail; }
+
+  Operation& front() { return ops[head & (capacity - 1)]; }
+  Operation& back() { return ops[(tail - 1) & (capacity - 1)]; }
+
+  Operation& push() {
+    assert(size() < capacity);
+    return ops[tail++ & (capacity - 1)];
+  }
 
-  double time() const { return (end_time - start_time) * 1000000; }
+  void pop() { head++; }
+
+private:
+  Operation *ops;
+  size_t capacity;
+  size_t head, tail;
+
+  OpQueue(const OpQueue&) = delete;
+  OpQueue& operator=(const OpQueue&) = delete;
 };
 
+/*
+ * OpaqueQueue: fixed-capacity FIFO of opaques, kept for the batch
+ * terminators in flight.  Like OpQueue its storage is sized once from
+ * --depth; every terminator closes a distinct op still in op_queue,
+ * bar the last retired one, so one more slot than op_queue always
+ * suffices.  resize() keeps the queued opaques.
+ */
+class OpaqueQueue {
+public:
+  OpaqueQueue(size_t min_capacity) : opaques(NULL), head(0), tail(0) {
+    resize(min_capacity);
+  }
+  ~OpaqueQueue() { delete[] opaques; }
+
+  void resize(size_t min_capacity) {
+    size_t n = 1;
+    while (n < min_capacity) n <<= 1;
+    assert(size() <= n);
+
+    uint32_t *grown = new uint32_t[n];
+    for (size_t i = 0; i < size(); i++)
+      grown[i] = opaques[(head + i) & (capacity - 1)];
+    tail = size();
+    head = 0;
+    delete[] opaques;
+    opaques = grown;
+    capacity = n;
+  }
+
+  size_t size() const { return tail - head; }
+  bool empty() const { return head == tail; }
+
+  uint32_t front() const { return opaques[head & (capacity - 1)]; }
+
+  void push(uint32_t opaque) {
+    assert(size() < capacity);
+    opaques[tail++ & (capacity - 1)] = opaque;
+  }
+
+  void pop() { head++; }
+
+private:
+  uint32_t *opaques;
+  size_t capacity;
+  size_t head, tail;
+
+  OpaqueQueue(const OpaqueQueue&) = delete;
+  OpaqueQueue& operator=(const OpaqueQueue&) = delete;
+};
 
 #endif // OPERATION_H
@@ -0,0 +1,190 @@
+// Microbenchmark and fuzz check: the zero-copy ASCII reply parser
+// (AsciiParser.h) vs. the old evbuffer_readln() + sscanf() path.
+//
+// Build with "make parserbench" and run ./parserbench [n_replies];
+// ./parserbench --check (run by "make check") only runs the fuzz pass.
+// Both parsers are first run over the same reply stream chopped at
+// random points (down to single-byte chains) and must agree; then each
+// is timed over the stream as it would arrive from 16KB socket reads.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+#include <event2/buffer.h>
+
+#include "log.h"
+#include "util.h"
+#include "AsciiParser.h"
+
+struct parse_state {
+  bool in_data;      // Waiting for value bytes.
+  bool got_value;    // Saw a VALUE since the last END.
+  long data_length;
+
+  long values, misses, ends, rx_bytes;
+};
+
+// The get path of ProtocolAscii::read_get() before AsciiParser.h.
+static void consume_readln(struct evbuffer *in, parse_state &s) {
+  for (;;) {
+    if (s.in_data) {
+      if (evbuffer_get_length(in) < (size_t) s.data_length + 2) return;
+      evbuffer_drain(in, s.data_length + 2);
+      s.rx_bytes += s.data_length + 2;
+      s.values++;
+      s.in_data = false;
+      continue;
+    }
+
+    size_t n_read_out;
+    char *buf = evbuffer_readln(in, &n_read_out, EVBUFFER_EOL_CRLF);
+    if (buf == NULL) return;
+    s.rx_bytes += n_read_out + 2;
+
+    int length;
+    if (!strncmp(buf, "VALUE", 5)) {
+      sscanf(buf, "VALUE %*s %*d %d", &length);
+      s.data_length = length;
+      s.in_data = s.got_value = true;
+    } else if (!strcmp(buf, "END")) {
+      if (!s.got_value) s.misses++;
+      s.got_value = false;
+      s.ends++;
+    } else {
+      DIE("Unexpected line %s", buf);
+    }
+    free(buf);
+  }
+}
+
+// The same, on ascii_peek_line().
+static void consume_peek(struct evbuffer *in, parse_state &s) {
+  for (;;) {
+    if (s.in_data) {
+      if (evbuffer_get_length(in) < (size_t) s.data_length + 2) return;
+      evbuffer_drain(in, s.data_length + 2);
+      s.rx_bytes += s.data_length + 2;
+      s.values++;
+      s.in_data = false;
+      continue;
+    }
+
+    const char *line;
+    size_t len, n = ascii_peek_line(in, &line, &len);
+    if (n == 0) return;
+
+    long length = ascii_value_length(line, len);
+    if (length >= 0) {
+      s.data_length = length;
+      s.in_data = s.got_value = true;
+    } else if (ascii_line_is(line, len, "END", 3)) {
+      if (!s.got_value) s.misses++;
+      s.got_value = false;
+      s.ends++;
+    } else {
+      DIE("Unexpected line %.*s", (int) len, line);
+    }
+    evbuffer_drain(in, n);
+    s.rx_bytes += n;
+  }
+}
+
+// Replies to n gets: ~10% misses, ~10% 5-key multi-gets, small values.
+static std::string make_replies(long n) {
+  std::string out;
+  char line[128];
+  std::string value(4096, 'x');
+
+  for (long i = 0; i < n; i++) {
+    double r = drand48();
+    int nvalues = r < 0.1 ? 0 : r < 0.2 ? 5 : 1;
+
+    for (int v = 0; v < nvalues; v++) {
+      int len = drand48() < 0.95 ? 2 + lrand48() % 64 : lrand48() % 4096;
+      int l = snprintf(line, sizeof(line), "VALUE key:%010ld %ld %d\r\n",
+                       lrand48() % 1000000, lrand48() % 4, len);
+      out.append(line, l);
+      out.append(value, 0, len);
+      out.append("\r\n");
+    }
+    out.append("END\r\n");
+  }
+
+  return out;
+}
+
+// Feed data through in to consume, one chain per chunk of 1..max_chunk
+// bytes (or exactly max_chunk bytes if !random).
+template <class F>
+static parse_state feed(const std::string &data, size_t max_chunk,
+                        bool random, F consume) {
+  parse_state s;
+  memset(&s, 0, sizeof(s));
+  struct evbuffer *in = evbuffer_new();
+
+  for (size_t off = 0; off < data.size(); ) {
+    size_t n = random ? 1 + lrand48() % max_chunk : max_chunk;
+    if (n > data.size() - off) n = data.size() - off;
+    evbuffer_add_reference(in, data.data() + off, n, NULL, NULL);
+    off += n;
+    consume(in, s);
+  }
+
+  if (evbuffer_get_length(in)) DIE("%zu bytes left unparsed",
+                                   evbuffer_get_length(in));
+  evbuffer_free(in);
+  return s;
+}
+
+static bool same(const parse_state &a, const parse_state &b) {
+  return a.values == b.values && a.misses == b.misses &&
+    a.ends == b.ends && a.rx_bytes == b.rx_bytes;
+}
+
+int main(int argc, char **argv) {
+  bool check_only = argc > 1 && !strcmp(argv[1], "--check");
+  if (check_only) argc--, argv++;
+  long n = argc > 1 ? atol(argv[1]) : 1000000;
+
+  srand48(0xdeadbeef);
+  std::string data = make_replies(n);
+
+  size_t chunks[] = {1, 7, 64, 1500, 16384};
+  for (size_t i = 0; i < sizeof(chunks) / sizeof(chunks[0]); i++) {
+    std::string small = data.substr(0, 1 << 20);
+    small.resize(small.rfind("END\r\n") + 5);
+
+    parse_state a = feed(small, chunks[i], true, consume_readln);
+    parse_state b = feed(small, chunks[i], true, consume_peek);
+    if (!same(a, b))
+      DIE("Parsers disagree with chunks up to %zu bytes: "
+          "values %ld/%ld misses %ld/%ld ends %ld/%ld rx %ld/%ld",
+          chunks[i], a.values, b.values, a.misses, b.misses,
+          a.ends, b.ends, a.rx_bytes, b.rx_bytes);
+  }
+  printf("fuzz    ok\n");
+  if (check_only) return 0;
+
+  double start = get_time_accurate();
+  parse_state a = feed(data, 16384, false, consume_readln);
+  double t_readln = get_time_accurate() - start;
+
+  start = get_time_accurate();
+  parse_state b = feed(data, 16384, false, consume_peek);
+  double t_peek = get_time_accurate() - start;
+
+  if (!same(a, b)) DIE("Parsers disagree");
+
+  printf("readln  %6.1f ns/reply  %6.2f GB/s\n", t_readln / n * 1e9,
+         data.size() / t_readln / 1e9);
+  printf("peek    %6.1f ns/reply  %6.2f GB/s\n", t_peek / n * 1e9,
+         data.size() / t_peek / 1e9);
+  printf("%ld replies, %ld values, %ld misses, %zu bytes\n",
+         b.ends, b.values, b.misses, data.size());
+
+  return 0;
+}
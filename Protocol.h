@@ -2,70 +2,596 @@
 #ifndef PROTOCOL_H
 #define PROTOCOL_H
 
-#include <event2/bufferevent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
-#include "ConnectionOptions.h"
+#include <event2/buffer.h>
 
-using namespace std;
+#include "AsciiParser.h"
+#include "binary_protocol.h"
+#include "Connection.h"
+#include "log.h"
+#include "Operation.h"
 
-class Connection;
+#define MAX_KEY_LEN 48
+#define MAX_MGET_KEYS 512
 
-class Protocol {
+#define unlikely(x) __builtin_expect((x),0)
+
+// Values at least this long are referenced rather than copied.
+#define VALUE_REFERENCE_MIN 1024
+
+/*
+ * Wire protocols, as policy classes.
+ *
+ * Connection's request and reply paths are templates over a protocol
+ * policy, bound once per Connection by Connection::bind_protocol().
+ * Each protocol therefore compiles to its own inlined state machine,
+ * with no per-request tests of options.protocol.  A policy is a class
+ * of static functions:
+ *
+ *   quiet_load                 true if the loader may use setq()/noop()
+ *   get(c, key, req)           append a get of key (req: prebuilt, or NULL)
+ *   multi_get(c, nkeys)        append a get of nkeys random keys
+ *   set(c, key, req, value, len, ttl)
+ *                              append a set (req: prebuilt ASCII prefix, or NULL;
+ *                              ttl in seconds, 0 for none)
+ *   setq(c, key, value, len)   append a set that is only answered on error
+ *   noop(c)                    append a request that is always answered
+ *   end_burst(c)               called after each run of requests is issued
+ *   read(c, op)                consume (part of) the reply to op
+ *
+ * Request functions return the number of bytes appended.  A new
+ * protocol needs a policy, a friend declaration in Connection and a
+ * case where the Connection constructor picks the policy; nothing else
+ * in Connection changes.
+ */
+
+/**
+ * Append a set's value.  Values are slices of random_char, which never
+ * changes once mcperf is running, so long ones are handed to the
+ * evbuffer by reference and go to the socket without a client-side
+ * copy.  Short ones are cheaper to copy than to give their own chain.
+ */
+static inline void add_value(struct evbuffer *out, const char *value, int len) {
+  if (len >= VALUE_REFERENCE_MIN)
+    evbuffer_add_reference(out, value, len, NULL, NULL);
+  else
+    evbuffer_add(out, value, len);
+}
+
+// Append v's decimal digits at p; returns the end.
+static inline char *put_uint(char *p, unsigned int v) {
+  char digits[12];
+  char *d = digits + sizeof(digits);
+  do *--d = '0' + v % 10; while (v /= 10);
+  memcpy(p, d, digits + sizeof(digits) - d);
+  return p + (digits + sizeof(digits) - d);
+}
+
+enum proto_read_t {
+  PROTO_INCOMPLETE,  // Need more input.
+  PROTO_PROGRESS,    // Consumed part of the reply; op is still open.
+  PROTO_VALUE,       // One value of a multi-key get; op is still open.
+  PROTO_DONE,        // Reply to op complete.
+  PROTO_FAILED,      // Reply to op complete, but the server refused it.
+  PROTO_UNSOLICITED, // Error reply to a quiet request; op is still open.
+};
+
+class ProtocolAscii {
 public:
-  Protocol(options_t _opts, Connection* _conn, bufferevent* _bev):
-    opts(_opts), conn(_conn), bev(_bev) {};
-  ~Protocol() {};
-
-  virtual bool setup_connection_w() = 0;
-  virtual bool setup_connection_r(evbuffer* input) = 0;
-  virtual int  get_request(const char* key) = 0;
-  virtual int  set_request(const char* key, const char* value, int len) = 0;
-  virtual bool handle_response(evbuffer* input, bool &done) = 0;
-
-protected:
-  options_t    opts;
-  Connection*  conn;
-  bufferevent* bev;
+  static const bool quiet_load = false;
+
+  static int get(Connection &c, const char *key, const char *req) {
+    if (req == NULL) return evbuffer_add_printf(c.output, "get %s\r\n", key);
+
+    int l = strlen(req);
+    evbuffer_add(c.output, req, l);
+    return l;
+  }
+
+  static int multi_get(Connection &c, int nkeys) {
+    char keys[MAX_KEY_LEN * MAX_MGET_KEYS];
+    char *p = keys;
+    int keylen = 0;
+
+    *p = '\0';
+    for (int n = 0; n < nkeys; n++) {
+      const char *key =
+        c.thread->keygen->generate(c.rng.below(c.options.records));
+      int curlen = strlen(key);
+      keylen += curlen + 1;
+      if (keylen > (MAX_KEY_LEN * MAX_MGET_KEYS)) break;
+      sprintf(p, "%s ", key);
+      p += curlen + 1;
+    }
+
+    return evbuffer_add_printf(c.output, "get %s\r\n", keys);
+  }
+
+  // req is the key cache's "set <key> 0 0 " (for ttl 0); only the
+  // length is formatted per request.
+  static int set(Connection &c, const char *key, const char *req,
+                 const char *value, int len, int ttl) {
+    char buf[max_memcached_len + 48];
+    char *p = buf;
+
+    if (req != NULL) {
+      size_t l = strlen(req);
+      memcpy(p, req, l);
+      p += l;
+    } else {
+      size_t l = strlen(key);
+      memcpy(p, "set ", 4);
+      memcpy(p + 4, key, l);
+      memcpy(p + 4 + l, " 0 ", 3);
+      p = put_uint(p + l + 7, ttl);
+      *p++ = ' ';
+    }
+
+    p = put_uint(p, len);
+    *p++ = '\r';
+    *p++ = '\n';
+
+    evbuffer_add(c.output, buf, p - buf);
+    add_value(c.output, value, len);
+    evbuffer_add(c.output, "\r\n", 2);
+    return (p - buf) + len + 2;
+  }
+
+  static int setq(Connection &c, const char *key, const char *value, int len) {
+    DIE("ASCII has no quiet set");
+  }
+
+  static int noop(Connection &c) { DIE("ASCII has no noop"); }
+
+  static void end_burst(Connection &c) {}
+
+  static proto_read_t read(Connection &c, Operation *op) {
+    if (op->type == Operation::SET) {
+      const char *line;
+      size_t len, n = ascii_peek_line(c.input, &line, &len);
+      if (n == 0) return PROTO_INCOMPLETE;
+
+      bool stored = ascii_line_is(line, len, "STORED", 6);
+      evbuffer_drain(c.input, n);
+      c.stats.rx_bytes += n;
+      return stored ? PROTO_DONE : PROTO_FAILED;
+    }
+
+    return read_get(c, op);
+  }
+
+private:
+  // Gets walk WAITING_FOR_GET -> (VALUE) WAITING_FOR_GET_DATA ->
+  // WAITING_FOR_END, and back to WAITING_FOR_GET_DATA for every further
+  // value of a multi-get.
+  static proto_read_t read_get(Connection &c, Operation *op) {
+    const char *line;
+    size_t len, n;
+    long length;
+
+    switch (c.read_state) {
+    case Connection::WAITING_FOR_GET:
+    case Connection::WAITING_FOR_END:
+      n = ascii_peek_line(c.input, &line, &len);
+      if (n == 0) return PROTO_INCOMPLETE;
+
+      // FIXME: check key name to see if it corresponds to the op at
+      // the head of the op queue?  This will be necessary to
+      // support "gets" where there may be misses.
+      length = ascii_value_length(line, len);
+      if (length >= 0) {
+        evbuffer_drain(c.input, n);
+        c.stats.rx_bytes += n;
+
+        c.data_length = length;
+        bool more = c.read_state == Connection::WAITING_FOR_END;
+        c.read_state = Connection::WAITING_FOR_GET_DATA;
+        return more ? PROTO_VALUE : PROTO_PROGRESS;
+      }
+
+      if (ascii_line_is(line, len, "END", 3)) {
+        if (c.read_state == Connection::WAITING_FOR_GET) c.stats.get_misses++;
+        evbuffer_drain(c.input, n);
+        c.stats.rx_bytes += n;
+        return PROTO_DONE;
+      }
+
+      if (c.read_state == Connection::WAITING_FOR_END) {
+        D("Wanted END got %.*s\n", (int) len, line);
+        DIE("Unexpected result when waiting for END");
+      }
+
+      D("[%s]: *** GOT %.*s\n", c.port.c_str(), (int) len, line);
+      evbuffer_drain(c.input, n);
+      c.stats.rx_bytes += n;
+      return PROTO_PROGRESS;
+
+    case Connection::WAITING_FOR_GET_DATA:
+      if (evbuffer_get_length(c.input) < (size_t) c.data_length + 2)
+        return PROTO_INCOMPLETE;
+
+      // FIXME: Actually parse the value?  Right now we just drain it.
+      evbuffer_drain(c.input, c.data_length + 2);
+      c.stats.rx_bytes += c.data_length + 2;
+      op->n_recv++;
+      c.read_state = Connection::WAITING_FOR_END;
+      return PROTO_PROGRESS;
+
+    default: DIE("Unexpected read state %d for a get", c.read_state);
+    }
+  }
 };
 
-class ProtocolAscii : public Protocol {
+class ProtocolBinary {
 public:
-  ProtocolAscii(options_t opts, Connection* conn, bufferevent* bev):
-    Protocol(opts, conn, bev) {
-    read_state = IDLE;
-  };
+  static const bool quiet_load = true;
+
+  // req is the key cache's GET header and key; only the opaque is
+  // filled in per request.
+  static int get(Connection &c, const char *key, const char *req) {
+    uint16_t keylen = strlen(key);
+
+    if (req != NULL) {
+      char buf[24 + max_memcached_len];
+      memcpy(buf, req, 24 + keylen);
+      ((binary_header_t *) buf)->opaque = htonl(c.op_queue.back().opaque);
+      evbuffer_add(c.output, buf, 24 + keylen);
+      return 24 + keylen;
+    }
+
+    // each line is 4-bytes
+    binary_header_t h = {0x80, CMD_GET, htons(keylen),
+                         0x00, 0x00, {htons(0)},
+                         htonl(keylen), htonl(c.op_queue.back().opaque) };
+
+    evbuffer_add(c.output, &h, 24); // size does not include extras
+    evbuffer_add(c.output, key, keylen);
+    return 24 + keylen;
+  }
+
+  // One GETKQ per key, closed by a NOOP.  Only hits are answered, each
+  // tagged with the op's opaque; keys still unanswered when the NOOP
+  // arrives are misses.
+  static int multi_get(Connection &c, int nkeys) {
+    binary_header_t h = {0x80, CMD_GETKQ, 0,
+                         0x00, 0x00, {htons(0)}, //TODO(syang0) get actual vbucket?
+                         0, htonl(c.op_queue.back().opaque) };
+    int l = 0;
+
+    for (int n = 0; n < nkeys; n++) {
+      const char *key =
+        c.thread->keygen->generate(c.rng.below(c.options.records));
+      uint16_t keylen = strlen(key);
+      h.key_len = htons(keylen);
+      h.body_len = htonl(keylen);
+      evbuffer_add(c.output, &h, 24); // size does not include extras
+      evbuffer_add(c.output, key, keylen);
+      l += 24 + keylen;
+    }
+
+    return l + noop(c);
+  }
+
+  static int set(Connection &c, const char *key, const char *req,
+                 const char *value, int len, int ttl) {
+    return store(c, CMD_SET, c.op_queue.back().opaque, key, value, len, ttl);
+  }
+
+  // Loader sets have no op of their own; failures are recognized by
+  // their opcode.
+  static int setq(Connection &c, const char *key, const char *value, int len) {
+    return store(c, CMD_SETQ, 0, key, value, len);
+  }
+
+  static int noop(Connection &c) {
+    binary_header_t h = {0x80, CMD_NOOP, 0, 0x00, 0x00, {htons(0)}, 0,
+                         htonl(c.op_queue.back().opaque)};
+    evbuffer_add(c.output, &h, 24);
+    return 24;
+  }
+
+  static void end_burst(Connection &c) {}
 
-  ~ProtocolAscii() {};
+  static proto_read_t read(Connection &c, Operation *op) {
+    uint8_t opcode;
+    uint16_t status;
+    uint32_t opaque;
 
-  virtual bool setup_connection_w() { return true; }
-  virtual bool setup_connection_r(evbuffer* input) { return true; }
-  virtual int  get_request(const char* key);
-  virtual int  set_request(const char* key, const char* value, int len);
-  virtual bool handle_response(evbuffer* input, bool &done);
+    if (!consume(c, opcode, status, opaque)) return PROTO_INCOMPLETE;
+
+    if (opcode == CMD_SETQ) return PROTO_UNSOLICITED;
+    if (op == NULL) return PROTO_DONE;  // SASL
+    if (opaque != op->opaque)
+      DIE("Binary reply for opaque %u, expected %u", opaque, op->opaque);
+
+    switch (opcode) {
+    case CMD_GETKQ:
+      op->n_recv++;
+      return PROTO_VALUE;
+    case CMD_NOOP:
+      // Ends a multi-get or a loader batch.
+      if (op->type == Operation::GET)
+        c.stats.get_misses += op->n_req - op->n_recv;
+      return PROTO_DONE;
+    case CMD_GET:
+      // If something other than success, count it as a miss
+      if (status) c.stats.get_misses++;
+      return PROTO_DONE;
+    default:
+      return status ? PROTO_FAILED : PROTO_DONE;
+    }
+  }
+
+  /**
+   * Tries to consume a binary response (in its entirety) from the
+   * Connection's input.
+   *
+   * @return  true if consumed, false if not enough data in buffer.
+   */
+  static bool consume(Connection &c, uint8_t &opcode, uint16_t &status,
+                      uint32_t &opaque) {
+    // Read the first 24 bytes as a header
+    int length = evbuffer_get_length(c.input);
+    if (length < 24) return false;
+    binary_header_t* h =
+      reinterpret_cast<binary_header_t*>(evbuffer_pullup(c.input, 24));
+    assert(h);
+
+    // Not whole response
+    int targetLen = 24 + ntohl(h->body_len);
+    if (length < targetLen) return false;
+
+    opcode = h->opcode;
+    status = ntohs(h->status);
+    opaque = ntohl(h->opaque);
+
+    if (unlikely(opcode == CMD_SASL)) {
+      if (status == RESP_OK) {
+        V("SASL authentication succeeded");
+      } else {
+        DIE("SASL authentication failed");
+      }
+    }
+
+    evbuffer_drain(c.input, targetLen);
+    c.stats.rx_bytes += targetLen;
+    return true;
+  }
 
 private:
-  enum read_fsm {
-    IDLE,
-    WAITING_FOR_GET,
-    WAITING_FOR_GET_DATA,
-    WAITING_FOR_END,
-  };
-
-  read_fsm read_state;
-  int data_length;
+  static int store(Connection &c, uint8_t opcode, uint32_t opaque,
+                   const char *key, const char *value, int len,
+                   int ttl = 0) {
+    uint16_t keylen = strlen(key);
+
+    // each line is 4-bytes
+    binary_header_t h = { 0x80, opcode, htons(keylen),
+                          0x08, 0x00, {htons(0)}, //TODO(syang0) get actual vbucket?
+                          htonl(keylen + 8 + len), htonl(opaque) };
+
+    char buf[32 + max_memcached_len];
+    memcpy(buf, &h, 32); // With extras
+    if (ttl) {
+      uint32_t expiration = htonl(ttl);  // Extras: flags, expiration.
+      memcpy(buf + 28, &expiration, 4);
+    }
+    memcpy(buf + 32, key, keylen);
+    evbuffer_add(c.output, buf, 32 + keylen);
+    add_value(c.output, value, len);
+    return 32 + keylen + len;
+  }
 };
 
-class ProtocolBinary : public Protocol {
+/*
+ * memcached meta protocol: mg, ms and mn.
+ *
+ * Every request carries the op's opaque (O flag), which the server
+ * echoes, so replies are matched to ops by opaque rather than by
+ * position.  Unless --meta_replies is given, requests are quiet (q
+ * flag): get misses and successful sets are not answered at all.
+ * Each run of requests then ends with an mn, and its MN reply closes
+ * every op issued before it.  An op that is passed over (a reply for
+ * a later opaque arrives, or its MN) got no reply: a miss for each
+ * key of a get still missing a value, success for a set.
+ *
+ * Gets ask for the value (v) and its size (s); --meta_base64 sends
+ * keys base64-encoded (b).
+ */
+class ProtocolMeta {
 public:
-  ProtocolBinary(options_t opts, Connection* conn, bufferevent* bev):
-    Protocol(opts, conn, bev) {};
-  ~ProtocolBinary() {};
-
-  virtual bool setup_connection_w();
-  virtual bool setup_connection_r(evbuffer* input);
-  virtual int  get_request(const char* key);
-  virtual int  set_request(const char* key, const char* value, int len);
-  virtual bool handle_response(evbuffer* input, bool &done);
+  static const bool quiet_load = true;
+
+  static int get(Connection &c, const char *key, const char *req) {
+    return mg(c, key, c.op_queue.back().opaque);
+  }
+
+  static int multi_get(Connection &c, int nkeys) {
+    uint32_t opaque = c.op_queue.back().opaque;
+    int l = 0;
+
+    for (int n = 0; n < nkeys; n++) {
+      const char *key =
+        c.thread->keygen->generate(c.rng.below(c.options.records));
+      l += mg(c, key, opaque);
+    }
+
+    return l;
+  }
+
+  static int set(Connection &c, const char *key, const char *req,
+                 const char *value, int len, int ttl) {
+    char k[MAX_B64_KEY_LEN], t[16] = "";
+    if (ttl) snprintf(t, sizeof(t), " T%d", ttl);
+    int l = evbuffer_add_printf(c.output, "ms %s %d%s%s%s O%u\r\n",
+                                encode_key(c, key, k), len, quiet_flag(c),
+                                c.options.meta_base64 ? " b" : "", t,
+                                c.op_queue.back().opaque);
+    add_value(c.output, value, len);
+    evbuffer_add(c.output, "\r\n", 2);
+    if (!c.options.meta_replies) c.unfenced = true;
+    return l + len + 2;
+  }
+
+  // Loader sets: quiet and without an opaque, so only failures are
+  // answered, and those can be told apart from the batch's MN.
+  static int setq(Connection &c, const char *key, const char *value, int len) {
+    char k[MAX_B64_KEY_LEN];
+    int l = evbuffer_add_printf(c.output, "ms %s %d q%s\r\n",
+                                encode_key(c, key, k), len,
+                                c.options.meta_base64 ? " b" : "");
+    add_value(c.output, value, len);
+    evbuffer_add(c.output, "\r\n", 2);
+    return l + len + 2;
+  }
+
+  static int noop(Connection &c) {
+    evbuffer_add(c.output, "mn\r\n", 4);
+    c.fences.push(c.op_queue.back().opaque);
+    return 4;
+  }
+
+  static void end_burst(Connection &c) {
+    if (!c.unfenced) return;
+
+    evbuffer_add(c.output, "mn\r\n", 4);
+    c.fences.push(c.op_queue.back().opaque);
+    c.unfenced = false;
+    if (c.read_state != Connection::LOADING) c.stats.tx_bytes += 4;
+  }
+
+  static proto_read_t read(Connection &c, Operation *op) {
+    const char *line;
+    size_t len, line_len = ascii_peek_line(c.input, &line, &len);
+    if (line_len == 0) return PROTO_INCOMPLETE;
+
+    const char *end = line + len;
+
+    if (len < 2) DIE("Malformed meta reply");
+
+    if (line[0] == 'M' && line[1] == 'N') {
+      if (c.fences.empty()) DIE("MN without a pending mn");
+      uint32_t fence = c.fences.front();
+
+      if (!seq_before(fence, op->opaque)) {
+        if (op->opaque == fence) {
+          drain(c, line_len);
+          c.fences.pop();
+        }
+        return unanswered(c, op);
+      }
+
+      // Everything up to the fence was answered already.
+      drain(c, line_len);
+      c.fences.pop();
+      return PROTO_PROGRESS;
+    }
+
+    uint32_t opaque;
+    if (find_opaque(line + 2, end, opaque)) {
+      if (seq_before(op->opaque, opaque)) return unanswered(c, op);
+      if (opaque != op->opaque)
+        DIE("Meta reply for opaque %u, expected %u", opaque, op->opaque);
+    } else if (c.read_state == Connection::LOADING) {
+      drain(c, line_len);  // A failed loader set.
+      return PROTO_UNSOLICITED;
+    }
+
+    // The line's memory goes away once drained.
+    char code[2] = { line[0], line[1] };
+
+    if (code[0] == 'V' && code[1] == 'A') {
+      size_t need = line_len + ascii_parse_uint(line + 3, end) + 2;
+      if (evbuffer_get_length(c.input) < need) return PROTO_INCOMPLETE;
+      drain(c, need);
+      return ++op->n_recv < op->n_req ? PROTO_VALUE : PROTO_DONE;
+    }
+
+    drain(c, line_len);
+
+    if (code[0] == 'H' && code[1] == 'D') {
+      if (op->type == Operation::GET)
+        return ++op->n_recv < op->n_req ? PROTO_VALUE : PROTO_DONE;
+      return PROTO_DONE;
+    }
+
+    if (code[0] == 'E' && code[1] == 'N') {
+      c.stats.get_misses++;
+      return ++op->n_recv < op->n_req ? PROTO_PROGRESS : PROTO_DONE;
+    }
+
+    // NS, EX, NF, or an error.
+    return PROTO_FAILED;
+  }
+
+private:
+  // "mg " + a base64 key + flags fit comfortably.
+  static const int MAX_B64_KEY_LEN = 4 * MAX_KEY_LEN;
+
+  static int mg(Connection &c, const char *key, uint32_t opaque) {
+    char k[MAX_B64_KEY_LEN];
+    if (!c.options.meta_replies) c.unfenced = true;
+    return evbuffer_add_printf(c.output, "mg %s s v%s%s O%u\r\n",
+                               encode_key(c, key, k), quiet_flag(c),
+                               c.options.meta_base64 ? " b" : "", opaque);
+  }
+
+  static const char *quiet_flag(Connection &c) {
+    return c.options.meta_replies ? "" : " q";
+  }
+
+  static const char *encode_key(Connection &c, const char *key, char *out) {
+    static const char b64[] =
+      "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+    if (!c.options.meta_base64) return key;
+
+    int len = strlen(key);
+    if (len > 3 * (MAX_B64_KEY_LEN / 4 - 1)) DIE("Key too long for base64");
+
+    char *p = out;
+    for (int i = 0; i < len; i += 3) {
+      uint32_t v = (uint8_t) key[i] << 16;
+      if (i + 1 < len) v |= (uint8_t) key[i + 1] << 8;
+      if (i + 2 < len) v |= (uint8_t) key[i + 2];
+
+      *p++ = b64[(v >> 18) & 63];
+      *p++ = b64[(v >> 12) & 63];
+      *p++ = i + 1 < len ? b64[(v >> 6) & 63] : '=';
+      *p++ = i + 2 < len ? b64[v & 63] : '=';
+    }
+    *p = '\0';
+    return out;
+  }
+
+  // True if opaque a was issued before b (sequence numbers wrap).
+  static bool seq_before(uint32_t a, uint32_t b) { return (int32_t) (a - b) < 0; }
+
+  static bool find_opaque(const char *p, const char *end, uint32_t &opaque) {
+    while (p < end) {
+      while (p < end && *p == ' ') p++;
+      if (p < end && *p == 'O') {
+        opaque = strtoul(p + 1, NULL, 10);
+        return true;
+      }
+      while (p < end && *p != ' ') p++;
+    }
+    return false;
+  }
+
+  static void drain(Connection &c, size_t len) {
+    evbuffer_drain(c.input, len);
+    c.stats.rx_bytes += len;
+  }
+
+  // op will get no (further) reply: quiet misses, or a quiet set that
+  // succeeded.
+  static proto_read_t unanswered(Connection &c, Operation *op) {
+    if (op->type == Operation::GET) c.stats.get_misses += op->n_req - op->n_recv;
+    return PROTO_DONE;
+  }
 };
 
 #endif
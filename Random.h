@@ -0,0 +1,74 @@
+// -*- c++ -*-
+#ifndef RANDOM_H
+#define RANDOM_H
+
+#include <stdint.h>
+
+#include <atomic>
+
+/*
+ * xoshiro256** pseudo-random generator (Blackman and Vigna).
+ *
+ * drand48()/lrand48() keep one process-wide state, so every thread
+ * drawing from them writes the same cache line, and which thread gets
+ * which number depends on scheduling.  Instead each Connection owns an
+ * Rng for its inter-arrival times, and each thread's ThreadState one
+ * for the key cache and value sizes its Connections share, seeded from
+ * --seed and their position (agent, thread, connection), so request
+ * streams are reproducible and no state is shared between threads.
+ * Code outside these draws from thread_rng().
+ */
+class Rng {
+public:
+  Rng(uint64_t seed = 0, uint64_t stream = 0) { this->seed(seed, stream); }
+
+  // Distinct streams of one seed start from unrelated states.
+  void seed(uint64_t seed, uint64_t stream = 0) {
+    uint64_t x = seed ^ (stream * 0xd1342543de82ef95ULL);
+    for (int i = 0; i < 4; i++) s[i] = splitmix64(x);
+  }
+
+  uint64_t next() {
+    uint64_t result = rotl(s[1] * 5, 7) * 9;
+    uint64_t t = s[1] << 17;
+
+    s[2] ^= s[0];
+    s[3] ^= s[1];
+    s[1] ^= s[2];
+    s[0] ^= s[3];
+    s[2] ^= t;
+    s[3] = rotl(s[3], 45);
+
+    return result;
+  }
+
+  // Uniform on [0, 1), like drand48().
+  double uniform() { return (next() >> 11) * (1.0 / (1ULL << 53)); }
+
+  // Uniform on [0, n), like lrand48() % n but without its bias.
+  uint64_t below(uint64_t n) {
+    return (uint64_t) (((unsigned __int128) next() * n) >> 64);
+  }
+
+private:
+  uint64_t s[4];
+
+  static uint64_t rotl(uint64_t x, int k) { return (x << k) | (x >> (64 - k)); }
+
+  static uint64_t splitmix64(uint64_t &x) {
+    uint64_t z = (x += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+  }
+};
+
+// The calling thread's generator, one stream per thread in order of
+// first use.
+inline Rng &thread_rng() {
+  static std::atomic<uint64_t> streams(0);
+  static thread_local Rng rng(0x6d63706572660000ULL, ++streams);
+  return rng;
+}
+
+#endif // RANDOM_H
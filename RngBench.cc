@@ -0,0 +1,65 @@
+// Microbenchmark: drand48() vs. per-thread Rng across threads.
+//
+// Build with "make rngbench" and run ./rngbench [draws_per_thread].
+// drand48() shares one state between all threads; Rng throughput
+// should scale with the thread count.
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <vector>
+
+#include "log.h"
+#include "util.h"
+#include "Random.h"
+
+struct bench_arg {
+  bool libc;
+  long n;
+  double sink;
+};
+
+static void *bench_thread(void *p) {
+  bench_arg *a = (bench_arg *) p;
+  double sum = 0.0;
+
+  if (a->libc) {
+    for (long i = 0; i < a->n; i++) sum += drand48();
+  } else {
+    Rng &rng = thread_rng();
+    for (long i = 0; i < a->n; i++) sum += rng.uniform();
+  }
+
+  a->sink = sum;
+  return NULL;
+}
+
+static double run(bool libc, int threads, long n) {
+  std::vector<pthread_t> pt(threads);
+  std::vector<bench_arg> args(threads);
+
+  double start = get_time_accurate();
+  for (int t = 0; t < threads; t++) {
+    args[t].libc = libc;
+    args[t].n = n;
+    if (pthread_create(&pt[t], NULL, bench_thread, &args[t]))
+      DIE("pthread_create() failed");
+  }
+  for (int t = 0; t < threads; t++) pthread_join(pt[t], NULL);
+  double t = get_time_accurate() - start;
+
+  return threads * n / t / 1e6;
+}
+
+int main(int argc, char **argv) {
+  long n = argc > 1 ? atol(argv[1]) : 20000000;
+  int threads[] = {1, 2, 4, 8, 16, 32};
+
+  printf("%7s %14s %14s\n", "threads", "drand48 M/s", "Rng M/s");
+  for (size_t i = 0; i < sizeof(threads) / sizeof(threads[0]); i++)
+    printf("%7d %14.1f %14.1f\n", threads[i], run(true, threads[i], n),
+           run(false, threads[i], n));
+
+  return 0;
+}
@@ -0,0 +1,84 @@
+// Microbenchmark: HdrHistogramSampler vs. the old LogHistogramSampler.
+//
+// Build with "make samplerbench" and run ./samplerbench [n_samples].
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#include <inttypes.h>
+#include <math.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "log.h"
+#include "util.h"
+#include "HdrHistogramSampler.h"
+#include "LogHistogramSampler.h"
+
+gengetopt_args_info args;
+
+int HdrHistogramSampler::default_digits = HDR_SIG_DIGITS;
+double HdrHistogramSampler::default_max_us = HDR_MAX_US;
+
+static int details[] = {5, 10, 50, 90, 95, 99, 999, 9999};
+static int ndetails = sizeof(details) / sizeof(int);
+
+template <class Sampler>
+static void run(const char *name, Sampler &h, Sampler &merged,
+                const std::vector<double> &lat) {
+  double start = get_time_accurate();
+  for (size_t i = 0; i < lat.size(); i++) h.sample(lat[i]);
+  double t_sample = get_time_accurate() - start;
+
+  int reps = 1000;
+  double sink = 0.0;
+  start = get_time_accurate();
+  for (int r = 0; r < reps; r++)
+    for (int i = 0; i < ndetails; i++) sink += h.get_nth(details[i]);
+  double t_nth = get_time_accurate() - start;
+
+  start = get_time_accurate();
+  for (int r = 0; r < reps; r++) merged.accumulate(h);
+  double t_merge = get_time_accurate() - start;
+
+  printf("%-6s sample %6.2f ns   get_nth %8.1f ns   accumulate %8.1f ns  (%g)\n",
+         name, t_sample / lat.size() * 1e9, t_nth / (reps * ndetails) * 1e9,
+         t_merge / reps * 1e9, sink > 0 ? 0.0 : 1.0);
+
+  printf("%-6s", name);
+  for (int i = 0; i < ndetails; i++) printf(" p%d=%.1f", details[i], h.get_nth(details[i]));
+  printf("\n");
+}
+
+int main(int argc, char **argv) {
+  size_t n = argc > 1 ? atol(argv[1]) : 10000000;
+
+  // Log-normal latencies around 50us with a long tail.
+  srand48(0xdeadbeef);
+  std::vector<double> lat(n);
+  for (size_t i = 0; i < n; i++) {
+    double u1 = drand48(), u2 = drand48();
+    double z = sqrt(-2.0 * log(1.0 - u1)) * cos(2.0 * M_PI * u2);
+    lat[i] = exp(log(50.0) + 0.6 * z);
+  }
+
+  std::vector<double> sorted(lat);
+  std::sort(sorted.begin(), sorted.end());
+  printf("%-6s", "exact");
+  for (int i = 0; i < ndetails; i++) {
+    double q = details[i] > 1000 ? details[i] / 10000.0 :
+      details[i] > 100 ? details[i] / 1000.0 : details[i] / 100.0;
+    printf(" p%d=%.1f", details[i], sorted[(size_t) (q * (n - 1))]);
+  }
+  printf("\n");
+
+  LogHistogramSampler log_h(LOGSAMPLER_BINS), log_m(LOGSAMPLER_BINS);
+  run("log", log_h, log_m, lat);
+
+  HdrHistogramSampler hdr_h, hdr_m;
+  run("hdr", hdr_h, hdr_m, lat);
+
+  return 0;
+}
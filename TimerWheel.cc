@@ -0,0 +1,119 @@
+#include <event2/event.h>
+
+#include "config.h"
+
+#include "Connection.h"
+#include "TimerWheel.h"
+#include "log.h"
+#include "util.h"
+
+TimerWheel::TimerWheel(struct event_base *base, double _spin) :
+  spin(_spin), cur(tick(get_time())), pending(0), next(0.0), ev(NULL),
+  armed(0.0) {
+  if (base && (ev = evtimer_new(base, timer_cb, this)) == NULL)
+    DIE("evtimer_new() failed");
+}
+
+TimerWheel::~TimerWheel() {
+  if (ev) event_free(ev);
+}
+
+void TimerWheel::attach(Connection *conn) {
+  conn->wheel = this;
+}
+
+void TimerWheel::add(Connection *conn, double deadline) {
+  uint64_t t = tick(deadline);
+  if (t < cur) t = cur;
+  slots[t & (TIMER_WHEEL_SLOTS - 1)].push_back(entry{deadline, conn});
+
+  if (pending++ == 0 || deadline < next) next = deadline;
+  if (ev && (armed == 0.0 || deadline < armed)) arm(deadline, get_time());
+}
+
+void TimerWheel::fire(std::vector<entry> &slot, double now) {
+  firing.swap(slot);
+
+  for (auto &e: firing) {
+    if (e.deadline > now) {
+      slot.push_back(e);
+      continue;
+    }
+    pending--;
+
+    // Stale entries (re-armed or cancelled) are skipped lazily.
+    Connection *conn = e.conn;
+    if (conn->timer_deadline != e.deadline) continue;
+
+    conn->timer_deadline = 0.0;
+    conn->timer_callback();
+  }
+
+  firing.clear();
+}
+
+void TimerWheel::run(double now) {
+  uint64_t end = tick(now);
+
+  if (pending) {
+    // Each slot is visited at most once however long we slept.
+    for (uint64_t t = cur; t <= end && t < cur + TIMER_WHEEL_SLOTS; t++)
+      fire(slots[t & (TIMER_WHEEL_SLOTS - 1)], now);
+  }
+  if (end > cur) cur = end;
+
+  find_next();
+  if (ev) {
+    armed = 0.0;
+    if (pending) arm(next, now);
+  }
+}
+
+/**
+ * The first slot holding a live entry of the current turn holds the
+ * earliest deadline.  Stale entries met on the way are dropped, so a
+ * re-armed or cancelled timer never wakes the thread.  With nothing
+ * due within a turn, wake up after one anyway.
+ */
+void TimerWheel::find_next() {
+  if (!pending) return;
+
+  for (uint64_t t = cur; t < cur + TIMER_WHEEL_SLOTS; t++) {
+    std::vector<entry> &slot = slots[t & (TIMER_WHEEL_SLOTS - 1)];
+    bool found = false;
+    size_t kept = 0;
+    for (auto &e: slot) {
+      if (e.conn->timer_deadline != e.deadline) {
+        pending--;
+        continue;
+      }
+      slot[kept++] = e;
+      if (tick(e.deadline) > t) continue;
+      if (!found || e.deadline < next) next = e.deadline;
+      found = true;
+    }
+    slot.resize(kept);
+    if (found) return;
+    if (!pending) {
+      next = 0.0;
+      return;
+    }
+  }
+
+  next = (cur + TIMER_WHEEL_SLOTS) * TIMER_WHEEL_TICK;
+}
+
+void TimerWheel::arm(double deadline, double now) {
+  double delay = deadline - now;
+  if (delay < spin) delay = 0.0;
+
+  struct timeval tv;
+  double_to_tv(delay, &tv);
+  evtimer_add(ev, &tv);
+  armed = deadline;
+}
+
+void TimerWheel::timer_cb(evutil_socket_t fd, short what, void *ptr) {
+  TimerWheel *wheel = (TimerWheel *) ptr;
+  wheel->run(get_time());
+}
@@ -0,0 +1,85 @@
+// -*- c++-mode -*-
+#ifndef TIMERWHEEL_H
+#define TIMERWHEEL_H
+
+#include "config.h"
+
+#include <stdint.h>
+
+#include <vector>
+
+#include <event2/event.h>
+
+#include "util.h"
+
+class Connection;
+
+#define TIMER_WHEEL_SLOTS 4096    // Power of two.
+#define TIMER_WHEEL_TICK  0.0001  // Seconds per slot; a turn is ~0.4s.
+
+/*
+ * TimerWheel: per-thread hashed timing wheel holding the next send
+ * time of every Connection of the thread.
+ *
+ * Connection::arm_timer() drops (deadline, Connection) into the slot
+ * of its tick in O(1); re-arming or cancelling just changes
+ * Connection::timer_deadline, and entries that no longer match it are
+ * dropped when their slot comes up.  Deadlines more than a turn away
+ * stay in their slot until their turn.  Under libevent the whole
+ * wheel is driven by one evtimer armed for the earliest deadline, so
+ * thousands of connections cost one timer in the event_base instead of
+ * one each; UringEngine asks next_deadline() for its wait timeout and
+ * calls run() itself.
+ *
+ * A wait shorter than spin seconds is not slept: the evtimer is armed
+ * with a zero timeout (or io_uring is entered without waiting), so the
+ * loop keeps polling sockets until the deadline instead of paying a
+ * wakeup's latency.
+ */
+class TimerWheel {
+public:
+  TimerWheel(struct event_base *base, double _spin = 0.0);
+  ~TimerWheel();
+
+  void attach(Connection *conn);
+  void add(Connection *conn, double deadline);
+  // Fire every timer due by now.
+  void run(double now);
+  // run() if a timer may be due.  Called after every libevent loop
+  // iteration: libevent times its own timers with a coarse cached
+  // clock that can fire them a scheduler tick late.
+  void poll() {
+    if (!pending) return;
+    double now = get_time();
+    if (now >= next) run(now);
+  }
+  // No later than the earliest pending deadline; 0.0 if none.
+  double next_deadline() const { return pending ? next : 0.0; }
+
+  double spin;
+
+private:
+  struct entry {
+    double deadline;
+    Connection *conn;
+  };
+
+  std::vector<entry> slots[TIMER_WHEEL_SLOTS];
+  std::vector<entry> firing;  // Slot being run; callbacks may refill it.
+  uint64_t cur;               // Tick run() has reached.
+  size_t pending;             // Entries in slots, stale ones included.
+  double next;
+
+  struct event *ev;  // NULL under io_uring.
+  double armed;      // Deadline ev is armed for, 0.0 if none.
+
+  static uint64_t tick(double t) { return (uint64_t) (t / TIMER_WHEEL_TICK); }
+
+  void fire(std::vector<entry> &slot, double now);
+  void find_next();
+  void arm(double deadline, double now);
+
+  static void timer_cb(evutil_socket_t fd, short what, void *ptr);
+};
+
+#endif // TIMERWHEEL_H
@@ -0,0 +1,48 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "config.h"
+
+#include "Trace.h"
+#include "log.h"
+
+Trace::Trace(const char *path) {
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) DIE("Cannot open trace %s: %s", path, strerror(errno));
+
+  struct stat st;
+  if (fstat(fd, &st)) DIE("fstat(%s): %s", path, strerror(errno));
+  map_len = st.st_size;
+  if (map_len < sizeof(trace_header_t)) DIE("%s is not a trace", path);
+
+  map = mmap(NULL, map_len, PROT_READ, MAP_SHARED, fd, 0);
+  if (map == MAP_FAILED) DIE("mmap(%s): %s", path, strerror(errno));
+  close(fd);
+
+  header = (const trace_header_t *) map;
+  if (memcmp(header->magic, TRACE_MAGIC, sizeof(header->magic)))
+    DIE("%s is not a trace", path);
+  if (header->version != TRACE_VERSION ||
+      header->record_size != sizeof(trace_record_t))
+    DIE("%s: unsupported trace version %u", path, header->version);
+  if (map_len != sizeof(trace_header_t) + header->count * sizeof(trace_record_t))
+    DIE("%s: truncated trace (%" PRIu64 " records expected)", path,
+        header->count);
+
+  records = (const trace_record_t *) (header + 1);
+  count = header->count;
+  duration = header->duration_us / 1000000.0;
+
+  // Connections read it front to back, each a stride apart.
+  madvise(map, map_len, MADV_SEQUENTIAL);
+}
+
+Trace::~Trace() {
+  munmap(map, map_len);
+}
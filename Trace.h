@@ -0,0 +1,66 @@
+// -*- c++-mode -*-
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define TRACE_MAGIC   "MCPTRACE"
+#define TRACE_VERSION 1
+
+enum trace_op_t { TRACE_GET = 0, TRACE_SET = 1 };
+
+/*
+ * Binary request trace replayed by --replay and written by
+ * mcperf-trace: a trace_header_t, then count trace_record_t sorted by
+ * time, in host byte order.  Key ids are dense (0 .. keys-1) and are
+ * turned into key names by KeyGenerator, zero-padded to the record's
+ * key size, so a trace replays without any string handling.
+ */
+struct trace_header_t {
+  char magic[8];         // TRACE_MAGIC, not NUL-terminated.
+  uint32_t version;      // TRACE_VERSION.
+  uint32_t record_size;  // sizeof(trace_record_t).
+  uint64_t count;        // Records.
+  uint64_t keys;         // Distinct key ids.
+  uint64_t duration_us;  // Time of the last record.
+  uint64_t reserved[3];
+};
+
+struct trace_record_t {
+  uint64_t time_us;      // Since the first record.
+  uint64_t key;          // Key id.
+  uint32_t value_size;   // Bytes set, or returned by a get.
+  uint32_t ttl;          // Seconds; 0 never expires.
+  uint16_t key_size;     // 0: --keysize picks it.
+  uint8_t op;            // trace_op_t.
+  uint8_t reserved[5];
+};
+
+static_assert(sizeof(trace_header_t) == 64, "trace_header_t layout");
+static_assert(sizeof(trace_record_t) == 32, "trace_record_t layout");
+
+/*
+ * Trace: a trace file mapped read-only.  All threads share one
+ * mapping, and the page cache keeps only the parts being replayed
+ * resident, so traces larger than memory replay fine.
+ */
+class Trace {
+public:
+  Trace(const char *path);  // DIEs if path is not a valid trace.
+  ~Trace();
+
+  const trace_header_t *header;
+  const trace_record_t *records;
+  uint64_t count;
+  double duration;  // Seconds.
+
+private:
+  void *map;
+  size_t map_len;
+
+  Trace(const Trace&) = delete;
+  Trace& operator=(const Trace&) = delete;
+};
+
+#endif // TRACE_H
@@ -0,0 +1,461 @@
+#include <errno.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <event2/buffer.h>
+#include <event2/event.h>
+
+#include "config.h"
+
+#include "Connection.h"
+#include "TimerWheel.h"
+#include "UringEngine.h"
+#include "log.h"
+#include "util.h"
+
+#if HAVE_IO_URING
+
+#include <linux/io_uring.h>
+
+// user_data tags, stored in the low bits of the (aligned) slot pointer.
+#define OP_RECV    1
+#define OP_SEND    2
+#define OP_PROVIDE 3
+#define OP_MASK 7
+
+#define URING_BGID 0
+
+// Longest we block in EVLOOP_ONCE, so the caller can check its exit
+// condition even when no timer is armed.
+#define URING_MAX_WAIT 0.1
+
+static int io_uring_setup(unsigned entries, struct io_uring_params *p) {
+  return (int) syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int io_uring_enter(int fd, unsigned to_submit, unsigned min_complete,
+                          unsigned flags, void *arg, size_t argsz) {
+  return (int) syscall(__NR_io_uring_enter, fd, to_submit, min_complete,
+                       flags, arg, argsz);
+}
+
+static int io_uring_register(int fd, unsigned opcode, void *arg,
+                             unsigned nr_args) {
+  return (int) syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+/**
+ * Whether the kernel has everything the engine uses: EXT_ARG waits
+ * (5.11), CQE_SKIP_SUCCESS (5.17), the RECV, SENDMSG and
+ * PROVIDE_BUFFERS opcodes, and multishot RECV (6.0).  Multishot RECV
+ * has no feature bit, so one is submitted on a socketpair; kernels
+ * without it fail it with -EINVAL.
+ */
+bool UringEngine::supported() {
+  struct io_uring_params p;
+  memset(&p, 0, sizeof(p));
+  int fd = io_uring_setup(4, &p);
+  if (fd < 0) return false;
+
+  const unsigned features = IORING_FEAT_EXT_ARG | IORING_FEAT_CQE_SKIP;
+  bool ok = (p.features & features) == features;
+
+  // Opcodes.
+  size_t probe_sz = sizeof(struct io_uring_probe) +
+    IORING_OP_LAST * sizeof(struct io_uring_probe_op);
+  struct io_uring_probe *probe = (struct io_uring_probe *) calloc(1, probe_sz);
+  if (ok && io_uring_register(fd, IORING_REGISTER_PROBE, probe,
+                              IORING_OP_LAST) == 0) {
+    for (int op : {IORING_OP_RECV, IORING_OP_SENDMSG,
+                   IORING_OP_PROVIDE_BUFFERS})
+      if (op > probe->last_op || !(probe->ops[op].flags & IO_URING_OP_SUPPORTED))
+        ok = false;
+  } else {
+    ok = false;
+  }
+  free(probe);
+
+  // Multishot RECV: provide one buffer, arm the receive, and send a
+  // byte so that a working receive completes too.
+  size_t sq_sz = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+  size_t cq_sz = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+  size_t sqes_sz = p.sq_entries * sizeof(struct io_uring_sqe);
+  char *sq = NULL, *cq = NULL;
+  struct io_uring_sqe *sqes = NULL;
+  int sv[2] = {-1, -1};
+  static char buf[64];  // Outlives the ring, whose teardown is deferred.
+
+  if (ok) {
+    if (p.features & IORING_FEAT_SINGLE_MMAP) sq_sz = cq_sz = MAX(sq_sz, cq_sz);
+    sq = (char *) mmap(0, sq_sz, PROT_READ | PROT_WRITE, MAP_SHARED,
+                       fd, IORING_OFF_SQ_RING);
+    cq = (p.features & IORING_FEAT_SINGLE_MMAP) ? sq :
+      (char *) mmap(0, cq_sz, PROT_READ | PROT_WRITE, MAP_SHARED,
+                    fd, IORING_OFF_CQ_RING);
+    sqes = (struct io_uring_sqe *) mmap(0, sqes_sz, PROT_READ | PROT_WRITE,
+                                        MAP_SHARED, fd, IORING_OFF_SQES);
+    if (sq == MAP_FAILED || cq == MAP_FAILED || sqes == MAP_FAILED ||
+        socketpair(AF_UNIX, SOCK_STREAM, 0, sv))
+      ok = false;
+  }
+
+  if (ok) {
+    unsigned *sq_tail = (unsigned *) (sq + p.sq_off.tail);
+    unsigned *sq_mask = (unsigned *) (sq + p.sq_off.ring_mask);
+    unsigned *sq_array = (unsigned *) (sq + p.sq_off.array);
+    unsigned tail = *sq_tail;
+
+    memset(sqes, 0, 2 * sizeof(struct io_uring_sqe));
+    sqes[0].opcode = IORING_OP_PROVIDE_BUFFERS;
+    sqes[0].fd = 1;
+    sqes[0].addr = (unsigned long) buf;
+    sqes[0].len = sizeof(buf);
+    sqes[0].buf_group = URING_BGID;
+    sqes[0].flags = IOSQE_IO_LINK;
+    sqes[0].user_data = OP_PROVIDE;
+
+    sqes[1].opcode = IORING_OP_RECV;
+    sqes[1].fd = sv[0];
+    sqes[1].ioprio = IORING_RECV_MULTISHOT;
+    sqes[1].flags = IOSQE_BUFFER_SELECT;
+    sqes[1].buf_group = URING_BGID;
+    sqes[1].user_data = OP_RECV;
+
+    sq_array[tail & *sq_mask] = 0;
+    sq_array[(tail + 1) & *sq_mask] = 1;
+    __atomic_store_n(sq_tail, tail + 2, __ATOMIC_RELEASE);
+
+    if (io_uring_enter(fd, 2, 0, 0, NULL, 0) != 2 || write(sv[1], "x", 1) != 1)
+      ok = false;
+  }
+
+  if (ok) {
+    unsigned *cq_head = (unsigned *) (cq + p.cq_off.head);
+    unsigned *cq_tail = (unsigned *) (cq + p.cq_off.tail);
+    unsigned *cq_mask = (unsigned *) (cq + p.cq_off.ring_mask);
+    struct io_uring_cqe *cqes = (struct io_uring_cqe *) (cq + p.cq_off.cqes);
+    bool recv_done = false;
+
+    while (ok && !recv_done) {
+      if (io_uring_enter(fd, 0, 1, IORING_ENTER_GETEVENTS, NULL, 0) < 0 &&
+          errno != EINTR) {
+        ok = false;
+        break;
+      }
+      unsigned head = *cq_head;
+      for (; head != __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE); head++) {
+        struct io_uring_cqe *cqe = &cqes[head & *cq_mask];
+        if (cqe->res < 0) ok = false;
+        if (cqe->user_data == OP_RECV) recv_done = true;
+      }
+      __atomic_store_n(cq_head, head, __ATOMIC_RELEASE);
+    }
+  }
+
+  if (sv[0] >= 0) {
+    close(sv[0]);
+    close(sv[1]);
+  }
+  if (sqes && sqes != MAP_FAILED) munmap(sqes, sqes_sz);
+  if (cq && cq != MAP_FAILED && cq != sq) munmap(cq, cq_sz);
+  if (sq && sq != MAP_FAILED) munmap(sq, sq_sz);
+  close(fd);  // Cancels the armed receive.
+  return ok;
+}
+
+UringEngine::UringEngine(TimerWheel *_timers, int entries) :
+  sq_local_tail(0), timers(_timers) {
+  struct io_uring_params p;
+  memset(&p, 0, sizeof(p));
+  p.flags = IORING_SETUP_CQSIZE;
+  p.cq_entries = entries * 4;
+
+  if ((ring_fd = io_uring_setup(entries, &p)) < 0)
+    DIE("io_uring_setup(): %s", strerror(errno));
+  if (!(p.features & IORING_FEAT_EXT_ARG))
+    DIE("io_uring: kernel lacks IORING_FEAT_EXT_ARG");
+
+  sq_ring_sz = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+  cq_ring_sz = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+  if (p.features & IORING_FEAT_SINGLE_MMAP)
+    sq_ring_sz = cq_ring_sz = MAX(sq_ring_sz, cq_ring_sz);
+
+  sq_ring_ptr = mmap(0, sq_ring_sz, PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQ_RING);
+  if (sq_ring_ptr == MAP_FAILED) DIE("mmap(sq_ring): %s", strerror(errno));
+
+  if (p.features & IORING_FEAT_SINGLE_MMAP) {
+    cq_ring_ptr = sq_ring_ptr;
+  } else {
+    cq_ring_ptr = mmap(0, cq_ring_sz, PROT_READ | PROT_WRITE,
+                       MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_CQ_RING);
+    if (cq_ring_ptr == MAP_FAILED) DIE("mmap(cq_ring): %s", strerror(errno));
+  }
+
+  sqes_sz = p.sq_entries * sizeof(struct io_uring_sqe);
+  sqes = (struct io_uring_sqe *) mmap(0, sqes_sz, PROT_READ | PROT_WRITE,
+                                      MAP_SHARED | MAP_POPULATE, ring_fd,
+                                      IORING_OFF_SQES);
+  if (sqes == MAP_FAILED) DIE("mmap(sqes): %s", strerror(errno));
+
+  char *sq = (char *) sq_ring_ptr;
+  sq_head = (unsigned *) (sq + p.sq_off.head);
+  sq_tail = (unsigned *) (sq + p.sq_off.tail);
+  sq_mask = (unsigned *) (sq + p.sq_off.ring_mask);
+  sq_array = (unsigned *) (sq + p.sq_off.array);
+  sq_entries = p.sq_entries;
+  sq_local_tail = *sq_tail;
+
+  char *cq = (char *) cq_ring_ptr;
+  cq_head = (unsigned *) (cq + p.cq_off.head);
+  cq_tail = (unsigned *) (cq + p.cq_off.tail);
+  cq_mask = (unsigned *) (cq + p.cq_off.ring_mask);
+  cqes = (struct io_uring_cqe *) (cq + p.cq_off.cqes);
+
+  // Hand the kernel the pool of buffers multishot receive draws from.
+  // PROVIDE_BUFFERS is used rather than a registered buffer ring, which
+  // some kernels accept but never select from.
+  buf_base = new char[(size_t) URING_BUFS * URING_BUF_SIZE];
+
+  struct io_uring_sqe *sqe = get_sqe();
+  sqe->opcode = IORING_OP_PROVIDE_BUFFERS;
+  sqe->fd = URING_BUFS;
+  sqe->addr = (unsigned long) buf_base;
+  sqe->len = URING_BUF_SIZE;
+  sqe->off = 0;
+  sqe->buf_group = URING_BGID;
+  sqe->user_data = OP_PROVIDE;
+}
+
+UringEngine::~UringEngine() {
+  for (auto s: slots) {
+    evbuffer_free(s->sending);
+    delete s;
+  }
+
+  munmap(sqes, sqes_sz);
+  if (cq_ring_ptr != sq_ring_ptr) munmap(cq_ring_ptr, cq_ring_sz);
+  munmap(sq_ring_ptr, sq_ring_sz);
+  close(ring_fd);
+
+  delete[] buf_base;
+}
+
+void UringEngine::recycle_buf(unsigned short bid) {
+  struct io_uring_sqe *sqe = get_sqe();
+  sqe->opcode = IORING_OP_PROVIDE_BUFFERS;
+  sqe->fd = 1;
+  sqe->addr = (unsigned long) (buf_base + (size_t) bid * URING_BUF_SIZE);
+  sqe->len = URING_BUF_SIZE;
+  sqe->off = bid;
+  sqe->buf_group = URING_BGID;
+  sqe->flags = IOSQE_CQE_SKIP_SUCCESS;
+  sqe->user_data = OP_PROVIDE;
+}
+
+struct io_uring_sqe *UringEngine::get_sqe() {
+  unsigned head = __atomic_load_n(sq_head, __ATOMIC_ACQUIRE);
+  if (sq_local_tail - head >= sq_entries) {
+    // Ring is full; hand what we have to the kernel.
+    enter(0, 0.0);
+    head = __atomic_load_n(sq_head, __ATOMIC_ACQUIRE);
+    if (sq_local_tail - head >= sq_entries) DIE("io_uring SQ overflow");
+  }
+
+  unsigned idx = sq_local_tail & *sq_mask;
+  struct io_uring_sqe *sqe = &sqes[idx];
+  memset(sqe, 0, sizeof(*sqe));
+  sq_array[idx] = idx;
+  sq_local_tail++;
+  return sqe;
+}
+
+/**
+ * Submit all queued SQEs and optionally wait for completions.
+ *
+ * @param min_complete completions to wait for (0 = don't block)
+ * @param timeout upper bound on the wait, in seconds
+ */
+int UringEngine::enter(unsigned min_complete, double timeout) {
+  unsigned to_submit = sq_local_tail - __atomic_load_n(sq_head, __ATOMIC_ACQUIRE);
+  __atomic_store_n(sq_tail, sq_local_tail, __ATOMIC_RELEASE);
+
+  if (to_submit == 0 && min_complete == 0) return 0;
+
+  struct __kernel_timespec ts;
+  struct io_uring_getevents_arg arg;
+  memset(&arg, 0, sizeof(arg));
+  unsigned flags = IORING_ENTER_EXT_ARG;
+
+  if (min_complete) {
+    if (timeout < 0.0) timeout = 0.0;
+    ts.tv_sec = (long long) timeout;
+    ts.tv_nsec = (long long) ((timeout - ts.tv_sec) * 1000000000);
+    arg.ts = (unsigned long) &ts;
+    flags |= IORING_ENTER_GETEVENTS;
+  }
+  arg.sigmask_sz = _NSIG / 8;
+
+  int ret = io_uring_enter(ring_fd, to_submit, min_complete, flags,
+                           &arg, sizeof(arg));
+  if (ret < 0 && errno != ETIME && errno != EINTR && errno != EBUSY &&
+      errno != EAGAIN)
+    DIE("io_uring_enter(): %s", strerror(errno));
+  return ret;
+}
+
+void UringEngine::arm_recv(slot *s) {
+  struct io_uring_sqe *sqe = get_sqe();
+  sqe->opcode = IORING_OP_RECV;
+  sqe->fd = s->conn->fd;
+  sqe->ioprio = IORING_RECV_MULTISHOT;
+  sqe->flags = IOSQE_BUFFER_SELECT;
+  sqe->buf_group = URING_BGID;
+  sqe->user_data = (unsigned long) s | OP_RECV;
+}
+
+void UringEngine::output_cb(struct evbuffer *buf,
+                            const struct evbuffer_cb_info *info, void *arg) {
+  slot *s = (slot *) arg;
+  if (info->n_added == 0 || s->dirty) return;
+
+  s->dirty = true;
+  s->conn->uring->dirty.push_back(s);
+}
+
+void UringEngine::attach(Connection *conn) {
+  slot *s = new slot;
+  s->conn = conn;
+  s->sending = evbuffer_new();
+  s->send_inflight = false;
+  s->dirty = false;
+  slots.push_back(s);
+
+  conn->uring = this;
+  evbuffer_add_cb(conn->output, output_cb, s);
+
+  // SASL may already have queued a request during connect.
+  if (evbuffer_get_length(conn->output) > 0) {
+    s->dirty = true;
+    dirty.push_back(s);
+  }
+
+  arm_recv(s);
+}
+
+/**
+ * Hand every Connection's pending output to the kernel.  Output is
+ * moved (not copied) into a per-slot staging evbuffer so the iovecs
+ * stay valid while new requests are appended behind them.
+ */
+void UringEngine::flush() {
+  for (auto s: dirty) {
+    s->dirty = false;
+    if (s->send_inflight) continue;
+
+    evbuffer_add_buffer(s->sending, s->conn->output);
+    int n = evbuffer_peek(s->sending, -1, NULL, s->iov, URING_IOV_MAX);
+    if (n <= 0) continue;
+    if (n > URING_IOV_MAX) n = URING_IOV_MAX;
+
+    memset(&s->msg, 0, sizeof(s->msg));
+    s->msg.msg_iov = s->iov;
+    s->msg.msg_iovlen = n;
+
+    struct io_uring_sqe *sqe = get_sqe();
+    sqe->opcode = IORING_OP_SENDMSG;
+    sqe->fd = s->conn->fd;
+    sqe->addr = (unsigned long) &s->msg;
+    sqe->len = 1;
+    sqe->msg_flags = MSG_NOSIGNAL;
+    sqe->user_data = (unsigned long) s | OP_SEND;
+    s->send_inflight = true;
+  }
+  dirty.clear();
+}
+
+void UringEngine::reap() {
+  unsigned head = *cq_head;
+  unsigned tail = __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE);
+
+  while (head != tail) {
+    struct io_uring_cqe *cqe = &cqes[head & *cq_mask];
+    slot *s = (slot *) (cqe->user_data & ~(unsigned long long) OP_MASK);
+    int op = cqe->user_data & OP_MASK;
+    int res = cqe->res;
+    unsigned flags = cqe->flags;
+    head++;
+    // Release the CQE before running callbacks, which may submit.
+    __atomic_store_n(cq_head, head, __ATOMIC_RELEASE);
+
+    if (op == OP_PROVIDE) {
+      if (res < 0) DIE("IORING_OP_PROVIDE_BUFFERS: %s", strerror(-res));
+    } else if (op == OP_RECV) {
+      if (res == -ENOBUFS) {
+        arm_recv(s);
+      } else if (res == 0) {
+        DIE("Unexpected EOF from server.");
+      } else if (res < 0) {
+        DIE("recv from %s:%s : %s", s->conn->hostname.c_str(),
+            s->conn->port.c_str(), strerror(-res));
+      } else {
+        unsigned short bid = flags >> IORING_CQE_BUFFER_SHIFT;
+        evbuffer_add(s->conn->input, buf_base + (size_t) bid * URING_BUF_SIZE,
+                     res);
+        recycle_buf(bid);
+        if (!(flags & IORING_CQE_F_MORE)) arm_recv(s);
+        s->conn->read_callback();
+      }
+    } else if (op == OP_SEND) {
+      if (res < 0)
+        DIE("send to %s:%s : %s", s->conn->hostname.c_str(),
+            s->conn->port.c_str(), strerror(-res));
+      evbuffer_drain(s->sending, res);
+      s->send_inflight = false;
+      if ((evbuffer_get_length(s->sending) > 0 ||
+           evbuffer_get_length(s->conn->output) > 0) && !s->dirty) {
+        s->dirty = true;
+        dirty.push_back(s);
+      }
+    }
+
+    tail = __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE);
+  }
+}
+
+void UringEngine::loop(int flags) {
+  flush();
+
+  if (flags & EVLOOP_NONBLOCK) {
+    enter(0, 0.0);
+  } else {
+    double timeout = URING_MAX_WAIT;
+    double next = timers->next_deadline();
+    if (next > 0.0) {
+      double until = next - get_time();
+      if (until < timers->spin) until = 0.0;
+      if (until < timeout) timeout = until;
+    }
+    enter(1, timeout);
+  }
+
+  reap();
+  timers->run(get_time());
+  flush();
+}
+
+#else
+
+bool UringEngine::supported() { return false; }
+UringEngine::UringEngine(TimerWheel *_timers, int entries) {
+  DIE("io_uring support not compiled in");
+}
+UringEngine::~UringEngine() {}
+void UringEngine::attach(Connection *conn) {}
+void UringEngine::loop(int flags) {}
+
+#endif
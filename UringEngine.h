@@ -0,0 +1,92 @@
+// -*- c++-mode -*-
+#ifndef URINGENGINE_H
+#define URINGENGINE_H
+
+#include "config.h"
+
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+#include <vector>
+
+#include <event2/buffer.h>
+
+class Connection;
+class TimerWheel;
+
+#define URING_ENTRIES  4096
+#define URING_BUFS     4096  // Provided receive buffers.
+#define URING_BUF_SIZE 4096
+#define URING_IOV_MAX  32
+
+/*
+ * UringEngine: per-thread io_uring replacement for the libevent
+ * event_base.
+ *
+ * It drives the same Connection read/write state machines: received
+ * bytes are appended to Connection::input before read_callback() runs,
+ * and whatever the state machines append to Connection::output is
+ * flushed with one SENDMSG per connection per loop iteration.  Receives
+ * use a single multishot RECV per connection that draws from a
+ * shared pool of provided buffers, so a steady-state request costs
+ * no syscalls beyond the batched io_uring_enter().
+ *
+ * loop() follows event_base_loop() semantics for EVLOOP_ONCE and
+ * EVLOOP_NONBLOCK so do_mcperf() can drive either engine.  Send timers
+ * live in the thread's TimerWheel, which bounds how long loop() waits.
+ */
+class UringEngine {
+public:
+  UringEngine(TimerWheel *_timers, int entries = URING_ENTRIES);
+  ~UringEngine();
+
+  void attach(Connection *conn);
+  void loop(int flags);
+
+  static bool supported();
+
+private:
+  struct slot {
+    Connection *conn;
+    struct evbuffer *sending;  // Bytes owned by the in-flight SENDMSG.
+    bool send_inflight;
+    bool dirty;
+    struct msghdr msg;
+    struct iovec iov[URING_IOV_MAX];
+  };
+
+  int ring_fd;
+
+  // Submission queue.
+  unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+  unsigned sq_entries;
+  unsigned sq_local_tail;
+  struct io_uring_sqe *sqes;
+
+  // Completion queue.
+  unsigned *cq_head, *cq_tail, *cq_mask;
+  struct io_uring_cqe *cqes;
+
+  void *sq_ring_ptr, *cq_ring_ptr;
+  size_t sq_ring_sz, cq_ring_sz, sqes_sz;
+
+  // Provided buffers for multishot receive.
+  char *buf_base;
+
+  std::vector<slot*> slots;
+  std::vector<slot*> dirty;
+
+  TimerWheel *timers;
+
+  struct io_uring_sqe *get_sqe();
+  int enter(unsigned min_complete, double timeout);
+  void arm_recv(slot *s);
+  void flush();
+  void reap();
+  void recycle_buf(unsigned short bid);
+
+  static void output_cb(struct evbuffer *buf,
+                        const struct evbuffer_cb_info *info, void *arg);
+};
+
+#endif // URINGENGINE_H
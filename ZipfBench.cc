@@ -0,0 +1,141 @@
+// Statistical check and microbenchmark for the Zipf key-order
+// generators (zipf:<s> and latest:<s>,<step>).
+//
+// Build with "make zipfbench" and run ./zipfbench [n_samples];
+// ./zipfbench --check (run by "make check") skips the timing.
+// Sampled rank frequencies are compared with the exact Zipf pmf by a
+// chi-square test (the head ranks individually, the tail in
+// log-spaced bins), and the moving latest key's share with the rank-1
+// probability; each must be within MAX_Z standard deviations.  Then
+// sampling time is measured for key spaces up to 1e9, which should
+// not grow with the key count.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <math.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "log.h"
+#include "util.h"
+#include "Generator.h"
+
+#define HEAD_RANKS 1000
+#define MAX_Z      4.0   // Standard deviations a check may be off by.
+
+// Rank bins: ranks 1..HEAD_RANKS alone, then bins growing by 10%.
+static std::vector<double> make_bins(double n) {
+  std::vector<double> upper;  // Inclusive upper rank of each bin.
+  for (double k = 1; k <= n && k <= HEAD_RANKS; k++) upper.push_back(k);
+  for (double k = HEAD_RANKS; k < n; ) {
+    k = std::min(n, floor(k * 1.1) + 1);
+    upper.push_back(k);
+  }
+  return upper;
+}
+
+static size_t bin_of(const std::vector<double> &upper, double rank) {
+  return std::lower_bound(upper.begin(), upper.end(), rank) - upper.begin();
+}
+
+// Chi-square of observed rank counts against Zipf(s, n); returns the
+// statistic's deviation from its mean in standard deviations.
+static double chi2_z(double s, double n, const std::vector<double> &upper,
+                     const std::vector<long> &observed, long samples) {
+  std::vector<double> expected(upper.size(), 0.0);
+  double norm = 0.0;
+  for (double k = 1; k <= n; k++) {
+    double p = pow(k, -s);
+    expected[bin_of(upper, k)] += p;
+    norm += p;
+  }
+
+  double chi2 = 0.0;
+  int dof = -1;
+  for (size_t b = 0; b < upper.size(); b++) {
+    double e = expected[b] / norm * samples;
+    if (e < 5.0) continue;  // Too few to test.
+    chi2 += (observed[b] - e) * (observed[b] - e) / e;
+    dof++;
+  }
+
+  return (chi2 - dof) / sqrt(2.0 * dof);
+}
+
+static bool check(const char *name, Generator *g, double s, double n,
+                  long samples, bool latest) {
+  Rng rng(0xdeadbeef);
+  g->set_rng(&rng);
+  g->set_max(n);
+
+  std::vector<double> upper = make_bins(n);
+  std::vector<long> observed(upper.size(), 0);
+  for (long i = 0; i < samples; i++) {
+    double idx = g->generate();
+    // latest without steps returns index (n - rank + 1) % n.
+    double rank = latest ? fmod(n - idx, n) + 1 : idx + 1;
+    observed[bin_of(upper, rank)]++;
+  }
+
+  double z = chi2_z(s, n, upper, observed, samples);
+  bool ok = fabs(z) < MAX_Z;
+  printf("%-8s s=%-5.2f n=%-8.0f chi2 z=%6.2f  p(1)=%.4f  %s\n", name, s, n,
+         z, (double) observed[0] / samples, ok ? "ok" : "FAIL");
+  return ok;
+}
+
+int main(int argc, char **argv) {
+  bool check_only = argc > 1 && !strcmp(argv[1], "--check");
+  if (check_only) argc--, argv++;
+  long samples = argc > 1 ? atol(argv[1]) : 10000000;
+  bool ok = true;
+
+  double exponents[] = {0.0, 0.5, 0.99, 1.0, 1.2, 2.0};
+  for (size_t i = 0; i < sizeof(exponents) / sizeof(exponents[0]); i++) {
+    Zipf z(exponents[i]);
+    ok &= check("zipf", &z, exponents[i], 1e6, samples, false);
+  }
+
+  // With a step longer than the run, latest is Zipf counted down from
+  // its latest key.
+  ZipfLatest l(0.99, 1e18);
+  ok &= check("latest", &l, 0.99, 1e5, samples, true);
+
+  // With a step, the hot key moves one key per step draws, and is
+  // still drawn with the probability of rank 1.
+  ZipfLatest m(0.99, 20);
+  Rng rng(0xdeadbeef);
+  m.set_rng(&rng);
+  m.set_max(1e6);
+  long moved = 0;
+  for (long i = 0; i < samples; i++)
+    if (m.generate() == floor((i + 1.0) / 20)) moved++;
+  double norm = 0.0;
+  for (double k = 1; k <= 1e6; k++) norm += pow(k, -0.99);
+  double p = 1.0 / norm;
+  double z = (moved - p * samples) / sqrt(samples * p * (1.0 - p));
+  bool moved_ok = fabs(z) < MAX_Z;
+  printf("latest   step=20: latest key drawn %.4f of the time, "
+         "expected %.4f (z=%.2f)  %s\n", (double) moved / samples, p, z,
+         moved_ok ? "ok" : "FAIL");
+  ok &= moved_ok;
+
+  if (check_only && !ok) DIE("Zipf samples do not follow the Zipf pmf");
+  if (check_only) return 0;
+
+  for (double n = 1e3; n <= 1e9; n *= 100) {
+    Zipf z(0.99, n);
+    double sink = 0.0;
+    double start = get_time_accurate();
+    for (long i = 0; i < samples; i++) sink += z.generate();
+    double t = get_time_accurate() - start;
+    printf("zipf     n=%-10.0f %6.1f ns/sample  (mean index %.0f)\n", n,
+           t / samples * 1e9, sink / samples);
+  }
+
+  if (!ok) DIE("Zipf samples do not follow the Zipf pmf");
+  return 0;
+}
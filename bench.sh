@@ -0,0 +1,45 @@
+#!/bin/bash
+
+# Client-overhead benchmark: run mcperf flat out against mcperf-echo and
+# report max QPS and client ns/request per thread.  Invoked by "make bench".
+#
+# Environment: BENCH_PORT (default 11299), BENCH_TIME (seconds per run,
+# default 5), BENCH_THREADS (mcperf threads, default "1 2"),
+# BENCH_ENGINES (default "libevent uring"), BENCH_SERVICE (echo service
+# time in us, default 0), BENCH_ARGS (extra mcperf arguments).
+
+set -e
+
+PORT=${BENCH_PORT:-11299}
+TIME=${BENCH_TIME:-5}
+THREADS=${BENCH_THREADS:-"1 2"}
+ENGINES=${BENCH_ENGINES:-"libevent uring"}
+SERVICE=${BENCH_SERVICE:-0}
+ECHO_THREADS=${BENCH_ECHO_THREADS:-4}
+
+./mcperf-echo -p $PORT -T $ECHO_THREADS -S $SERVICE &
+ECHO_PID=$!
+trap "kill $ECHO_PID 2>/dev/null" EXIT
+sleep 0.5
+
+printf "%-9s %-6s %3s %5s %12s %12s %10s\n" \
+       engine proto T depth QPS QPS/thread ns/req
+for engine in $ENGINES; do
+  for proto in ascii binary; do
+    for t in $THREADS; do
+      for depth in 1 16; do
+        flags="--engine=$engine -T $t -c 4 -d $depth -t $TIME"
+        [ $proto = binary ] && flags="$flags --binary"
+        out=$(./mcperf -s 127.0.0.1:$PORT $flags $BENCH_ARGS 2>&1) || {
+          printf "%-9s %-6s %3s %5s %12s\n" $engine $proto $t $depth failed
+          continue
+        }
+        qps=$(echo "$out" | awk '/^Total QPS/ { print $4 }')
+        cpu=$(echo "$out" | awk '/^Client CPU/ { print $4 }')
+        awk -v e=$engine -v p=$proto -v t=$t -v d=$depth -v q=$qps -v c=$cpu \
+            'BEGIN { printf "%-9s %-6s %3d %5d %12.1f %12.1f %10.0f\n", \
+                     e, p, t, d, q, q / t, c * 1000 }'
+      done
+    done
+  done
+done
@@ -1,11 +1,14 @@
 #ifndef BINARY_PROTOCOL_H
 #define	BINARY_PROTOCOL_H
 
-#define CMD_GET  0x00
-#define CMD_SET  0x01
-#define CMD_MGET 0x09
-#define CMD_NOOP 0x0a
-#define CMD_SASL 0x21
+#define CMD_GET   0x00
+#define CMD_SET   0x01
+#define CMD_GETQ  0x09
+#define CMD_NOOP  0x0a
+#define CMD_GETK  0x0c
+#define CMD_GETKQ 0x0d
+#define CMD_SETQ  0x11
+#define CMD_SASL  0x21
 
 #define RESP_OK 0x00
 #define RESP_SASL_ERR 0x20
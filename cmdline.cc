@@ -41,6 +41,7 @@ const char *gengetopt_args_info_help[] = {
   "\nBasic options:",
   "  -s, --server=STRING           Memcached server hostname[:port[-end_port]].\n                                  Repeat to specify multiple servers. ",
   "      --binary                  Use binary memcached protocol instead of ASCII.",
+  "      --protocol=STRING         Wire protocol: ascii, binary or meta (memcached\n                                  meta commands mg/ms/mn).  --binary is short\n                                  for --protocol=binary.  (default=`ascii')",
   "  -q, --qps=INT                 Target aggregate QPS. 0 = peak QPS.\n                                  (default=`0')",
   "  -t, --time=INT                Maximum time to run (seconds).  (default=`5')",
   "      --profile=INT             Select one of several predefined profiles.",
@@ -55,8 +56,11 @@ const char *gengetopt_args_info_help[] = {
   "      --qps_min=INT             Min dynamic QPS.  (default=`1000')",
   "      --qps_target=INT          QPS dynamic trace. Full trace needs to be\n                                  provided.",
   "      --qps_seed=INT            QPS seed.  (default=`0')",
+  "      --seed=INT                Seed for key, value size and inter-arrival\n                                  draws.  Runs with the same seed (and threads,\n                                  connections and agents) issue the same\n                                  requests.  By default a seed is picked from\n                                  the clock and printed with -v.",
   "  -U, --username=STRING         Username to use for SASL authentication.",
   "  -P, --password=STRING         Password to use for SASL authentication.",
+  "      --meta_replies            With --protocol=meta, ask for a reply to every\n                                  request instead of sending quiet (q) requests\n                                  terminated by mn.",
+  "      --meta_base64             With --protocol=meta, send keys base64-encoded\n                                  (b flag).",
   "  -T, --threads=INT             Number of threads to spawn.  (default=`1')",
   "      --affinity                Set CPU affinity for threads, round-robin",
   "  -c, --connections=INT         Connections to establish per server.\n                                  (default=`1')",
@@ -65,14 +69,28 @@ const char *gengetopt_args_info_help[] = {
   "  -i, --iadist=STRING           Inter-arrival distribution (distribution).\n                                  Note: The distribution will automatically be\n                                  adjusted to match the QPS given by --qps.\n                                  (default=`exponential')",
   "  -S, --skip                    Skip transmissions if previous requests are\n                                  late.  This harms the long-term QPS average,\n                                  but reduces spikes in QPS after long latency\n                                  requests.",
   "      --moderate                Enforce a minimum delay of ~1/lambda between\n                                  requests.",
+  "      --cdf_tables              Draw exponential, pareto and GEV inter-arrival\n                                  times and value sizes from shared,\n                                  interpolated inverse-CDF tables instead of\n                                  computing log()/pow() per draw.",
   "      --noload                  Skip database loading.",
   "      --loadonly                Load database and then exit.",
+  "      --replay=path             Replay a binary request trace (made with\n                                  mcperf-trace) instead of generating requests.\n                                  Skips database loading.",
+  "      --replay_speed=DOUBLE     Replay speed relative to the trace: 2 sends\n                                  twice as fast.  (default=`1.0')",
   "  -B, --blocking                Use blocking epoll().  May increase latency.",
+  "      --timer_spin=INT          With --blocking, poll instead of sleeping when\n                                  the next scheduled send is less than this\n                                  many microseconds away.  (default=`0')",
   "      --no_nodelay              Don't use TCP_NODELAY.",
+  "      --engine=STRING           Event engine driving connections: libevent or\n                                  uring (io_uring, batched submissions with\n                                  multishot receive).  (default=`libevent')",
+  "      --clock=STRING            Clock used to timestamp requests: tsc,\n                                  monotonic or gettimeofday.  tsc falls back to\n                                  monotonic if the TSC is not invariant.\n                                  (default=`tsc')",
   "  -w, --warmup=INT              Warmup time before starting measurement.",
   "  -W, --wait=INT                Time to wait after startup to start\n                                  measurement.",
   "      --save=STRING             Record latency samples to given file.",
+  "      --hdr_digits=INT          Significant digits kept by the latency\n                                  histogram.  (default=`2')",
+  "      --hdr_max=DOUBLE          Highest latency (seconds) tracked by the\n                                  latency histogram; slower samples are\n                                  clamped.  (default=`10')",
+  "      --live=INT                Print QPS, latency, miss rate and RX/TX rate\n                                  every N milliseconds while running.  0\n                                  disables live output.  (default=`0')",
+  "      --live_format=STRING      Format of live output: csv or json.\n                                  (default=`csv')",
   "      --search=N:X              Search for the QPS where N-order statistic <\n                                  Xus.  (i.e. --search 95:1000 means find the\n                                  QPS where 95% of requests are faster than\n                                  1000us).",
+  "      --search_window=INT       With --search, probe every QPS in one run,\n                                  retargeting all threads and agents live and\n                                  measuring windows of this many ms until the\n                                  latency is clearly above or below X.  0\n                                  restarts a full run per probe.  (default=`0')",
+  "      --slo=N:X                 Keep adjusting the QPS for the whole run to the\n                                  highest where N-order statistic < Xus (as in\n                                  --search), printing one row per --slo_window.",
+  "      --slo_window=INT          Window (ms) over which --slo measures latency\n                                  before each adjustment.  (default=`1000')",
+  "      --slo_control=STRING      How --slo adjusts the QPS after each window:\n                                  aimd (add 2% of the starting QPS if the\n                                  target was met, else cut it by 20%) or pid.\n                                  (default=`aimd')",
   "      --scan=min:max:step       Scan latency across QPS rates from min to max.",
   "  -e, --trace                   To enable server tracing based on client\n                                  activity, will issue special\n                                  start_trace/stop_trace commands. Requires\n                                  memcached to support these commands.",
   "  -G, --getq_size=INT           Size of queue for multiget requests.\n                                  (default=`100')",
@@ -91,7 +109,7 @@ const char *gengetopt_args_info_help[] = {
   "  -D, --measure_depth=INT       Set master client connection depth.",
   "  -m, --poll_freq=INT           Set frequency in seconds for agent protocol\n                                  recv polling.  (default=`1')",
   "  -M, --poll_max=INT            Set timeout for agent protocol recv polling. An\n                                  agent not responding within time limit will\n                                  be dropped.  (default=`120')",
-  "\nThe --measure_* options aid in taking latency measurements of the\nmemcached server without incurring significant client-side queuing\ndelay.  --measure_connections allows the master to override the\n--connections option.  --measure_depth allows the master to operate as\nan \"open-loop\" client while other agents continue as a regular\nclosed-loop clients.  --measure_qps lets you modulate the QPS the\nmaster queries at independent of other clients.  This theoretically\nnormalizes the baseline queuing delay you expect to see across a wide\nrange of --qps values.\n\nPredefined profiles to approximate some use cases:\n1. memcached for web serving benchmark : p95, 20ms, FB key/value/IA, >4000\nconnections to the device under test.\n2. memcached for applications backends : p99, 10ms, 32B key , 1000B value,\nuniform IA,  >1000 connections\n3. memcached for low latency (e.g. stock trading): p99.9, 32B key, 200B value,\nuniform IA, QPS rate set to 100000	\n4. P99.9, 1 msec. Key size = 32 bytes; value size has uniform distribution from\n100 bytes to 1k; \n\nSome options take a 'distribution' as an argument.\nDistributions are specified by <distribution>[:<param1>[,...]].\nParameters are not required.  The following distributions are supported:\n\n   [fixed:]<value>              Always generates <value>.\n   uniform:<max>                Uniform distribution between 0 and <max>.\n   normal:<mean>,<sd>           Normal distribution.\n   exponential:<lambda>         Exponential distribution.\n   pareto:<loc>,<scale>,<shape> Generalized Pareto distribution.\n   gev:<loc>,<scale>,<shape>    Generalized Extreme Value distribution.\n\n   To recreate the Facebook \"ETC\" request stream from [1], the\n   following hard-coded distributions are also provided:\n\n   fb_value   = a hard-coded discrete and GPareto PDF of value sizes\n   fb_key     = \"gev:30.7984,8.20449,0.078688\", key-size distribution\n   fb_ia      = \"pareto:0.0,16.0292,0.154971\", inter-arrival time dist.\n\n[1] Berk Atikoglu et al., Workload Analysis of a Large-Scale Key-Value Store,\n    SIGMETRICS 2012\n",
+  "\nThe --measure_* options aid in taking latency measurements of the\nmemcached server without incurring significant client-side queuing\ndelay.  --measure_connections allows the master to override the\n--connections option.  --measure_depth allows the master to operate as\nan \"open-loop\" client while other agents continue as a regular\nclosed-loop clients.  --measure_qps lets you modulate the QPS the\nmaster queries at independent of other clients.  This theoretically\nnormalizes the baseline queuing delay you expect to see across a wide\nrange of --qps values.\n\nPredefined profiles to approximate some use cases:\n1. memcached for web serving benchmark : p95, 20ms, FB key/value/IA, >4000\nconnections to the device under test.\n2. memcached for applications backends : p99, 10ms, 32B key , 1000B value,\nuniform IA,  >1000 connections\n3. memcached for low latency (e.g. stock trading): p99.9, 32B key, 200B value,\nuniform IA, QPS rate set to 100000	\n4. P99.9, 1 msec. Key size = 32 bytes; value size has uniform distribution from\n100 bytes to 1k; \n\nSome options take a 'distribution' as an argument.\nDistributions are specified by <distribution>[:<param1>[,...]].\nParameters are not required.  The following distributions are supported:\n\n   [fixed:]<value>              Always generates <value>.\n   uniform:<max>                Uniform distribution between 0 and <max>.\n   normal:<mean>,<sd>           Normal distribution.\n   exponential:<lambda>         Exponential distribution.\n   pareto:<loc>,<scale>,<shape> Generalized Pareto distribution.\n   gev:<loc>,<scale>,<shape>    Generalized Extreme Value distribution.\n   file:<path>                  Empirical distribution: \"<value> <weight>\"\n                                lines, e.g. a measured value-size histogram.\n   zipf:<s>                     Zipf key popularity over --records keys\n                                (--keyorder only; default s=0.99).\n   latest:<s>,<step>            Zipf over recency: the hot key moves on\n                                one key every <step> draws (default 20).\n\n   To recreate the Facebook \"ETC\" request stream from [1], the\n   following hard-coded distributions are also provided:\n\n   fb_value   = a hard-coded discrete and GPareto PDF of value sizes\n   fb_key     = \"gev:30.7984,8.20449,0.078688\", key-size distribution\n   fb_ia      = \"pareto:0.0,16.0292,0.154971\", inter-arrival time dist.\n\n[1] Berk Atikoglu et al., Workload Analysis of a Large-Scale Key-Value Store,\n    SIGMETRICS 2012\n",
     0
 };
 
@@ -150,6 +168,7 @@ void clear_given (struct gengetopt_args_info *args_info)
   args_info->quiet_given = 0 ;
   args_info->server_given = 0 ;
   args_info->binary_given = 0 ;
+  args_info->protocol_given = 0 ;
   args_info->qps_given = 0 ;
   args_info->time_given = 0 ;
   args_info->profile_given = 0 ;
@@ -163,8 +182,11 @@ void clear_given (struct gengetopt_args_info *args_info)
   args_info->qps_min_given = 0 ;
   args_info->qps_target_given = 0 ;
   args_info->qps_seed_given = 0 ;
+  args_info->seed_given = 0 ;
   args_info->username_given = 0 ;
   args_info->password_given = 0 ;
+  args_info->meta_replies_given = 0 ;
+  args_info->meta_base64_given = 0 ;
   args_info->threads_given = 0 ;
   args_info->affinity_given = 0 ;
   args_info->connections_given = 0 ;
@@ -173,14 +195,28 @@ void clear_given (struct gengetopt_args_info *args_info)
   args_info->iadist_given = 0 ;
   args_info->skip_given = 0 ;
   args_info->moderate_given = 0 ;
+  args_info->cdf_tables_given = 0 ;
   args_info->noload_given = 0 ;
   args_info->loadonly_given = 0 ;
+  args_info->replay_given = 0 ;
+  args_info->replay_speed_given = 0 ;
   args_info->blocking_given = 0 ;
+  args_info->timer_spin_given = 0 ;
   args_info->no_nodelay_given = 0 ;
+  args_info->engine_given = 0 ;
+  args_info->clock_given = 0 ;
   args_info->warmup_given = 0 ;
   args_info->wait_given = 0 ;
   args_info->save_given = 0 ;
+  args_info->hdr_digits_given = 0 ;
+  args_info->hdr_max_given = 0 ;
+  args_info->live_given = 0 ;
+  args_info->live_format_given = 0 ;
   args_info->search_given = 0 ;
+  args_info->search_window_given = 0 ;
+  args_info->slo_given = 0 ;
+  args_info->slo_window_given = 0 ;
+  args_info->slo_control_given = 0 ;
   args_info->scan_given = 0 ;
   args_info->trace_given = 0 ;
   args_info->getq_size_given = 0 ;
@@ -206,6 +242,8 @@ void clear_args (struct gengetopt_args_info *args_info)
   FIX_UNUSED (args_info);
   args_info->server_arg = NULL;
   args_info->server_orig = NULL;
+  args_info->protocol_arg = gengetopt_strdup ("ascii");
+  args_info->protocol_orig = NULL;
   args_info->qps_arg = 0;
   args_info->qps_orig = NULL;
   args_info->time_arg = 5;
@@ -231,6 +269,7 @@ void clear_args (struct gengetopt_args_info *args_info)
   args_info->qps_target_orig = NULL;
   args_info->qps_seed_arg = 0;
   args_info->qps_seed_orig = NULL;
+  args_info->seed_orig = NULL;
   args_info->username_arg = NULL;
   args_info->username_orig = NULL;
   args_info->password_arg = NULL;
@@ -243,12 +282,38 @@ void clear_args (struct gengetopt_args_info *args_info)
   args_info->depth_orig = NULL;
   args_info->iadist_arg = gengetopt_strdup ("exponential");
   args_info->iadist_orig = NULL;
+  args_info->replay_arg = NULL;
+  args_info->replay_orig = NULL;
+  args_info->replay_speed_arg = 1.0;
+  args_info->replay_speed_orig = NULL;
+  args_info->timer_spin_arg = 0;
+  args_info->timer_spin_orig = NULL;
+  args_info->engine_arg = gengetopt_strdup ("libevent");
+  args_info->engine_orig = NULL;
+  args_info->clock_arg = gengetopt_strdup ("tsc");
+  args_info->clock_orig = NULL;
   args_info->warmup_orig = NULL;
   args_info->wait_orig = NULL;
   args_info->save_arg = NULL;
   args_info->save_orig = NULL;
+  args_info->hdr_digits_arg = 2;
+  args_info->hdr_digits_orig = NULL;
+  args_info->hdr_max_arg = 10;
+  args_info->hdr_max_orig = NULL;
+  args_info->live_arg = 0;
+  args_info->live_orig = NULL;
+  args_info->live_format_arg = gengetopt_strdup ("csv");
+  args_info->live_format_orig = NULL;
   args_info->search_arg = NULL;
   args_info->search_orig = NULL;
+  args_info->search_window_arg = 0;
+  args_info->search_window_orig = NULL;
+  args_info->slo_arg = NULL;
+  args_info->slo_orig = NULL;
+  args_info->slo_window_arg = 1000;
+  args_info->slo_window_orig = NULL;
+  args_info->slo_control_arg = gengetopt_strdup ("aimd");
+  args_info->slo_control_orig = NULL;
   args_info->scan_arg = NULL;
   args_info->scan_orig = NULL;
   args_info->getq_size_arg = 100;
@@ -292,58 +357,76 @@ void init_args_info(struct gengetopt_args_info *args_info)
   args_info->server_min = 0;
   args_info->server_max = 0;
   args_info->binary_help = gengetopt_args_info_help[6] ;
-  args_info->qps_help = gengetopt_args_info_help[7] ;
-  args_info->time_help = gengetopt_args_info_help[8] ;
-  args_info->profile_help = gengetopt_args_info_help[9] ;
-  args_info->keysize_help = gengetopt_args_info_help[10] ;
-  args_info->keyorder_help = gengetopt_args_info_help[11] ;
-  args_info->valuesize_help = gengetopt_args_info_help[12] ;
-  args_info->records_help = gengetopt_args_info_help[13] ;
-  args_info->update_help = gengetopt_args_info_help[14] ;
-  args_info->qps_interval_help = gengetopt_args_info_help[16] ;
-  args_info->qps_max_help = gengetopt_args_info_help[17] ;
-  args_info->qps_min_help = gengetopt_args_info_help[18] ;
-  args_info->qps_target_help = gengetopt_args_info_help[19] ;
+  args_info->protocol_help = gengetopt_args_info_help[7] ;
+  args_info->qps_help = gengetopt_args_info_help[8] ;
+  args_info->time_help = gengetopt_args_info_help[9] ;
+  args_info->profile_help = gengetopt_args_info_help[10] ;
+  args_info->keysize_help = gengetopt_args_info_help[11] ;
+  args_info->keyorder_help = gengetopt_args_info_help[12] ;
+  args_info->valuesize_help = gengetopt_args_info_help[13] ;
+  args_info->records_help = gengetopt_args_info_help[14] ;
+  args_info->update_help = gengetopt_args_info_help[15] ;
+  args_info->qps_interval_help = gengetopt_args_info_help[17] ;
+  args_info->qps_max_help = gengetopt_args_info_help[18] ;
+  args_info->qps_min_help = gengetopt_args_info_help[19] ;
+  args_info->qps_target_help = gengetopt_args_info_help[20] ;
   args_info->qps_target_min = 0;
   args_info->qps_target_max = 0;
-  args_info->qps_seed_help = gengetopt_args_info_help[20] ;
-  args_info->username_help = gengetopt_args_info_help[21] ;
-  args_info->password_help = gengetopt_args_info_help[22] ;
-  args_info->threads_help = gengetopt_args_info_help[23] ;
-  args_info->affinity_help = gengetopt_args_info_help[24] ;
-  args_info->connections_help = gengetopt_args_info_help[25] ;
-  args_info->depth_help = gengetopt_args_info_help[26] ;
-  args_info->roundrobin_help = gengetopt_args_info_help[27] ;
-  args_info->iadist_help = gengetopt_args_info_help[28] ;
-  args_info->skip_help = gengetopt_args_info_help[29] ;
-  args_info->moderate_help = gengetopt_args_info_help[30] ;
-  args_info->noload_help = gengetopt_args_info_help[31] ;
-  args_info->loadonly_help = gengetopt_args_info_help[32] ;
-  args_info->blocking_help = gengetopt_args_info_help[33] ;
-  args_info->no_nodelay_help = gengetopt_args_info_help[34] ;
-  args_info->warmup_help = gengetopt_args_info_help[35] ;
-  args_info->wait_help = gengetopt_args_info_help[36] ;
-  args_info->save_help = gengetopt_args_info_help[37] ;
-  args_info->search_help = gengetopt_args_info_help[38] ;
-  args_info->scan_help = gengetopt_args_info_help[39] ;
-  args_info->trace_help = gengetopt_args_info_help[40] ;
-  args_info->getq_size_help = gengetopt_args_info_help[41] ;
-  args_info->getq_freq_help = gengetopt_args_info_help[42] ;
-  args_info->keycache_capacity_help = gengetopt_args_info_help[43] ;
-  args_info->keycache_reuse_help = gengetopt_args_info_help[44] ;
-  args_info->keycache_regen_help = gengetopt_args_info_help[45] ;
-  args_info->plot_all_help = gengetopt_args_info_help[46] ;
-  args_info->agentmode_help = gengetopt_args_info_help[48] ;
-  args_info->agent_help = gengetopt_args_info_help[49] ;
+  args_info->qps_seed_help = gengetopt_args_info_help[21] ;
+  args_info->seed_help = gengetopt_args_info_help[22] ;
+  args_info->username_help = gengetopt_args_info_help[23] ;
+  args_info->password_help = gengetopt_args_info_help[24] ;
+  args_info->meta_replies_help = gengetopt_args_info_help[25] ;
+  args_info->meta_base64_help = gengetopt_args_info_help[26] ;
+  args_info->threads_help = gengetopt_args_info_help[27] ;
+  args_info->affinity_help = gengetopt_args_info_help[28] ;
+  args_info->connections_help = gengetopt_args_info_help[29] ;
+  args_info->depth_help = gengetopt_args_info_help[30] ;
+  args_info->roundrobin_help = gengetopt_args_info_help[31] ;
+  args_info->iadist_help = gengetopt_args_info_help[32] ;
+  args_info->skip_help = gengetopt_args_info_help[33] ;
+  args_info->moderate_help = gengetopt_args_info_help[34] ;
+  args_info->cdf_tables_help = gengetopt_args_info_help[35] ;
+  args_info->noload_help = gengetopt_args_info_help[36] ;
+  args_info->loadonly_help = gengetopt_args_info_help[37] ;
+  args_info->replay_help = gengetopt_args_info_help[38] ;
+  args_info->replay_speed_help = gengetopt_args_info_help[39] ;
+  args_info->blocking_help = gengetopt_args_info_help[40] ;
+  args_info->timer_spin_help = gengetopt_args_info_help[41] ;
+  args_info->no_nodelay_help = gengetopt_args_info_help[42] ;
+  args_info->engine_help = gengetopt_args_info_help[43] ;
+  args_info->clock_help = gengetopt_args_info_help[44] ;
+  args_info->warmup_help = gengetopt_args_info_help[45] ;
+  args_info->wait_help = gengetopt_args_info_help[46] ;
+  args_info->save_help = gengetopt_args_info_help[47] ;
+  args_info->hdr_digits_help = gengetopt_args_info_help[48] ;
+  args_info->hdr_max_help = gengetopt_args_info_help[49] ;
+  args_info->live_help = gengetopt_args_info_help[50] ;
+  args_info->live_format_help = gengetopt_args_info_help[51] ;
+  args_info->search_help = gengetopt_args_info_help[52] ;
+  args_info->search_window_help = gengetopt_args_info_help[53] ;
+  args_info->slo_help = gengetopt_args_info_help[54] ;
+  args_info->slo_window_help = gengetopt_args_info_help[55] ;
+  args_info->slo_control_help = gengetopt_args_info_help[56] ;
+  args_info->scan_help = gengetopt_args_info_help[57] ;
+  args_info->trace_help = gengetopt_args_info_help[58] ;
+  args_info->getq_size_help = gengetopt_args_info_help[59] ;
+  args_info->getq_freq_help = gengetopt_args_info_help[60] ;
+  args_info->keycache_capacity_help = gengetopt_args_info_help[61] ;
+  args_info->keycache_reuse_help = gengetopt_args_info_help[62] ;
+  args_info->keycache_regen_help = gengetopt_args_info_help[63] ;
+  args_info->plot_all_help = gengetopt_args_info_help[64] ;
+  args_info->agentmode_help = gengetopt_args_info_help[66] ;
+  args_info->agent_help = gengetopt_args_info_help[67] ;
   args_info->agent_min = 0;
   args_info->agent_max = 0;
-  args_info->agent_port_help = gengetopt_args_info_help[50] ;
-  args_info->lambda_mul_help = gengetopt_args_info_help[51] ;
-  args_info->measure_connections_help = gengetopt_args_info_help[52] ;
-  args_info->measure_qps_help = gengetopt_args_info_help[53] ;
-  args_info->measure_depth_help = gengetopt_args_info_help[54] ;
-  args_info->poll_freq_help = gengetopt_args_info_help[55] ;
-  args_info->poll_max_help = gengetopt_args_info_help[56] ;
+  args_info->agent_port_help = gengetopt_args_info_help[68] ;
+  args_info->lambda_mul_help = gengetopt_args_info_help[69] ;
+  args_info->measure_connections_help = gengetopt_args_info_help[70] ;
+  args_info->measure_qps_help = gengetopt_args_info_help[71] ;
+  args_info->measure_depth_help = gengetopt_args_info_help[72] ;
+  args_info->poll_freq_help = gengetopt_args_info_help[73] ;
+  args_info->poll_max_help = gengetopt_args_info_help[74] ;
   
 }
 
@@ -493,6 +576,8 @@ cmdline_parser_release (struct gengetopt_args_info *args_info)
 {
 
   free_multiple_string_field (args_info->server_given, &(args_info->server_arg), &(args_info->server_orig));
+  free_string_field (&(args_info->protocol_arg));
+  free_string_field (&(args_info->protocol_orig));
   free_string_field (&(args_info->qps_orig));
   free_string_field (&(args_info->time_orig));
   free_string_field (&(args_info->profile_orig));
@@ -510,6 +595,7 @@ cmdline_parser_release (struct gengetopt_args_info *args_info)
   free_multiple_field (args_info->qps_target_given, (void *)(args_info->qps_target_arg), &(args_info->qps_target_orig));
   args_info->qps_target_arg = 0;
   free_string_field (&(args_info->qps_seed_orig));
+  free_string_field (&(args_info->seed_orig));
   free_string_field (&(args_info->username_arg));
   free_string_field (&(args_info->username_orig));
   free_string_field (&(args_info->password_arg));
@@ -519,12 +605,31 @@ cmdline_parser_release (struct gengetopt_args_info *args_info)
   free_string_field (&(args_info->depth_orig));
   free_string_field (&(args_info->iadist_arg));
   free_string_field (&(args_info->iadist_orig));
+  free_string_field (&(args_info->replay_arg));
+  free_string_field (&(args_info->replay_orig));
+  free_string_field (&(args_info->replay_speed_orig));
+  free_string_field (&(args_info->timer_spin_orig));
+  free_string_field (&(args_info->engine_arg));
+  free_string_field (&(args_info->engine_orig));
+  free_string_field (&(args_info->clock_arg));
+  free_string_field (&(args_info->clock_orig));
   free_string_field (&(args_info->warmup_orig));
   free_string_field (&(args_info->wait_orig));
   free_string_field (&(args_info->save_arg));
   free_string_field (&(args_info->save_orig));
+  free_string_field (&(args_info->hdr_digits_orig));
+  free_string_field (&(args_info->hdr_max_orig));
+  free_string_field (&(args_info->live_orig));
+  free_string_field (&(args_info->live_format_arg));
+  free_string_field (&(args_info->live_format_orig));
   free_string_field (&(args_info->search_arg));
   free_string_field (&(args_info->search_orig));
+  free_string_field (&(args_info->search_window_orig));
+  free_string_field (&(args_info->slo_arg));
+  free_string_field (&(args_info->slo_orig));
+  free_string_field (&(args_info->slo_window_orig));
+  free_string_field (&(args_info->slo_control_arg));
+  free_string_field (&(args_info->slo_control_orig));
   free_string_field (&(args_info->scan_arg));
   free_string_field (&(args_info->scan_orig));
   free_string_field (&(args_info->getq_size_orig));
@@ -589,6 +694,8 @@ cmdline_parser_dump(FILE *outfile, struct gengetopt_args_info *args_info)
   write_multiple_into_file(outfile, args_info->server_given, "server", args_info->server_orig, 0);
   if (args_info->binary_given)
     write_into_file(outfile, "binary", 0, 0 );
+  if (args_info->protocol_given)
+    write_into_file(outfile, "protocol", args_info->protocol_orig, 0);
   if (args_info->qps_given)
     write_into_file(outfile, "qps", args_info->qps_orig, 0);
   if (args_info->time_given)
@@ -614,10 +721,16 @@ cmdline_parser_dump(FILE *outfile, struct gengetopt_args_info *args_info)
   write_multiple_into_file(outfile, args_info->qps_target_given, "qps_target", args_info->qps_target_orig, 0);
   if (args_info->qps_seed_given)
     write_into_file(outfile, "qps_seed", args_info->qps_seed_orig, 0);
+  if (args_info->seed_given)
+    write_into_file(outfile, "seed", args_info->seed_orig, 0);
   if (args_info->username_given)
     write_into_file(outfile, "username", args_info->username_orig, 0);
   if (args_info->password_given)
     write_into_file(outfile, "password", args_info->password_orig, 0);
+  if (args_info->meta_replies_given)
+    write_into_file(outfile, "meta_replies", 0, 0 );
+  if (args_info->meta_base64_given)
+    write_into_file(outfile, "meta_base64", 0, 0 );
   if (args_info->threads_given)
     write_into_file(outfile, "threads", args_info->threads_orig, 0);
   if (args_info->affinity_given)
@@ -634,22 +747,50 @@ cmdline_parser_dump(FILE *outfile, struct gengetopt_args_info *args_info)
     write_into_file(outfile, "skip", 0, 0 );
   if (args_info->moderate_given)
     write_into_file(outfile, "moderate", 0, 0 );
+  if (args_info->cdf_tables_given)
+    write_into_file(outfile, "cdf_tables", 0, 0 );
   if (args_info->noload_given)
     write_into_file(outfile, "noload", 0, 0 );
   if (args_info->loadonly_given)
     write_into_file(outfile, "loadonly", 0, 0 );
+  if (args_info->replay_given)
+    write_into_file(outfile, "replay", args_info->replay_orig, 0);
+  if (args_info->replay_speed_given)
+    write_into_file(outfile, "replay_speed", args_info->replay_speed_orig, 0);
   if (args_info->blocking_given)
     write_into_file(outfile, "blocking", 0, 0 );
+  if (args_info->timer_spin_given)
+    write_into_file(outfile, "timer_spin", args_info->timer_spin_orig, 0);
   if (args_info->no_nodelay_given)
     write_into_file(outfile, "no_nodelay", 0, 0 );
+  if (args_info->engine_given)
+    write_into_file(outfile, "engine", args_info->engine_orig, 0);
+  if (args_info->clock_given)
+    write_into_file(outfile, "clock", args_info->clock_orig, 0);
   if (args_info->warmup_given)
     write_into_file(outfile, "warmup", args_info->warmup_orig, 0);
   if (args_info->wait_given)
     write_into_file(outfile, "wait", args_info->wait_orig, 0);
   if (args_info->save_given)
     write_into_file(outfile, "save", args_info->save_orig, 0);
+  if (args_info->hdr_digits_given)
+    write_into_file(outfile, "hdr_digits", args_info->hdr_digits_orig, 0);
+  if (args_info->hdr_max_given)
+    write_into_file(outfile, "hdr_max", args_info->hdr_max_orig, 0);
+  if (args_info->live_given)
+    write_into_file(outfile, "live", args_info->live_orig, 0);
+  if (args_info->live_format_given)
+    write_into_file(outfile, "live_format", args_info->live_format_orig, 0);
   if (args_info->search_given)
     write_into_file(outfile, "search", args_info->search_orig, 0);
+  if (args_info->search_window_given)
+    write_into_file(outfile, "search_window", args_info->search_window_orig, 0);
+  if (args_info->slo_given)
+    write_into_file(outfile, "slo", args_info->slo_orig, 0);
+  if (args_info->slo_window_given)
+    write_into_file(outfile, "slo_window", args_info->slo_window_orig, 0);
+  if (args_info->slo_control_given)
+    write_into_file(outfile, "slo_control", args_info->slo_control_orig, 0);
   if (args_info->scan_given)
     write_into_file(outfile, "scan", args_info->scan_orig, 0);
   if (args_info->trace_given)
@@ -1270,6 +1411,7 @@ cmdline_parser_internal (
         { "quiet",	0, NULL, 0 },
         { "server",	1, NULL, 's' },
         { "binary",	0, NULL, 0 },
+        { "protocol",	1, NULL, 0 },
         { "qps",	1, NULL, 'q' },
         { "time",	1, NULL, 't' },
         { "profile",	1, NULL, 0 },
@@ -1283,8 +1425,11 @@ cmdline_parser_internal (
         { "qps_min",	1, NULL, 0 },
         { "qps_target",	1, NULL, 0 },
         { "qps_seed",	1, NULL, 0 },
+        { "seed",	1, NULL, 0 },
         { "username",	1, NULL, 'U' },
         { "password",	1, NULL, 'P' },
+        { "meta_replies",	0, NULL, 0 },
+        { "meta_base64",	0, NULL, 0 },
         { "threads",	1, NULL, 'T' },
         { "affinity",	0, NULL, 0 },
         { "connections",	1, NULL, 'c' },
@@ -1293,14 +1438,28 @@ cmdline_parser_internal (
         { "iadist",	1, NULL, 'i' },
         { "skip",	0, NULL, 'S' },
         { "moderate",	0, NULL, 0 },
+        { "cdf_tables",	0, NULL, 0 },
         { "noload",	0, NULL, 0 },
         { "loadonly",	0, NULL, 0 },
+        { "replay",	1, NULL, 0 },
+        { "replay_speed",	1, NULL, 0 },
         { "blocking",	0, NULL, 'B' },
+        { "timer_spin",	1, NULL, 0 },
         { "no_nodelay",	0, NULL, 0 },
+        { "engine",	1, NULL, 0 },
+        { "clock",	1, NULL, 0 },
         { "warmup",	1, NULL, 'w' },
         { "wait",	1, NULL, 'W' },
         { "save",	1, NULL, 0 },
+        { "hdr_digits",	1, NULL, 0 },
+        { "hdr_max",	1, NULL, 0 },
+        { "live",	1, NULL, 0 },
+        { "live_format",	1, NULL, 0 },
         { "search",	1, NULL, 0 },
+        { "search_window",	1, NULL, 0 },
+        { "slo",	1, NULL, 0 },
+        { "slo_window",	1, NULL, 0 },
+        { "slo_control",	1, NULL, 0 },
         { "scan",	1, NULL, 0 },
         { "trace",	0, NULL, 'e' },
         { "getq_size",	1, NULL, 'G' },
@@ -1726,6 +1885,20 @@ cmdline_parser_internal (
                 additional_error))
               goto failure;
           
+          }
+          /* Wire protocol: ascii, binary or meta (memcached meta commands mg/ms/mn).  --binary is short for --protocol=binary.  */
+          else if (strcmp (long_options[option_index].name, "protocol") == 0)
+          {
+          
+          
+            if (update_arg( (void *)&(args_info->protocol_arg), 
+                 &(args_info->protocol_orig), &(args_info->protocol_given),
+                &(local_args_info.protocol_given), optarg, 0, "ascii", ARG_STRING,
+                check_ambiguity, override, 0, 0,
+                "protocol", '-',
+                additional_error))
+              goto failure;
+          
           }
           /* Select one of several predefined profiles..  */
           else if (strcmp (long_options[option_index].name, "profile") == 0)
@@ -1821,6 +1994,48 @@ cmdline_parser_internal (
                 additional_error))
               goto failure;
           
+          }
+          /* Seed for key, value size and inter-arrival draws.  Runs with the same seed (and threads, connections and agents) issue the same requests.  By default a seed is picked from the clock and printed with -v.  */
+          else if (strcmp (long_options[option_index].name, "seed") == 0)
+          {
+          
+          
+            if (update_arg( (void *)&(args_info->seed_arg), 
+                 &(args_info->seed_orig), &(args_info->seed_given),
+                &(local_args_info.seed_given), optarg, 0, 0, ARG_INT,
+                check_ambiguity, override, 0, 0,
+                "seed", '-',
+                additional_error))
+              goto failure;
+          
+          }
+          /* With --protocol=meta, ask for a reply to every request instead of sending quiet (q) requests terminated by mn.  */
+          else if (strcmp (long_options[option_index].name, "meta_replies") == 0)
+          {
+          
+          
+            if (update_arg( 0 , 
+                 0 , &(args_info->meta_replies_given),
+                &(local_args_info.meta_replies_given), optarg, 0, 0, ARG_NO,
+                check_ambiguity, override, 0, 0,
+                "meta_replies", '-',
+                additional_error))
+              goto failure;
+          
+          }
+          /* With --protocol=meta, send keys base64-encoded (b flag).  */
+          else if (strcmp (long_options[option_index].name, "meta_base64") == 0)
+          {
+          
+          
+            if (update_arg( 0 , 
+                 0 , &(args_info->meta_base64_given),
+                &(local_args_info.meta_base64_given), optarg, 0, 0, ARG_NO,
+                check_ambiguity, override, 0, 0,
+                "meta_base64", '-',
+                additional_error))
+              goto failure;
+          
           }
           /* Set CPU affinity for threads, round-robin.  */
           else if (strcmp (long_options[option_index].name, "affinity") == 0)
@@ -1849,6 +2064,20 @@ cmdline_parser_internal (
                 additional_error))
               goto failure;
           
+          }
+          /* Draw exponential, pareto and GEV inter-arrival times and value sizes from shared, interpolated inverse-CDF tables instead of computing log()/pow() per draw.  */
+          else if (strcmp (long_options[option_index].name, "cdf_tables") == 0)
+          {
+          
+          
+            if (update_arg( 0 , 
+                 0 , &(args_info->cdf_tables_given),
+                &(local_args_info.cdf_tables_given), optarg, 0, 0, ARG_NO,
+                check_ambiguity, override, 0, 0,
+                "cdf_tables", '-',
+                additional_error))
+              goto failure;
+          
           }
           /* Skip database loading..  */
           else if (strcmp (long_options[option_index].name, "noload") == 0)
@@ -1877,6 +2106,48 @@ cmdline_parser_internal (
                 additional_error))
               goto failure;
           
+          }
+          /* Replay a binary request trace (made with mcperf-trace) instead of generating requests.  Skips database loading.  */
+          else if (strcmp (long_options[option_index].name, "replay") == 0)
+          {
+          
+          
+            if (update_arg( (void *)&(args_info->replay_arg), 
+                 &(args_info->replay_orig), &(args_info->replay_given),
+                &(local_args_info.replay_given), optarg, 0, 0, ARG_STRING,
+                check_ambiguity, override, 0, 0,
+                "replay", '-',
+                additional_error))
+              goto failure;
+          
+          }
+          /* Replay speed relative to the trace: 2 sends twice as fast.  */
+          else if (strcmp (long_options[option_index].name, "replay_speed") == 0)
+          {
+          
+          
+            if (update_arg( (void *)&(args_info->replay_speed_arg), 
+                 &(args_info->replay_speed_orig), &(args_info->replay_speed_given),
+                &(local_args_info.replay_speed_given), optarg, 0, "1.0", ARG_DOUBLE,
+                check_ambiguity, override, 0, 0,
+                "replay_speed", '-',
+                additional_error))
+              goto failure;
+          
+          }
+          /* With --blocking, poll instead of sleeping when the next scheduled send is less than this many microseconds away.  */
+          else if (strcmp (long_options[option_index].name, "timer_spin") == 0)
+          {
+          
+          
+            if (update_arg( (void *)&(args_info->timer_spin_arg), 
+                 &(args_info->timer_spin_orig), &(args_info->timer_spin_given),
+                &(local_args_info.timer_spin_given), optarg, 0, "0", ARG_INT,
+                check_ambiguity, override, 0, 0,
+                "timer_spin", '-',
+                additional_error))
+              goto failure;
+          
           }
           /* Don't use TCP_NODELAY..  */
           else if (strcmp (long_options[option_index].name, "no_nodelay") == 0)
@@ -1891,6 +2162,34 @@ cmdline_parser_internal (
                 additional_error))
               goto failure;
           
+          }
+          /* Event engine driving connections: libevent or uring (io_uring, batched submissions with multishot receive).  */
+          else if (strcmp (long_options[option_index].name, "engine") == 0)
+          {
+          
+          
+            if (update_arg( (void *)&(args_info->engine_arg), 
+                 &(args_info->engine_orig), &(args_info->engine_given),
+                &(local_args_info.engine_given), optarg, 0, "libevent", ARG_STRING,
+                check_ambiguity, override, 0, 0,
+                "engine", '-',
+                additional_error))
+              goto failure;
+          
+          }
+          /* Clock used to timestamp requests: tsc, monotonic or gettimeofday.  tsc falls back to monotonic if the TSC is not invariant.  */
+          else if (strcmp (long_options[option_index].name, "clock") == 0)
+          {
+          
+          
+            if (update_arg( (void *)&(args_info->clock_arg), 
+                 &(args_info->clock_orig), &(args_info->clock_given),
+                &(local_args_info.clock_given), optarg, 0, "tsc", ARG_STRING,
+                check_ambiguity, override, 0, 0,
+                "clock", '-',
+                additional_error))
+              goto failure;
+          
           }
           /* Record latency samples to given file..  */
           else if (strcmp (long_options[option_index].name, "save") == 0)
@@ -1905,6 +2204,62 @@ cmdline_parser_internal (
                 additional_error))
               goto failure;
           
+          }
+          /* Significant digits kept by the latency histogram.  */
+          else if (strcmp (long_options[option_index].name, "hdr_digits") == 0)
+          {
+          
+          
+            if (update_arg( (void *)&(args_info->hdr_digits_arg), 
+                 &(args_info->hdr_digits_orig), &(args_info->hdr_digits_given),
+                &(local_args_info.hdr_digits_given), optarg, 0, "2", ARG_INT,
+                check_ambiguity, override, 0, 0,
+                "hdr_digits", '-',
+                additional_error))
+              goto failure;
+          
+          }
+          /* Highest latency (seconds) tracked by the latency histogram; slower samples are clamped.  */
+          else if (strcmp (long_options[option_index].name, "hdr_max") == 0)
+          {
+          
+          
+            if (update_arg( (void *)&(args_info->hdr_max_arg), 
+                 &(args_info->hdr_max_orig), &(args_info->hdr_max_given),
+                &(local_args_info.hdr_max_given), optarg, 0, "10", ARG_DOUBLE,
+                check_ambiguity, override, 0, 0,
+                "hdr_max", '-',
+                additional_error))
+              goto failure;
+          
+          }
+          /* Print QPS, latency, miss rate and RX/TX rate every N milliseconds while running.  0 disables live output.  */
+          else if (strcmp (long_options[option_index].name, "live") == 0)
+          {
+          
+          
+            if (update_arg( (void *)&(args_info->live_arg), 
+                 &(args_info->live_orig), &(args_info->live_given),
+                &(local_args_info.live_given), optarg, 0, "0", ARG_INT,
+                check_ambiguity, override, 0, 0,
+                "live", '-',
+                additional_error))
+              goto failure;
+          
+          }
+          /* Format of live output: csv or json.  */
+          else if (strcmp (long_options[option_index].name, "live_format") == 0)
+          {
+          
+          
+            if (update_arg( (void *)&(args_info->live_format_arg), 
+                 &(args_info->live_format_orig), &(args_info->live_format_given),
+                &(local_args_info.live_format_given), optarg, 0, "csv", ARG_STRING,
+                check_ambiguity, override, 0, 0,
+                "live_format", '-',
+                additional_error))
+              goto failure;
+          
           }
           /* Search for the QPS where N-order statistic < Xus.  (i.e. --search 95:1000 means find the QPS where 95% of requests are faster than 1000us)..  */
           else if (strcmp (long_options[option_index].name, "search") == 0)
@@ -1919,6 +2274,62 @@ cmdline_parser_internal (
                 additional_error))
               goto failure;
           
+          }
+          /* With --search, probe every QPS in one run, retargeting all threads and agents live and measuring windows of this many ms until the latency is clearly above or below X.  0 restarts a full run per probe.  */
+          else if (strcmp (long_options[option_index].name, "search_window") == 0)
+          {
+          
+          
+            if (update_arg( (void *)&(args_info->search_window_arg), 
+                 &(args_info->search_window_orig), &(args_info->search_window_given),
+                &(local_args_info.search_window_given), optarg, 0, "0", ARG_INT,
+                check_ambiguity, override, 0, 0,
+                "search_window", '-',
+                additional_error))
+              goto failure;
+          
+          }
+          /* Keep adjusting the QPS for the whole run to the highest where N-order statistic < Xus (as in --search), printing one row per --slo_window.  */
+          else if (strcmp (long_options[option_index].name, "slo") == 0)
+          {
+          
+          
+            if (update_arg( (void *)&(args_info->slo_arg), 
+                 &(args_info->slo_orig), &(args_info->slo_given),
+                &(local_args_info.slo_given), optarg, 0, 0, ARG_STRING,
+                check_ambiguity, override, 0, 0,
+                "slo", '-',
+                additional_error))
+              goto failure;
+          
+          }
+          /* Window (ms) over which --slo measures latency before each adjustment.  */
+          else if (strcmp (long_options[option_index].name, "slo_window") == 0)
+          {
+          
+          
+            if (update_arg( (void *)&(args_info->slo_window_arg), 
+                 &(args_info->slo_window_orig), &(args_info->slo_window_given),
+                &(local_args_info.slo_window_given), optarg, 0, "1000", ARG_INT,
+                check_ambiguity, override, 0, 0,
+                "slo_window", '-',
+                additional_error))
+              goto failure;
+          
+          }
+          /* How --slo adjusts the QPS after each window: aimd (add 2% of the starting QPS if the target was met, else cut it by 20%) or pid.  */
+          else if (strcmp (long_options[option_index].name, "slo_control") == 0)
+          {
+          
+          
+            if (update_arg( (void *)&(args_info->slo_control_arg), 
+                 &(args_info->slo_control_orig), &(args_info->slo_control_given),
+                &(local_args_info.slo_control_given), optarg, 0, "aimd", ARG_STRING,
+                check_ambiguity, override, 0, 0,
+                "slo_control", '-',
+                additional_error))
+              goto failure;
+          
           }
           /* Scan latency across QPS rates from min to max..  */
           else if (strcmp (long_options[option_index].name, "scan") == 0)
@@ -49,6 +49,9 @@ struct gengetopt_args_info
   unsigned int server_max; /**< @brief Memcached server hostname[:port[-end_port]].  Repeat to specify multiple servers. 's maximum occurreces */
   const char *server_help; /**< @brief Memcached server hostname[:port[-end_port]].  Repeat to specify multiple servers.  help description.  */
   const char *binary_help; /**< @brief Use binary memcached protocol instead of ASCII. help description.  */
+  char * protocol_arg;	/**< @brief Wire protocol: ascii, binary or meta (memcached meta commands mg/ms/mn).  --binary is short for --protocol=binary. (default='ascii').  */
+  char * protocol_orig;	/**< @brief Wire protocol: ascii, binary or meta (memcached meta commands mg/ms/mn).  --binary is short for --protocol=binary. original value given at command line.  */
+  const char *protocol_help; /**< @brief Wire protocol: ascii, binary or meta (memcached meta commands mg/ms/mn).  --binary is short for --protocol=binary. help description.  */
   int qps_arg;	/**< @brief Target aggregate QPS. 0 = peak QPS. (default='0').  */
   char * qps_orig;	/**< @brief Target aggregate QPS. 0 = peak QPS. original value given at command line.  */
   const char *qps_help; /**< @brief Target aggregate QPS. 0 = peak QPS. help description.  */
@@ -90,12 +93,17 @@ struct gengetopt_args_info
   int qps_seed_arg;	/**< @brief QPS seed. (default='0').  */
   char * qps_seed_orig;	/**< @brief QPS seed. original value given at command line.  */
   const char *qps_seed_help; /**< @brief QPS seed. help description.  */
+  int seed_arg;	/**< @brief Seed for key, value size and inter-arrival draws.  Runs with the same seed (and threads, connections and agents) issue the same requests.  By default a seed is picked from the clock and printed with -v..  */
+  char * seed_orig;	/**< @brief Seed for key, value size and inter-arrival draws.  Runs with the same seed (and threads, connections and agents) issue the same requests.  By default a seed is picked from the clock and printed with -v. original value given at command line.  */
+  const char *seed_help; /**< @brief Seed for key, value size and inter-arrival draws.  Runs with the same seed (and threads, connections and agents) issue the same requests.  By default a seed is picked from the clock and printed with -v. help description.  */
   char * username_arg;	/**< @brief Username to use for SASL authentication..  */
   char * username_orig;	/**< @brief Username to use for SASL authentication. original value given at command line.  */
   const char *username_help; /**< @brief Username to use for SASL authentication. help description.  */
   char * password_arg;	/**< @brief Password to use for SASL authentication..  */
   char * password_orig;	/**< @brief Password to use for SASL authentication. original value given at command line.  */
   const char *password_help; /**< @brief Password to use for SASL authentication. help description.  */
+  const char *meta_replies_help; /**< @brief With --protocol=meta, ask for a reply to every request instead of sending quiet (q) requests terminated by mn. help description.  */
+  const char *meta_base64_help; /**< @brief With --protocol=meta, send keys base64-encoded (b flag). help description.  */
   int threads_arg;	/**< @brief Number of threads to spawn. (default='1').  */
   char * threads_orig;	/**< @brief Number of threads to spawn. original value given at command line.  */
   const char *threads_help; /**< @brief Number of threads to spawn. help description.  */
@@ -112,10 +120,26 @@ struct gengetopt_args_info
   const char *iadist_help; /**< @brief Inter-arrival distribution (distribution).  Note: The distribution will automatically be adjusted to match the QPS given by --qps. help description.  */
   const char *skip_help; /**< @brief Skip transmissions if previous requests are late.  This harms the long-term QPS average, but reduces spikes in QPS after long latency requests. help description.  */
   const char *moderate_help; /**< @brief Enforce a minimum delay of ~1/lambda between requests. help description.  */
+  const char *cdf_tables_help; /**< @brief Draw exponential, pareto and GEV inter-arrival times and value sizes from shared, interpolated inverse-CDF tables instead of computing log()/pow() per draw. help description.  */
   const char *noload_help; /**< @brief Skip database loading. help description.  */
   const char *loadonly_help; /**< @brief Load database and then exit. help description.  */
+  char * replay_arg;	/**< @brief Replay a binary request trace (made with mcperf-trace) instead of generating requests.  Skips database loading..  */
+  char * replay_orig;	/**< @brief Replay a binary request trace (made with mcperf-trace) instead of generating requests.  Skips database loading. original value given at command line.  */
+  const char *replay_help; /**< @brief Replay a binary request trace (made with mcperf-trace) instead of generating requests.  Skips database loading. help description.  */
+  double replay_speed_arg;	/**< @brief Replay speed relative to the trace: 2 sends twice as fast. (default='1.0').  */
+  char * replay_speed_orig;	/**< @brief Replay speed relative to the trace: 2 sends twice as fast. original value given at command line.  */
+  const char *replay_speed_help; /**< @brief Replay speed relative to the trace: 2 sends twice as fast. help description.  */
   const char *blocking_help; /**< @brief Use blocking epoll().  May increase latency. help description.  */
+  int timer_spin_arg;	/**< @brief With --blocking, poll instead of sleeping when the next scheduled send is less than this many microseconds away. (default='0').  */
+  char * timer_spin_orig;	/**< @brief With --blocking, poll instead of sleeping when the next scheduled send is less than this many microseconds away. original value given at command line.  */
+  const char *timer_spin_help; /**< @brief With --blocking, poll instead of sleeping when the next scheduled send is less than this many microseconds away. help description.  */
   const char *no_nodelay_help; /**< @brief Don't use TCP_NODELAY. help description.  */
+  char * engine_arg;	/**< @brief Event engine driving connections: libevent or uring (io_uring, batched submissions with multishot receive). (default='libevent').  */
+  char * engine_orig;	/**< @brief Event engine driving connections: libevent or uring (io_uring, batched submissions with multishot receive). original value given at command line.  */
+  const char *engine_help; /**< @brief Event engine driving connections: libevent or uring (io_uring, batched submissions with multishot receive). help description.  */
+  char * clock_arg;	/**< @brief Clock used to timestamp requests: tsc, monotonic or gettimeofday.  tsc falls back to monotonic if the TSC is not invariant. (default='tsc').  */
+  char * clock_orig;	/**< @brief Clock used to timestamp requests: tsc, monotonic or gettimeofday.  tsc falls back to monotonic if the TSC is not invariant. original value given at command line.  */
+  const char *clock_help; /**< @brief Clock used to timestamp requests: tsc, monotonic or gettimeofday.  tsc falls back to monotonic if the TSC is not invariant. help description.  */
   int warmup_arg;	/**< @brief Warmup time before starting measurement..  */
   char * warmup_orig;	/**< @brief Warmup time before starting measurement. original value given at command line.  */
   const char *warmup_help; /**< @brief Warmup time before starting measurement. help description.  */
@@ -125,9 +149,33 @@ struct gengetopt_args_info
   char * save_arg;	/**< @brief Record latency samples to given file..  */
   char * save_orig;	/**< @brief Record latency samples to given file. original value given at command line.  */
   const char *save_help; /**< @brief Record latency samples to given file. help description.  */
+  int hdr_digits_arg;	/**< @brief Significant digits kept by the latency histogram. (default='2').  */
+  char * hdr_digits_orig;	/**< @brief Significant digits kept by the latency histogram. original value given at command line.  */
+  const char *hdr_digits_help; /**< @brief Significant digits kept by the latency histogram. help description.  */
+  double hdr_max_arg;	/**< @brief Highest latency (seconds) tracked by the latency histogram; slower samples are clamped. (default='10').  */
+  char * hdr_max_orig;	/**< @brief Highest latency (seconds) tracked by the latency histogram; slower samples are clamped. original value given at command line.  */
+  const char *hdr_max_help; /**< @brief Highest latency (seconds) tracked by the latency histogram; slower samples are clamped. help description.  */
+  int live_arg;	/**< @brief Print QPS, latency, miss rate and RX/TX rate every N milliseconds while running.  0 disables live output. (default='0').  */
+  char * live_orig;	/**< @brief Print QPS, latency, miss rate and RX/TX rate every N milliseconds while running.  0 disables live output. original value given at command line.  */
+  const char *live_help; /**< @brief Print QPS, latency, miss rate and RX/TX rate every N milliseconds while running.  0 disables live output. help description.  */
+  char * live_format_arg;	/**< @brief Format of live output: csv or json. (default='csv').  */
+  char * live_format_orig;	/**< @brief Format of live output: csv or json. original value given at command line.  */
+  const char *live_format_help; /**< @brief Format of live output: csv or json. help description.  */
   char * search_arg;	/**< @brief Search for the QPS where N-order statistic < Xus.  (i.e. --search 95:1000 means find the QPS where 95% of requests are faster than 1000us)..  */
   char * search_orig;	/**< @brief Search for the QPS where N-order statistic < Xus.  (i.e. --search 95:1000 means find the QPS where 95% of requests are faster than 1000us). original value given at command line.  */
   const char *search_help; /**< @brief Search for the QPS where N-order statistic < Xus.  (i.e. --search 95:1000 means find the QPS where 95% of requests are faster than 1000us). help description.  */
+  int search_window_arg;	/**< @brief With --search, probe every QPS in one run, retargeting all threads and agents live and measuring windows of this many ms until the latency is clearly above or below X.  0 restarts a full run per probe. (default='0').  */
+  char * search_window_orig;	/**< @brief With --search, probe every QPS in one run, retargeting all threads and agents live and measuring windows of this many ms until the latency is clearly above or below X.  0 restarts a full run per probe. original value given at command line.  */
+  const char *search_window_help; /**< @brief With --search, probe every QPS in one run, retargeting all threads and agents live and measuring windows of this many ms until the latency is clearly above or below X.  0 restarts a full run per probe. help description.  */
+  char * slo_arg;	/**< @brief Keep adjusting the QPS for the whole run to the highest where N-order statistic < Xus (as in --search), printing one row per --slo_window..  */
+  char * slo_orig;	/**< @brief Keep adjusting the QPS for the whole run to the highest where N-order statistic < Xus (as in --search), printing one row per --slo_window. original value given at command line.  */
+  const char *slo_help; /**< @brief Keep adjusting the QPS for the whole run to the highest where N-order statistic < Xus (as in --search), printing one row per --slo_window. help description.  */
+  int slo_window_arg;	/**< @brief Window (ms) over which --slo measures latency before each adjustment. (default='1000').  */
+  char * slo_window_orig;	/**< @brief Window (ms) over which --slo measures latency before each adjustment. original value given at command line.  */
+  const char *slo_window_help; /**< @brief Window (ms) over which --slo measures latency before each adjustment. help description.  */
+  char * slo_control_arg;	/**< @brief How --slo adjusts the QPS after each window: aimd (add 2% of the starting QPS if the target was met, else cut it by 20%) or pid. (default='aimd').  */
+  char * slo_control_orig;	/**< @brief How --slo adjusts the QPS after each window: aimd (add 2% of the starting QPS if the target was met, else cut it by 20%) or pid. original value given at command line.  */
+  const char *slo_control_help; /**< @brief How --slo adjusts the QPS after each window: aimd (add 2% of the starting QPS if the target was met, else cut it by 20%) or pid. help description.  */
   char * scan_arg;	/**< @brief Scan latency across QPS rates from min to max..  */
   char * scan_orig;	/**< @brief Scan latency across QPS rates from min to max. original value given at command line.  */
   const char *scan_help; /**< @brief Scan latency across QPS rates from min to max. help description.  */
@@ -182,6 +230,7 @@ struct gengetopt_args_info
   unsigned int quiet_given ;	/**< @brief Whether quiet was given.  */
   unsigned int server_given ;	/**< @brief Whether server was given.  */
   unsigned int binary_given ;	/**< @brief Whether binary was given.  */
+  unsigned int protocol_given ;	/**< @brief Whether protocol was given.  */
   unsigned int qps_given ;	/**< @brief Whether qps was given.  */
   unsigned int time_given ;	/**< @brief Whether time was given.  */
   unsigned int profile_given ;	/**< @brief Whether profile was given.  */
@@ -195,8 +244,11 @@ struct gengetopt_args_info
   unsigned int qps_min_given ;	/**< @brief Whether qps_min was given.  */
   unsigned int qps_target_given ;	/**< @brief Whether qps_target was given.  */
   unsigned int qps_seed_given ;	/**< @brief Whether qps_seed was given.  */
+  unsigned int seed_given ;	/**< @brief Whether seed was given.  */
   unsigned int username_given ;	/**< @brief Whether username was given.  */
   unsigned int password_given ;	/**< @brief Whether password was given.  */
+  unsigned int meta_replies_given ;	/**< @brief Whether meta_replies was given.  */
+  unsigned int meta_base64_given ;	/**< @brief Whether meta_base64 was given.  */
   unsigned int threads_given ;	/**< @brief Whether threads was given.  */
   unsigned int affinity_given ;	/**< @brief Whether affinity was given.  */
   unsigned int connections_given ;	/**< @brief Whether connections was given.  */
@@ -205,14 +257,28 @@ struct gengetopt_args_info
   unsigned int iadist_given ;	/**< @brief Whether iadist was given.  */
   unsigned int skip_given ;	/**< @brief Whether skip was given.  */
   unsigned int moderate_given ;	/**< @brief Whether moderate was given.  */
+  unsigned int cdf_tables_given ;	/**< @brief Whether cdf_tables was given.  */
   unsigned int noload_given ;	/**< @brief Whether noload was given.  */
   unsigned int loadonly_given ;	/**< @brief Whether loadonly was given.  */
+  unsigned int replay_given ;	/**< @brief Whether replay was given.  */
+  unsigned int replay_speed_given ;	/**< @brief Whether replay_speed was given.  */
   unsigned int blocking_given ;	/**< @brief Whether blocking was given.  */
+  unsigned int timer_spin_given ;	/**< @brief Whether timer_spin was given.  */
   unsigned int no_nodelay_given ;	/**< @brief Whether no_nodelay was given.  */
+  unsigned int engine_given ;	/**< @brief Whether engine was given.  */
+  unsigned int clock_given ;	/**< @brief Whether clock was given.  */
   unsigned int warmup_given ;	/**< @brief Whether warmup was given.  */
   unsigned int wait_given ;	/**< @brief Whether wait was given.  */
   unsigned int save_given ;	/**< @brief Whether save was given.  */
+  unsigned int hdr_digits_given ;	/**< @brief Whether hdr_digits was given.  */
+  unsigned int hdr_max_given ;	/**< @brief Whether hdr_max was given.  */
+  unsigned int live_given ;	/**< @brief Whether live was given.  */
+  unsigned int live_format_given ;	/**< @brief Whether live_format was given.  */
   unsigned int search_given ;	/**< @brief Whether search was given.  */
+  unsigned int search_window_given ;	/**< @brief Whether search_window was given.  */
+  unsigned int slo_given ;	/**< @brief Whether slo was given.  */
+  unsigned int slo_window_given ;	/**< @brief Whether slo_window was given.  */
+  unsigned int slo_control_given ;	/**< @brief Whether slo_control was given.  */
   unsigned int scan_given ;	/**< @brief Whether scan was given.  */
   unsigned int trace_given ;	/**< @brief Whether trace was given.  */
   unsigned int getq_size_given ;	/**< @brief Whether getq_size was given.  */
@@ -7,7 +7,7 @@
 #define HAVE_LIBEVENT 1
 
 /* Set to 1 if EVENT_BASE_FLAG_PRECISE_TIMER is defined. */
-/* #undef HAVE_DECL_EVENT_BASE_FLAG_PRECISE_TIMER */
+#define HAVE_DECL_EVENT_BASE_FLAG_PRECISE_TIMER 1
 
 /* Define to 1 if you have the `pthread' library. */
 #define HAVE_LIBPTHREAD 1
@@ -19,6 +19,9 @@
 /* #undef HAVE_LIBZMQ */
 #define HAVE_LIBZMQ 1
 
+/* Define to 1 if <linux/io_uring.h> is available (--engine=uring). */
+#define HAVE_IO_URING 1
+
 /* Define to 1 if the system has the function `pthread_barrier_init'. */
 #define HAVE_PTHREAD_BARRIER_INIT 1
 
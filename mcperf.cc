@@ -4,6 +4,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/resource.h>
 #include <sys/socket.h>
 #include <sys/types.h>
 #include <time.h>
@@ -12,6 +13,7 @@
 
 #include <iostream>
 
+#include <map>
 #include <queue>
 #include <string>
 #include <vector>
@@ -38,8 +40,12 @@
 #include "cmdline.h"
 #include "Connection.h"
 #include "ConnectionOptions.h"
+#include "LiveStats.h"
 #include "log.h"
 #include "mcperf.h"
+#include "TimerWheel.h"
+#include "Trace.h"
+#include "UringEngine.h"
 #include "util.h"
 #include "cpu_stat_thread.h"
 
@@ -58,26 +64,59 @@ using namespace std::chrono;
 
 gengetopt_args_info args;
 char random_char[2 * 1024 * 1024];  // Buffer used to generate random values.
+Trace *replay_trace = NULL;  // --replay, shared by all threads.
 
 #ifdef HAVE_LIBZMQ
 vector<zmq::socket_t*> agent_sockets;
-zmq::context_t context(1);
+// Never destroyed: zmq_ctx_term() would block an exit() (a DIE) while
+// agent_sockets are still open.
+zmq::context_t &context = *new zmq::context_t(1);
 #endif
 
 struct thread_data {
   const vector<string> *servers;
   options_t *options;
   bool master;  // Thread #0, not to be confused with agent master.
+  int thread_id;
 #ifdef HAVE_LIBZMQ
   zmq::socket_t *socket;
 #endif
 };
 
+// --search or --slo target.  The online search (--search_window) and
+// the --slo controller also leave what they found here.
+struct target_data {
+  int n;             // Percentile, unless avg.
+  bool avg;
+  double x;          // Latency limit (us).
+  const char *name;  // n or "avg", for messages.
+  double peak_qps;
+  int qps;           // Measured at the end, 0 if unpaced.
+  int windows, met;  // --slo windows, and those that met the target.
+  double met_qps;    // Sum of the QPS of those that did.
+};
+struct target_data latency_target;
+
+#define SEARCH_MIN_WINDOWS 3      // Per probe, after one to settle.
+#define SEARCH_MAX_WINDOWS 10
+#define CONTROL_MAX_TIME   86400  // Seconds; bounds a controlled run.
+
+// --slo_control aimd: add SLO_AIMD_ADD of the starting QPS after a
+// window that met the target, else scale by SLO_AIMD_MUL.
+#define SLO_AIMD_ADD 0.02
+#define SLO_AIMD_MUL 0.8
+// --slo_control pid: gains on the relative latency headroom
+// (X - latency) / X, applied to the QPS in velocity form.
+#define SLO_PID_KP 0.3
+#define SLO_PID_KI 0.2
+#define SLO_PID_KD 0.05
+
 // struct evdns_base *evdns;
 
 pthread_barrier_t barrier;
 
 double boot_time;
+uint64_t boot_ticks;  // boot_time in get_ticks() units.
 
 void init_random_stuff();
 
@@ -95,7 +134,8 @@ char const *command_string[] = {
 };
 
 void do_mcperf(const vector<string> &servers, options_t &options,
-                 ConnectionStats &stats, bool master = true
+                 ConnectionStats &stats, bool master = true,
+                 int thread_id = 0
 #ifdef HAVE_LIBZMQ
 , zmq::socket_t* socket = NULL
 #endif
@@ -254,7 +294,7 @@ static bool s_send (zmq::socket_t &socket, const std::string &string) {
  * However, neither the master nor the agent know at this point how
  * many total connections will be made to the memcached server.
  *
- * 2. Agent -> Master: int num = (--threads) * (--lambda_mul)
+ * 2. Agent -> Master: int num = (--threads) * (--lambda_mul), int threads
  *
  * The agent sends a number to the master indicating how many threads
  * this mcperf agent will spawn, and a mutiplier that weights how
@@ -263,7 +303,7 @@ static bool s_send (zmq::socket_t &socket, const std::string &string) {
  * agent or an agent on a really fast network connection be more
  * aggressive than other agents or the master).
  *
- * 3. Master -> Agent: lambda_denom
+ * 3. Master -> Agent: lambda_denom, load_first, load_count
  *
  * The master aggregates all of the numbers collected in (2) and
  * computes a global "lambda_denom".  Which is essentially a count of
@@ -278,6 +318,10 @@ static bool s_send (zmq::socket_t &socket, const std::string &string) {
  *
  *   lambda = qps / lambda_denom * args.lambda_mul;
  *
+ * load_first and load_count give the agent's share of the records to
+ * load, in proportion to its thread count (all of them under
+ * --roundrobin).
+ *
  * RUN PHASE
  *
  * After the PREP phase completes, everyone executes do_mcperf().
@@ -289,8 +333,8 @@ static bool s_send (zmq::socket_t &socket, const std::string &string) {
  * [IF WARMUP]  0:  Everyone: RUN for options.warmup seconds.
  * 1. Master <-> Agent: Synchronize
  * 2. Everyone: RUN for options.time seconds.
- * 3. Master -> Agent: Dummy message
- * 4. Agent -> Master: Send AgentStats [w/ RX/TX bytes, # gets/sets]
+ * 3. Master -> Agent: "stats" (sent to all agents before collecting)
+ * 4. Agent -> Master: AgentStats in one message (see AgentStatsWire)
  *
  * The master then aggregates AgentStats across all agents with its
  * own ConnectionStats to compute overall statistics.
@@ -304,6 +348,7 @@ void prep_agent(const vector<string>& servers, options_t& options) {
     sum = args.measure_connections_arg * options.server_given * options.threads;
 
   int master_sum = sum;
+  std::map<zmq::socket_t*, int> agent_threads;
   if (args.measure_qps_given) {
     sum = 0;
     if (options.qps) options.qps -= args.measure_qps_arg;
@@ -316,6 +361,7 @@ void prep_agent(const vector<string>& servers, options_t& options) {
     aid++;
 
     V("Agent %d prep ", aid);
+      options.agent_id = aid;
       memcpy((void *) message.data(), &options, sizeof(options_t));
       status=poll_send(*s,message);
     D("Agent %d prep send = %s", aid, status?"true":"false");
@@ -330,7 +376,9 @@ void prep_agent(const vector<string>& servers, options_t& options) {
       its--; // adjust the iterator since we did not iterate over the next agent
       continue;
     }
-      unsigned int num = *((int *) rep.data());
+      unsigned int num = ((int *) rep.data())[0];
+      agent_threads[s] = rep.size() >= 2 * sizeof(int) ?
+        ((int *) rep.data())[1] : num;
 
       sum += options.connections * (options.roundrobin ?
               (servers.size() > num ? servers.size() : num) : 
@@ -354,6 +402,7 @@ void prep_agent(const vector<string>& servers, options_t& options) {
       its--; // adjust the iterator since we did not iterate over the next agent
     }
   }
+  options.agent_id = 0;
 
   //
   // Dynamic operation
@@ -443,10 +492,30 @@ void prep_agent(const vector<string>& servers, options_t& options) {
 
   if (args.measure_depth_given) options.depth = args.measure_depth_arg;
 
+  // Split the records to load by thread count; the master takes the
+  // first slice.  With --roundrobin every instance loads them all.
+  int64_t total_threads = options.threads;
+  for (auto s : agent_sockets) total_threads += agent_threads[s];
+  int64_t records = options.load_count, before = options.threads;
+  if (!options.roundrobin && total_threads > 0)
+    options.load_count = records * options.threads / total_threads;
+  options.total_threads = total_threads;
+
   for ( its=agent_sockets.begin(); its!=agent_sockets.end(); its++ ) {
     zmq::socket_t *s=*its;
-    zmq::message_t message(sizeof(sum));
-    *((int *) message.data()) = sum;
+    zmq::message_t message(5 * sizeof(int));
+    int *msg = (int *) message.data();
+    msg[0] = sum;
+    msg[1] = 0;
+    msg[2] = records;
+    msg[3] = before;
+    msg[4] = total_threads;
+    if (!options.roundrobin && total_threads > 0) {
+      int64_t after = before + agent_threads[s];
+      msg[1] = records * before / total_threads;
+      msg[2] = records * after / total_threads - msg[1];
+    }
+    before += agent_threads[s];
     poll_send(*s,message);
     string rep = s_recv(*s);
 
@@ -465,6 +534,10 @@ void prep_agent(const vector<string>& servers, options_t& options) {
   V("MASTER SLEEPS"); sleep_time(1.5);
 }
 
+// An agent whose master asked for the stats before the agent's own run
+// ended: the run is cut short and the request is answered after it.
+static std::atomic<bool> stats_requested(false);
+
 // ----------------------------------------------------------------------------------------------------
 void agent() {
   zmq::context_t context(1);
@@ -479,13 +552,16 @@ int lid=0;
     socket.recv(&request);
 lid++;
 
-    zmq::message_t num(sizeof(int));
-    *((int *) num.data()) = args.threads_arg * args.lambda_mul_arg;
+    zmq::message_t num(2 * sizeof(int));
+    ((int *) num.data())[0] = args.threads_arg * args.lambda_mul_arg;
+    ((int *) num.data())[1] = args.threads_arg;
     socket.send(num);
 V("sent num %d",lid);
     options_t options;
     memcpy(&options, request.data(), sizeof(options));
 V("Got options: %d %s",options.connections,options.loadonly ? "loadonly" : options.noload ? "noload" : "");
+    HdrHistogramSampler::configure(options.hdr_digits, options.hdr_max_us);
+    clock_init(options.clock);
 
 	//get a string containing the servers, and parse it to extract all servers
 	string server_opt=s_recv(socket);
@@ -511,9 +587,21 @@ V("sent ack");
       V("sent tnx 1");
     }
     
-    // Get lambda adjusted
+    // Get lambda adjusted, and our share of the records to load
     socket.recv(&request);
-    options.lambda_denom = *((int *) request.data());
+    options.lambda_denom = ((int *) request.data())[0];
+    if (request.size() >= 3 * sizeof(int)) {
+      options.load_first = ((int *) request.data())[1];
+      options.load_count = ((int *) request.data())[2];
+    }
+    options.thread_offset = 0;
+    options.total_threads = options.threads;
+    if (request.size() >= 5 * sizeof(int)) {
+      options.thread_offset = ((int *) request.data())[3];
+      options.total_threads = ((int *) request.data())[4];
+    }
+    if (options.replay[0] && replay_trace == NULL)
+      replay_trace = new Trace(options.replay);
     s_send(socket, "THANKS");
     V("sent tnx 2");
 
@@ -545,104 +633,29 @@ V("launching go");
 
 V("Done run.");
     // Run done. Send the stats back to the master.
-#ifdef STATIC_ALLOC_SAMPLER
-    AgentStats as = AgentStats();
-
-    as.rx_bytes = stats.rx_bytes;
-    as.tx_bytes = stats.tx_bytes;
-    as.gets = stats.gets;
-    as.sets = stats.sets;
-    as.get_misses = stats.get_misses;
-    as.start = stats.start;
-    as.stop = stats.stop;
-    as.skips = stats.skips;
-    
-    for(int i = 0; i < options.n_intervals; i++){
-      as.gets_dyn[i] = stats.gets_dyn[i];
-      as.sets_dyn[i] = stats.sets_dyn[i];
-    }
-    
-    for(int i = 0; i < options.n_intervals; i++) {
-      for (int j = 0; j < LOGSAMPLER_BINS; j++) {
-        as.get_bins[i][j]=stats.get_sampler.bins[i][j];
-      }
-      as.get_sum[i] = stats.get_sampler.sum[i];
-      as.get_sum_sq[i] = stats.get_sampler.sum_sq[i];
-    } 
-
-    // Send to master
-    string req = s_recv(socket);
-    V("req = %s", req.c_str());
-    request.rebuild(sizeof(as));
-    memcpy(request.data(), &as, sizeof(as));
-    socket.send(request);
-    V("send = %s", req.c_str());
-#else 
-    AgentStats as = AgentStats(options.n_intervals);
-
-    as.bs.rx_bytes = stats.rx_bytes;
-    as.bs.tx_bytes = stats.tx_bytes;
-    as.bs.gets = stats.gets;
-    as.bs.sets = stats.sets;
-    as.bs.get_misses = stats.get_misses;
-    as.bs.start = stats.start;
-    as.bs.stop = stats.stop;
-    as.bs.skips = stats.skips;
-    
-    for(int i = 0; i < options.n_intervals; i++){
-      as.gets_dyn[i] = stats.gets_dyn[i];
-      as.sets_dyn[i] = stats.sets_dyn[i];
-    }
-    
-    for(int i = 0; i < options.n_intervals; i++) {
-      for (int j = 0; j < LOGSAMPLER_BINS; j++) {
-        as.get_bins[i][j]=stats.get_sampler.bins[i][j];
-      }
-      as.get_sum[i] = stats.get_sampler.sum[i];
-      as.get_sum_sq[i] = stats.get_sampler.sum_sq[i];
-    }
-
-    // Send to master
-    string req = s_recv(socket);
-    request.rebuild(sizeof(as.bs));
-    memcpy(request.data(), &(as.bs), sizeof(as.bs));
-    socket.send(request);
-
-    req = s_recv(socket);
-    request.rebuild(options.n_intervals * sizeof(uint64_t));
-    memcpy(request.data(), as.gets_dyn, options.n_intervals * sizeof(uint64_t));
-    socket.send(request);
-
-    req = s_recv(socket);
-    request.rebuild(options.n_intervals * sizeof(uint64_t));
-    memcpy(request.data(), as.sets_dyn, options.n_intervals * sizeof(uint64_t));
-    socket.send(request);
-
-    for(int i = 0; i < options.n_intervals; i++) {
-      req = s_recv(socket);
-      request.rebuild(LOGSAMPLER_BINS * sizeof(uint64_t));
-      memcpy(request.data(), as.get_bins[i], LOGSAMPLER_BINS * sizeof(uint64_t));
+    AgentStats as(options.n_intervals, stats.get_sampler.counts_len);
+    stats.export_stats(as);
+
+    // Send to master, as one message in reply to its "stats" request.
+    string wire;
+    AgentStatsWire::encode(as, wire);
+
+    string req = stats_requested ? "stats" : s_recv(socket);
+    while (req == "live") {
+      // A --live request that raced with the end of the run.
+      string empty;
+      AgentStats none(1, as.counts_len);
+      AgentStatsWire::encode(none, empty);
+      request.rebuild(empty.size());
+      memcpy(request.data(), empty.data(), empty.size());
       socket.send(request);
+      req = s_recv(socket);
     }
-
-    req = s_recv(socket);
-    request.rebuild(options.n_intervals * sizeof(double));
-    memcpy(request.data(), as.get_sum, options.n_intervals * sizeof(double));
+    V("req = %s, replying with %zu bytes", req.c_str(), wire.size());
+    request.rebuild(wire.size());
+    memcpy(request.data(), wire.data(), wire.size());
     socket.send(request);
 
-    req = s_recv(socket);
-    request.rebuild(options.n_intervals * sizeof(uint64_t));
-    memcpy(request.data(), as.get_sum_sq, options.n_intervals * sizeof(double));
-    socket.send(request);   
-
-    //std::cout << "SENDING" << std::endl;
-    //as.print_base();
-    //as.print_dyn();
-    //as.print_bins();
-    //as.print_sum();
-
-#endif
-
   if (log_level > DEBUG) {
 		stats.print_header(false);
 		printf(" QPS\n");
@@ -660,66 +673,38 @@ V("Done run.");
 
 // ----------------------------------------------------------------------------------------------------
 void finish_agent(ConnectionStats &stats, int n_intervals) {
-	int aid=0;
-  //for (auto s: agent_sockets) {
+  int aid=0;
+  double start = get_time();
   vector<zmq::socket_t*>::iterator its;
+
+  // Ask every agent first, so they all serialize their stats
+  // concurrently, then collect the replies.
   for ( its=agent_sockets.begin(); its!=agent_sockets.end(); its++ ) {
-    zmq::socket_t *s=*its;
-	  aid++;
-	  bool status;
+    aid++;
+    if (!s_send(**its, "stats")) W("Agent %d stats request failed.", aid);
+  }
 
-#ifdef STATIC_ALLOC_SAMPLER
-// Static allocation
-    AgentStats as = AgentStats();
-    zmq::message_t message;
-    
-    status = s_send(*s, "stats");
-    D("Agent %d finish send = %s", aid, status?"true":"false");
-    status = poll_recv(*s, &message);
-    memcpy(&as, message.data(), sizeof(as));
-    D("Agent %d finish recv = %s", aid, status?"true":"false");
-#else
-// Dynamic allocation
-    AgentStats as = AgentStats(n_intervals);
+  aid=0;
+  for ( its=agent_sockets.begin(); its!=agent_sockets.end(); its++ ) {
+    zmq::socket_t *s=*its;
     zmq::message_t message;
-    
-    status = s_send(*s, "stats");
-    status = poll_recv(*s, &message);
-    memcpy(&(as.bs), message.data(), sizeof(as.bs));
-
-    status = s_send(*s, "gets_dyn");
-    status = poll_recv(*s, &message);
-    memcpy(as.gets_dyn, message.data(), n_intervals * sizeof(uint64_t));
-
-    status = s_send(*s, "sets_dyn");
-    status = poll_recv(*s, &message);
-    memcpy(as.sets_dyn, message.data(), n_intervals * sizeof(uint64_t));
-
-    for(int i = 0; i < n_intervals; i++) {
-      status = s_send(*s, "bins" + i);
-      status = poll_recv(*s, &message);
-      memcpy(as.get_bins[i], message.data(), LOGSAMPLER_BINS * sizeof(uint64_t));
-    }
-
-    status = s_send(*s, "sum");
-    status = poll_recv(*s, &message);
-    memcpy(as.get_sum, message.data(), n_intervals * sizeof(double));
+    aid++;
 
-    status = s_send(*s, "sum_sq");
-    status = poll_recv(*s, &message);
-    memcpy(as.get_sum_sq, message.data(), n_intervals * sizeof(double));
+    if (!poll_recv(*s, &message)) {
+      W("Agent %d sent no stats.", aid);
+      continue;
+    }
 
-    //std::cout << "RECEIVED" << std::endl;
-    //as.print_base();
-    //as.print_dyn();
-    //as.print_bins();
-    //as.print_sum();
+    AgentStats as(n_intervals, stats.get_sampler.counts_len);
+    const char *err = AgentStatsWire::decode(as, message.data(), message.size());
+    if (err) DIE("Agent %d: %s.", aid, err);
+    D("Agent %d sent %zu bytes of stats", aid, message.size());
 
-#endif
-    // Finally accumulate
     stats.accumulate(as);
   }
 
+  V("Collected stats from %d agents in %.3f ms", aid,
+    (get_time() - start) * 1000);
 }
 
 /*
@@ -901,6 +886,11 @@ int main(int argc, char **argv) {
   if (!args.server_given && !args.agentmode_given)
     DIE("--server or --agentmode must be specified.");
 
+  // Agents take the master's seed with its options.
+  if (!args.seed_given)
+    args.seed_arg = (unsigned int) (get_time_accurate() * 1e6) ^ getpid();
+  if (!args.agentmode_given) V("Random seed = %u", (unsigned int) args.seed_arg);
+
   // TODO: Discover peers, share arguments.
 
   init_random_stuff();
@@ -916,6 +906,7 @@ int main(int argc, char **argv) {
   options_t options;
   bzero(&options, sizeof(options_t));
   args_to_options(&options);
+  boot_ticks = get_ticks();
 
 #ifdef HAVE_LIBZMQ
   if (args.agentmode_given) {
@@ -1017,69 +1008,107 @@ int main(int argc, char **argv) {
     if (avgseek) I("Search-mode.  Find QPS @ %dus avg latency.", x, n);
     else I("Search-mode.  Find QPS @ %dus %dth percentile.", x, n);
 
-	//first determine max qps without paying attention to latency. 
-    int high_qps = 10000000;
-    int low_qps = 1; // 5000;
-    double nth;
-    int cur_qps;
+    latency_target.n = n;
+    latency_target.avg = avgseek;
+    latency_target.x = x;
+    latency_target.name = n_ptr;
+    latency_target.peak_qps = 0.0;
+    latency_target.qps = options.qps;
 
-    go(servers, options, stats, start, end);
+    // One run; the search itself runs in go().
+    if (options.control_ms > 0) {
+      go(servers, options, stats, start, end);
+      peak_qps = latency_target.peak_qps;
+      options.qps = latency_target.qps;
+      options.lambda = (double) options.qps / options.lambda_denom *
+        args.lambda_mul_arg;
+    } else {
+      //first determine max qps without paying attention to latency. 
+      int high_qps = 10000000;
+      int low_qps = 1; // 5000;
+      double nth;
+      int cur_qps;
 
-    if (avgseek) nth=stats.get_avg();
-    else nth = stats.get_nth(n);
-    peak_qps = stats.get_qps();
-    high_qps = stats.get_qps();
-    cur_qps = stats.get_qps();
+      go(servers, options, stats, start, end);
 
-    I("peak qps = % 8d, %s = %.1f", high_qps, n_ptr, nth);
-	//if latency at peak more then requested, search for requested latency setting to middle point between current and a point with known good latency
-	//continue searching until the boundary between known good and current is ~5%
+      if (avgseek) nth=stats.get_avg();
+      else nth = stats.get_nth(n);
+      peak_qps = stats.get_qps();
+      high_qps = stats.get_qps();
+      cur_qps = stats.get_qps();
 
-    if (nth > x) {
-    while ((high_qps > low_qps * 1.02) && cur_qps > (peak_qps * .01)) {
-      cur_qps = (high_qps + low_qps) / 2;
+      I("peak qps = % 8d, %s = %.1f", high_qps, n_ptr, nth);
+      //if latency at peak more then requested, search for requested latency setting to middle point between current and a point with known good latency
+      //continue searching until the boundary between known good and current is ~5%
 
-      args_to_options(&options);
+      if (nth > x) {
+      while ((high_qps > low_qps * 1.02) && cur_qps > (peak_qps * .01)) {
+        cur_qps = (high_qps + low_qps) / 2;
 
-      options.qps = cur_qps;
-      options.lambda = (double) options.qps / (double) options.lambda_denom * args.lambda_mul_arg;
+        args_to_options(&options);
 
-      stats.~ConnectionStats();
-      new(&stats) ConnectionStats();
+        options.qps = cur_qps;
+        options.lambda = (double) options.qps / (double) options.lambda_denom * args.lambda_mul_arg;
 
-      go(servers, options, stats, start, end);
+        stats.~ConnectionStats();
+        new(&stats) ConnectionStats();
 
-      if (avgseek) nth=stats.get_avg();
-      else nth = stats.get_nth(n);
+        go(servers, options, stats, start, end);
 
-      I(". target = % 8d, %s = %.1f, high_qps = %d, low_qps = %d, qps = %.0f", cur_qps,n_ptr,nth, high_qps, low_qps, stats.get_qps());
+        if (avgseek) nth=stats.get_avg();
+        else nth = stats.get_nth(n);
 
-      if (nth > x /*|| cur_qps > stats.get_qps() * 1.05*/) high_qps = cur_qps;
-      else low_qps = cur_qps;
-    }
+        I(". target = % 8d, %s = %.1f, high_qps = %d, low_qps = %d, qps = %.0f", cur_qps,n_ptr,nth, high_qps, low_qps, stats.get_qps());
 
-	// now if last value found at conversion has latency over the limit, use the last value before latency came within bounds, 
-	// and decrease requested qps by 1% until latency comes within bounds, or we go below 90% of previously found value.
-    while (nth > x && cur_qps > (peak_qps * .01) && cur_qps > (low_qps * 0.90)) {
-      cur_qps = cur_qps * 99 / 100;
+        if (nth > x /*|| cur_qps > stats.get_qps() * 1.05*/) high_qps = cur_qps;
+        else low_qps = cur_qps;
+      }
 
-      args_to_options(&options);
+      // now if last value found at conversion has latency over the limit, use the last value before latency came within bounds, 
+      // and decrease requested qps by 1% until latency comes within bounds, or we go below 90% of previously found value.
+      while (nth > x && cur_qps > (peak_qps * .01) && cur_qps > (low_qps * 0.90)) {
+        cur_qps = cur_qps * 99 / 100;
 
-      options.qps = cur_qps;
-      options.lambda = (double) options.qps / (double) options.lambda_denom * args.lambda_mul_arg;
+        args_to_options(&options);
 
-      stats.~ConnectionStats();
-      new(&stats) ConnectionStats();
+        options.qps = cur_qps;
+        options.lambda = (double) options.qps / (double) options.lambda_denom * args.lambda_mul_arg;
 
-      go(servers, options, stats, start, end);
+        stats.~ConnectionStats();
+        new(&stats) ConnectionStats();
 
-      if (avgseek) nth=stats.get_avg();
-      else nth = stats.get_nth(n);
+        go(servers, options, stats, start, end);
 
-      I(". target = % 8d, %s = %.1f, high_qps = %d, low_qps = %d, qps = %.0f", cur_qps,n_ptr,nth, high_qps, low_qps, stats.get_qps());
-    }
+        if (avgseek) nth=stats.get_avg();
+        else nth = stats.get_nth(n);
+
+        I(". target = % 8d, %s = %.1f, high_qps = %d, low_qps = %d, qps = %.0f", cur_qps,n_ptr,nth, high_qps, low_qps, stats.get_qps());
+      }
 
+      if (nth > x)
+        W("No QPS tried met %s <= %dus; reporting the last, %d QPS (%s = %.1f).",
+          n_ptr, x, cur_qps, n_ptr, nth);
+      }
     }
+  } else if (args.slo_given) {
+    char *n_ptr = strtok(args.slo_arg, ":");
+    char *x_ptr = strtok(NULL, ":");
+
+    if (n_ptr == NULL || x_ptr == NULL) DIE("Invalid --slo argument");
+
+    latency_target.avg = strstr("avg", n_ptr) != NULL;
+    latency_target.n = atoi(n_ptr);
+    latency_target.x = atoi(x_ptr);
+    latency_target.name = n_ptr;
+
+    if (latency_target.avg)
+      I("SLO-mode.  Track the QPS @ %dus avg latency (%s).", atoi(x_ptr),
+        args.slo_control_arg);
+    else
+      I("SLO-mode.  Track the QPS @ %dus %dth percentile (%s).", atoi(x_ptr),
+        latency_target.n, args.slo_control_arg);
+
+    go(servers, options, stats, start, end);
   } else if (args.scan_given) {
     char *min_ptr = strtok(args.scan_arg, ":");
     char *max_ptr = strtok(NULL, ":");
@@ -1165,6 +1194,9 @@ int main(int argc, char **argv) {
     printf("TX %10" PRIu64 " bytes : %6.1f MB/s\n",
            stats.tx_bytes,
            (double) stats.tx_bytes / 1024 / 1024 / (stats.stop - stats.start));
+
+    printf("Client CPU = %.2f us/req (%s engine)\n",
+           stats.client_cpu / total * 1000000, args.engine_arg);
   }
 
   else if (!args.scan_given && !args.loadonly_given) {
@@ -1174,6 +1206,11 @@ int main(int argc, char **argv) {
     stats.print_header();
     stats.print_stats("read",   stats.get_sampler, true, true);
     stats.print_stats("update", stats.set_sampler);
+    if (options.lambda > 0.0 || options.replay[0] || args.slo_given) {
+      stats.print_stats("read_co", stats.get_co_sampler);
+      stats.print_stats("upd_co",  stats.set_co_sampler);
+      stats.print_stats("tx_lag",  stats.tx_lag_sampler);
+    }
     stats.print_stats("op_q",   stats.op_sampler);
 
     float total = (float)(stats.gets + stats.sets);
@@ -1185,6 +1222,14 @@ int main(int argc, char **argv) {
     if (args.search_given && peak_qps > 0.0)
       printf("Peak QPS  = %.1f\n", peak_qps);
 
+    if (args.slo_given && latency_target.windows > 0)
+      printf("SLO QPS   = %.1f (%d of %d windows met %s%s <= %.0fus)\n",
+             latency_target.met ?
+             latency_target.met_qps / latency_target.met : 0.0,
+             latency_target.met, latency_target.windows,
+             latency_target.avg ? "" : "p", latency_target.name,
+             latency_target.x);
+
     printf("\n");
 	
 	  printf("Total connections = %d\n", options.connections * options.server_given * options.threads);
@@ -1202,6 +1247,9 @@ int main(int argc, char **argv) {
            stats.tx_bytes,
            (double) stats.tx_bytes / 1024 / 1024 / (stats.stop - stats.start));
 
+    printf("Client CPU = %.2f us/req (%s engine)\n",
+           stats.client_cpu / total * 1000000, args.engine_arg);
+
     if (args.save_given) {
       printf("Saving latency samples to %s.\n", args.save_arg);
 
@@ -1210,7 +1258,8 @@ int main(int argc, char **argv) {
         DIE("--save: failed to open %s: %s", args.save_arg, strerror(errno));
 	std::vector<Operation>::const_iterator i;
       for ( i= stats.get_sampler.samples.begin(); i!=stats.get_sampler.samples.end(); i++) {
-        fprintf(file, "%f %f\n", i->start_time - boot_time, i->time());
+        fprintf(file, "%f %f\n",
+                ticks_to_us(i->start_time - boot_ticks) / 1000000, i->time());
       }
     }
     
@@ -1242,12 +1291,480 @@ int main(int argc, char **argv) {
   return 0;
 }
 
+/*
+ * Live reporting (--live).  The reporter thread waits until the
+ * measurement starts (live_running, set by the master thread after the
+ * final synchronization) and stops when go() sets live_stop.
+ *
+ * On the master it prints one row per period, including the deltas of
+ * every agent: it sends "live" to all agents and each replies with its
+ * own deltas as an AgentStats message.  On an agent it answers those
+ * requests.  The agent socket is only touched by the reporter while the
+ * run is in progress, so it never races the setup or stats exchange.
+ */
+static std::atomic<bool> live_running(false), live_stop(false);
+
+struct live_data {
+  options_t *options;
+#ifdef HAVE_LIBZMQ
+  zmq::socket_t *socket;
+#endif
+};
+
+// How long live_collect() waits for threads to publish a period.
+static int live_grace_ms(const options_t &options) {
+  int period = options.live_ms > 0 ? options.live_ms : options.control_ms;
+  return std::max(1, std::min(10, period / 10));
+}
+
+#ifdef HAVE_LIBZMQ
+// Add every agent's deltas since its last "live" request into as.  A
+// reply that does not come within --poll_max is fatal: the agent's
+// REQ socket would still await it, and a late one would be read as
+// the next period's deltas.
+static void agents_live_collect(AgentStats &as) {
+  if (!args.agent_given) return;
+
+  vector<zmq::socket_t*>::iterator its;
+  for (its=agent_sockets.begin(); its!=agent_sockets.end(); its++)
+    s_send(**its, "live");
+
+  int aid = 0;
+  for (its=agent_sockets.begin(); its!=agent_sockets.end(); its++) {
+    zmq::message_t message;
+    AgentStats delta(1, as.counts_len);
+    aid++;
+
+    if (!poll_recv(**its, &message))
+      DIE("Agent %d sent no live stats within --poll_max.", aid);
+    const char *err = AgentStatsWire::decode(delta, message.data(),
+                                             message.size());
+    if (err) DIE("Agent live stats: %s.", err);
+    live_merge(as, delta);
+  }
+}
+
+// Send a control request to every agent and wait for the "ack"s,
+// which, as in agents_live_collect(), must come within --poll_max.
+static void agents_command(const string &cmd) {
+  if (!args.agent_given) return;
+
+  vector<zmq::socket_t*>::iterator its;
+  for (its=agent_sockets.begin(); its!=agent_sockets.end(); its++)
+    s_send(**its, cmd);
+
+  int aid = 0;
+  for (its=agent_sockets.begin(); its!=agent_sockets.end(); its++) {
+    zmq::message_t message;
+    aid++;
+    if (!poll_recv(**its, &message))
+      DIE("Agent %d did not acknowledge %s within --poll_max.", aid,
+          cmd.c_str());
+  }
+}
+#endif
+
+static bool live_wait_start() {
+  struct timespec ts = {0, 1000000};
+  while (!live_running && !live_stop) nanosleep(&ts, NULL);
+  return !live_stop;
+}
+
+void* live_thread(void *arg) {
+  struct live_data *ld = (struct live_data *) arg;
+  options_t &options = *ld->options;
+  bool json = !strcmp(args.live_format_arg, "json");
+  int counts_len = HdrHistogramSampler().counts_len;
+
+  if (!live_wait_start()) return NULL;
+
+  live_print_header(stdout, json);
+
+  double start = get_time(), last = start;
+  double next = start + options.live_ms / 1000.0;
+
+  while (!live_stop) {
+    double now = get_time();
+    if (now < next) {
+      sleep_time(std::min(next - now, 0.01));
+      continue;
+    }
+    next += options.live_ms / 1000.0;
+
+    AgentStats as(1, counts_len);
+    live_collect(as, live_grace_ms(options));
+#ifdef HAVE_LIBZMQ
+    agents_live_collect(as);
+#endif
+
+    if (!live_running) break;
+
+    now = get_time();
+    live_print(stdout, json, as, now - start, now - last);
+    last = now;
+  }
+
+  return NULL;
+}
+
+/*
+ * Online QPS control (--search_window, --slo).  Instead of restarting
+ * the run for every QPS it tries, the master's controller changes the
+ * target during one run: it publishes a new total QPS in control_qps and
+ * bumps control_qps_epoch, and every load thread, noticing the new
+ * epoch from its event loop the way LiveRecorders notice live_epoch,
+ * moves its Connections to their share of it.  Agents are sent the
+ * same changes as "qps", "reset" and "stop" requests and apply them
+ * locally.  The controller measures the windows between changes with
+ * live_collect(), so threads keep LiveRecorders as under --live.
+ */
+static std::atomic<int> control_qps(0);
+static std::atomic<uint64_t> control_qps_epoch(0);
+static std::atomic<uint64_t> control_reset_epoch(0);  // Restart stats.
+static std::atomic<bool> control_stop(false);         // End the run.
+
+static void control_set_qps(int qps) {
+  control_qps = qps;
+  control_qps_epoch++;
+#ifdef HAVE_LIBZMQ
+  agents_command("qps " + std::to_string(qps));
+#endif
+}
+
+static void control_reset() {
+  control_reset_epoch++;
+#ifdef HAVE_LIBZMQ
+  agents_command("reset");
+#endif
+}
+
+static void control_end() {
+#ifdef HAVE_LIBZMQ
+  agents_command("stop");
+#endif
+  control_stop = true;
+}
+
+/**
+ * Wait out one measurement window of ms milliseconds, ending at
+ * *next, and collect it into as; dt is its length.  False if the run
+ * ended first.
+ */
+static bool control_window(const options_t &options, double *next,
+                           AgentStats &as, double &dt) {
+  while (get_time() < *next) {
+    if (live_stop || interrupted) return false;
+    sleep_time(std::min(*next - get_time(), 0.01));
+  }
+  double start = *next - options.control_ms / 1000.0;
+  *next += options.control_ms / 1000.0;
+
+  live_collect(as, live_grace_ms(options));
+#ifdef HAVE_LIBZMQ
+  agents_live_collect(as);
+#endif
+  dt = get_time() - start;
+  return !live_stop;
+}
+
+// The --search or --slo statistic (us) of the reads and updates in as.
+static double target_metric(AgentStats &as) {
+  double v = 0.0;
+  for (int id : {AGENT_HIST_GET, AGENT_HIST_SET}) {
+    HdrHistogramSampler &h = as.hists[id];
+    if (h.total() == 0) continue;
+    v = std::max(v, latency_target.avg ? h.average() : h.get_nth(latency_target.n));
+  }
+  return v;
+}
+
+/**
+ * Measure the current target.  The first window lets the change
+ * settle and is dropped.  Then windows are taken until, over at
+ * least SEARCH_MIN_WINDOWS of them, the per-window statistic is more
+ * than two standard errors away from the limit -- or, for the peak
+ * probe, the QPS is steady to within 1% -- or SEARCH_MAX_WINDOWS have
+ * passed.  qps and metric are over all windows taken.
+ */
+static bool search_probe(const options_t &options, bool peak,
+                         double &qps, double &metric) {
+  int counts_len = HdrHistogramSampler().counts_len;
+  double next = get_time() + options.control_ms / 1000.0, dt, t = 0.0;
+  AgentStats total(1, counts_len);
+  vector<double> v;
+
+  {
+    AgentStats settle(1, counts_len);
+    if (!control_window(options, &next, settle, dt)) return false;
+  }
+
+  for (int k = 1; k <= SEARCH_MAX_WINDOWS; k++) {
+    AgentStats as(1, counts_len);
+    if (!control_window(options, &next, as, dt)) return false;
+    live_merge(total, as);
+    t += dt;
+    v.push_back(peak ? (as.bs.gets + as.bs.sets) / dt : target_metric(as));
+    if (k < SEARCH_MIN_WINDOWS) continue;
+
+    double mean = 0.0, var = 0.0;
+    for (double x : v) mean += x;
+    mean /= k;
+    for (double x : v) var += (x - mean) * (x - mean);
+    double se = sqrt(var / (k - 1) / k);
+
+    if (peak ? se < 0.01 * mean : fabs(mean - latency_target.x) > 2 * se) break;
+  }
+
+  qps = (total.bs.gets + total.bs.sets) / t;
+  metric = target_metric(total);
+  return true;
+}
+
+/*
+ * The online --search, on the master.  Same search as the one in
+ * main(): measure the peak, then bisect between 1 and the peak until
+ * the bounds are within 2%, and step down by 1% while the last probe
+ * misses the limit.  The run ends with -t seconds of measurement at
+ * the QPS the search ended on, which go() returns as the run's stats;
+ * a warning says so if even that missed the limit.
+ */
+void* search_thread(void *arg) {
+  struct live_data *ld = (struct live_data *) arg;
+  options_t &options = *ld->options;
+  double qps, nth;
+  int final_qps;
+
+  if (!live_wait_start()) return NULL;
+
+  if (!search_probe(options, true, qps, nth)) goto stop;
+  latency_target.peak_qps = qps;
+  I("peak qps = % 8d, %s = %.1f", (int) qps, latency_target.name, nth);
+
+  final_qps = options.qps;  // The peak: keep running as started.
+  if (nth > latency_target.x) {
+    int high_qps = qps, low_qps = 1, cur_qps = qps;
+
+    while (high_qps > low_qps * 1.02 && cur_qps > latency_target.peak_qps * .01) {
+      cur_qps = (high_qps + low_qps) / 2;
+      control_set_qps(cur_qps);
+      if (!search_probe(options, false, qps, nth)) goto stop;
+
+      I(". target = % 8d, %s = %.1f, high_qps = %d, low_qps = %d, qps = %.0f",
+        cur_qps, latency_target.name, nth, high_qps, low_qps, qps);
+
+      if (nth > latency_target.x) high_qps = cur_qps;
+      else low_qps = cur_qps;
+    }
+
+    // As in main(): if the last probe is over the limit, step down by
+    // 1% until it is met, or we go below 90% of the last good QPS.
+    while (nth > latency_target.x && cur_qps > latency_target.peak_qps * .01 &&
+           cur_qps > low_qps * 0.90) {
+      cur_qps = cur_qps * 99 / 100;
+      control_set_qps(cur_qps);
+      if (!search_probe(options, false, qps, nth)) goto stop;
+
+      I(". target = % 8d, %s = %.1f, high_qps = %d, low_qps = %d, qps = %.0f",
+        cur_qps, latency_target.name, nth, high_qps, low_qps, qps);
+    }
+
+    if (nth > latency_target.x)
+      W("No QPS tried met %s <= %.0fus; measuring the last, %d QPS (%s = %.1f).",
+        latency_target.name, latency_target.x, cur_qps, latency_target.name,
+        nth);
+
+    final_qps = cur_qps;
+    sleep_time(options.control_ms / 1000.0);  // Settle.
+  }
+
+  latency_target.qps = final_qps;
+  if (final_qps > 0)
+    V("Search done, measuring %d QPS for %ds.", final_qps, args.time_arg);
+  else
+    V("Search done, measuring the peak for %ds.", args.time_arg);
+  control_reset();
+  for (double end = get_time() + args.time_arg; get_time() < end;) {
+    if (live_stop || interrupted) break;
+    sleep_time(std::min(end - get_time(), 0.01));
+  }
+
+stop:
+  control_end();
+  return NULL;
+}
+
+/*
+ * --slo: for the rest of the run, after every --slo_window move the
+ * target QPS toward the highest that meets the latency target, with
+ * AIMD or a PID loop, and print the window: the target (0 while still
+ * unpaced), the QPS and statistic achieved, whether it met the target,
+ * and slo_qps, the QPS achieved within the target (0 if missed).
+ * Without --qps the first window runs unpaced and its QPS is where
+ * the controller starts.
+ */
+void* slo_thread(void *arg) {
+  struct live_data *ld = (struct live_data *) arg;
+  options_t &options = *ld->options;
+  bool json = !strcmp(args.live_format_arg, "json");
+  bool pid = !strcmp(args.slo_control_arg, "pid");
+  int counts_len = HdrHistogramSampler().counts_len;
+  double target = options.qps, start_qps = options.qps;
+  double e1 = 0.0, e2 = 0.0;  // Headroom of the last two windows.
+
+  if (!live_wait_start()) return NULL;
+
+  {
+    double start = get_time(), dt;
+    double next = start + options.control_ms / 1000.0;
+
+    if (!json) printf("#time,target,qps,latency,met,slo_qps\n");
+    fflush(stdout);
+
+    while (next <= start + args.time_arg + 1e-6) {
+      AgentStats as(1, counts_len);
+      if (!control_window(options, &next, as, dt)) break;
+
+      double qps = (as.bs.gets + as.bs.sets) / dt;
+      double lat = target_metric(as);
+      bool met = lat <= latency_target.x;
+      double t = get_time() - start;
+
+      latency_target.windows++;
+      if (met) {
+        latency_target.met++;
+        latency_target.met_qps += qps;
+      }
+
+      if (json)
+        printf("{\"time\": %.3f, \"target\": %.0f, \"qps\": %.1f, "
+               "\"latency\": %.1f, \"met\": %s, \"slo_qps\": %.1f}\n",
+               t, target, qps, lat, met ? "true" : "false", met ? qps : 0.0);
+      else
+        printf("%.3f,%.0f,%.1f,%.1f,%d,%.1f\n", t, target, qps, lat, met,
+               met ? qps : 0.0);
+      fflush(stdout);
+
+      if (target <= 0.0) target = start_qps = qps;
+
+      if (pid) {
+        double e = (latency_target.x - lat) / latency_target.x;
+        double u = SLO_PID_KP * (e - e1) + SLO_PID_KI * e +
+          SLO_PID_KD * (e - 2 * e1 + e2);
+        target *= 1.0 + std::max(-0.5, std::min(0.25, u));
+        e2 = e1;
+        e1 = e;
+      } else {
+        target = met ? target + SLO_AIMD_ADD * start_qps :
+          target * SLO_AIMD_MUL;
+      }
+      target = std::max(target, 1.0);
+      control_set_qps((int) target);
+    }
+  }
+
+  control_end();
+  return NULL;
+}
+
+#ifdef HAVE_LIBZMQ
+/*
+ * An agent's side of --live, --search_window and --slo: answer the master's
+ * requests on the agent socket while the run is in progress.
+ */
+void* agent_control_thread(void *arg) {
+  struct live_data *ld = (struct live_data *) arg;
+  zmq::socket_t &socket = *ld->socket;
+  int counts_len = HdrHistogramSampler().counts_len;
+
+  if (!live_wait_start()) return NULL;
+
+  while (!live_stop) {
+    zmq::pollitem_t item = {(void *) socket, 0, ZMQ_POLLIN, 0};
+    zmq::poll(&item, 1, 100);
+    if (!(item.revents & ZMQ_POLLIN)) continue;
+
+    string req = s_recv(socket);
+    if (req == "live") {
+      AgentStats as(1, counts_len);
+      live_collect(as, live_grace_ms(*ld->options));
+
+      string wire;
+      AgentStatsWire::encode(as, wire);
+      zmq::message_t reply(wire.size());
+      memcpy(reply.data(), wire.data(), wire.size());
+      socket.send(reply);
+      continue;
+    }
+
+    if (!req.compare(0, 4, "qps ")) {
+      control_qps = atoi(req.c_str() + 4);
+      control_qps_epoch++;
+    } else if (req == "reset") {
+      control_reset_epoch++;
+    } else if (req == "stats") {
+      // The master's --live run ended before ours.
+      stats_requested = true;
+      control_stop = true;
+      break;
+    } else if (req != "stop") {
+      DIE("Unexpected request during run: %s", req.c_str());
+    }
+    s_send(socket, "ack");
+
+    // The master's next request is for the stats, after the run.
+    if (req == "stop") {
+      control_stop = true;
+      break;
+    }
+  }
+
+  return NULL;
+}
+#endif
+
+// Running counters of one thread's connections, for LiveRecorder.
+static BaseStats live_totals(const ConnectionStats &s) {
+  BaseStats t;
+  memset(&t, 0, sizeof(t));
+
+  t.rx_bytes = s.rx_bytes;
+  t.tx_bytes = s.tx_bytes;
+  t.gets = s.gets;
+  t.sets = s.sets;
+  t.get_misses = s.get_misses;
+  t.skips = s.skips;
+
+  return t;
+}
+
+/**
+ * Raise the open file limit to fit n sockets, or die saying how.
+ */
+static void raise_fd_limit(uint64_t n) {
+  struct rlimit rl;
+  if (getrlimit(RLIMIT_NOFILE, &rl)) DIE("getrlimit(RLIMIT_NOFILE) failed");
+  if (rl.rlim_cur >= n) return;
+
+  if (rl.rlim_max < n)
+    DIE("%" PRIu64 " connections need more file descriptors than the hard "
+        "limit of %lu; raise it with ulimit -Hn.", n,
+        (unsigned long) rl.rlim_max);
+
+  rl.rlim_cur = n;
+  if (setrlimit(RLIMIT_NOFILE, &rl))
+    DIE("setrlimit(RLIMIT_NOFILE, %" PRIu64 ") failed", n);
+  V("Raised open file limit to %" PRIu64 ".", n);
+}
+
 void go(const vector<string>& servers, options_t& options,
         ConnectionStats &stats, uint64_t& start, uint64_t& end
 #ifdef HAVE_LIBZMQ
 , zmq::socket_t* socket
 #endif
 ) {
+  raise_fd_limit((uint64_t) options.connections * servers.size() *
+                 std::max(options.threads, 1) + 64);
+
 #ifdef HAVE_LIBZMQ
   if (args.agent_given > 0) {
 V("agent given");
@@ -1256,6 +1773,31 @@ V("Agent prep done.");
   }
 #endif
 
+  pthread_t live_pt;
+  struct live_data ld;
+  ld.options = &options;
+#ifdef HAVE_LIBZMQ
+  ld.socket = socket;
+#endif
+  live_running = false;
+  live_stop = false;
+  control_stop = false;
+  stats_requested = false;
+
+  Connection::keys_loaded = 0;
+  Connection::keys_to_load = 0;
+
+  bool control = options.live_ms > 0 || options.control_ms > 0;
+  if (control) {
+    void* (*fn)(void*) = options.live_ms > 0 ? live_thread :
+      args.slo_given ? slo_thread : search_thread;
+#ifdef HAVE_LIBZMQ
+    if (args.agentmode_given) fn = agent_control_thread;
+#endif
+    if (pthread_create(&live_pt, NULL, fn, &ld))
+      DIE("pthread_create() failed");
+  }
+
   if (options.threads > 1) {
     pthread_t pt[options.threads];
     struct thread_data td[options.threads];
@@ -1280,6 +1822,7 @@ D("Starting %d threads.", options.threads);
 #endif
       if (t == 0) td[t].master = true;
       else td[t].master = false;
+      td[t].thread_id = t;
 
       if (options.roundrobin) {
         for (unsigned int i = (t % servers.size());
@@ -1329,7 +1872,7 @@ D("Waiting for thread %d.",t);
       delete cs;
     }
   } else if (options.threads == 1) {
-    do_mcperf(servers, options, stats, true
+    do_mcperf(servers, options, stats, true, 0
 #ifdef HAVE_LIBZMQ
 , socket
 #endif
@@ -1341,10 +1884,16 @@ D("Waiting for thread %d.",t);
 	if (err>0) DIE("ERRORS in agent sync!");
     }
 #endif
+    live_running = true;
   }
 
   end = duration_cast<milliseconds>(system_clock::now().time_since_epoch()).count();
 
+  if (control) {
+    live_stop = true;
+    pthread_join(live_pt, NULL);
+  }
+
 #ifdef HAVE_LIBZMQ
 	if (args.agentmode_given) {
     	float total = (float)(stats.gets) + (float)stats.sets;
@@ -1365,7 +1914,7 @@ void* thread_main(void *arg) {
 
   ConnectionStats *cs = new ConnectionStats(true, td->options->n_intervals);
 
-  do_mcperf(*td->servers, *td->options, *cs, td->master
+  do_mcperf(*td->servers, *td->options, *cs, td->master, td->thread_id
 #ifdef HAVE_LIBZMQ
 , td->socket
 #endif
@@ -1374,8 +1923,35 @@ void* thread_main(void *arg) {
   return cs;
 }
 
+/**
+ * Part i of parts of the range [first, first + count), as [f, f + n).
+ */
+static void split_range(int first, int count, int parts, int i,
+                        int &f, int &n) {
+  int64_t lo = (int64_t) count * i / parts;
+  int64_t hi = (int64_t) count * (i + 1) / parts;
+  f = first + lo;
+  n = hi - lo;
+}
+
+/**
+ * Run one iteration of whichever event engine drives this thread.
+ */
+static void engine_loop(struct event_base *base, UringEngine *uring,
+                        TimerWheel *wheel, CachingKeyGenerator *keys,
+                        int flags) {
+  if (uring) {
+    uring->loop(flags);
+  } else {
+    event_base_loop(base, flags);
+    wheel->poll();
+  }
+  // Key cache regeneration, off the request path.
+  keys->maintain();
+}
+
 void do_mcperf(const vector<string>& servers, options_t& options,
-                 ConnectionStats& stats, bool master
+                 ConnectionStats& stats, bool master, int thread_id
 #ifdef HAVE_LIBZMQ
 , zmq::socket_t* socket
 #endif
@@ -1403,14 +1979,36 @@ void do_mcperf(const vector<string>& servers, options_t& options,
 
   if ((evdns = evdns_base_new(base, 1)) == 0) DIE("evdns");
 
+  // One timer for all of this thread's Connections.
+  TimerWheel *wheel = new TimerWheel(options.engine == ENGINE_URING ? NULL :
+                                     base, options.timer_spin);
+  UringEngine *uring =
+    options.engine == ENGINE_URING ? new UringEngine(wheel) : NULL;
+
   //  event_base_priority_init(base, 2);
 
   // FIXME: May want to move this to after all connections established.
   double start = get_time();
   double now = start;
 
+  ThreadState *thread = new ThreadState(options,
+    ((uint64_t) options.agent_id << 48) | ((uint64_t) thread_id << 32) |
+    0xffffffffULL,
+    args.keycache_capacity_given ? args.keycache_capacity_arg : 0,
+    args.keycache_reuse_given ? args.keycache_reuse_arg : 0,
+    args.keycache_regen_given ? args.keycache_regen_arg : 0);
+  thread->trace = replay_trace;
+
   vector<Connection*> connections;
-  vector<Connection*> server_lead;
+  vector<vector<Connection*> > server_conns;
+
+  // Measure what Connections cost once every thread has built its own.
+  static std::atomic<size_t> connections_built;
+  size_t rss_before = 0;
+  if (master) connections_built = 0;
+  pthread_barrier_wait(&barrier);
+  if (master) rss_before = get_rss();
+  pthread_barrier_wait(&barrier);
 	 vector<string>::const_iterator s;
 
   for (s=servers.begin(); s!=servers.end(); s++) {
@@ -1433,26 +2031,40 @@ void do_mcperf(const vector<string>& servers, options_t& options,
       options.connections;
 	D("Connections req %s %d [%d/%d]",s->c_str(),conns,args.measure_connections_arg,options.connections);
 
+    server_conns.push_back(vector<Connection*>());
+
     for (int c = 0; c < conns; c++) {
 
-      Connection* conn = new Connection(base, evdns, hostname, port, options,
-                                        args.agentmode_given ? true :
-                                        true,
-										args.keycache_capacity_given ? args.keycache_capacity_arg : 0,
-										args.keycache_reuse_given ? args.keycache_reuse_arg : 0,
-										args.keycache_regen_given ? args.keycache_regen_arg : 0);
+      uint64_t rng_stream = ((uint64_t) options.agent_id << 48) |
+        ((uint64_t) thread_id << 32) | connections.size();
+      Connection* conn = new Connection(thread, base, evdns, hostname, port,
+                                        rng_stream);
+      wheel->attach(conn);
+      if (uring) uring->attach(conn);
       connections.push_back(conn);
-      if (c == 0) server_lead.push_back(conn);
+      server_conns.back().push_back(conn);
     }
   }
 
-  // Wait for all Connections to become IDLE.
-  int lcntr=0;
-  struct timeval delay;
-  //SG setup auto exit from evloop to break potential deadlock
-  delay.tv_sec = 4;
-  delay.tv_usec = 0;
+  // Under --replay, record i of the trace goes to thread i % T of all
+  // T threads (master and agents), and each thread deals its records
+  // out to its connections in turn.
+  if (thread->trace) {
+    uint64_t T = options.total_threads, n = connections.size();
+    uint64_t first = options.thread_offset + thread_id;
+    for (uint64_t j = 0; j < n; j++)
+      connections[j]->replay(first + T * j, T * n);
+  }
 
+  connections_built += connections.size();
+  pthread_barrier_wait(&barrier);
+  if (master && rss_before > 0) {
+    size_t total = connections_built, rss = get_rss();
+    V("%zu connections, %.1f KB each (RSS %.1f MB)", total,
+      ((double) rss - rss_before) / total / 1024, rss / 1048576.0);
+  }
+
+  // Wait for all Connections to become IDLE.
   D("evt based loop start\n");
   while (1) {
     if (interrupted) {
@@ -1460,7 +2072,7 @@ void do_mcperf(const vector<string>& servers, options_t& options,
       break;
     }
 
-    event_base_loop(base, loop_flag);
+    engine_loop(base, uring, wheel, thread->keygen, loop_flag);
 
     struct timeval now_tv;
     event_base_gettimeofday_cached(base, &now_tv);
@@ -1478,34 +2090,65 @@ void do_mcperf(const vector<string>& servers, options_t& options,
 
   D("evt based loop end\n");
 
-  // Load database on lead connection for each server.
-  // TODO: parallelize the database loading to multiple threads
+  // Load this instance's share of the database.  Each thread takes a
+  // slice of it (unless --roundrobin gave threads disjoint servers),
+  // and spreads its slice over all of its connections to each server.
   if (!options.noload) {
     D("Loading database.");
-	vector<Connection*>::iterator c;
-    for (c= server_lead.begin(); c!=server_lead.end(); c++ ) (*c)->start_loading();
+    int first = options.load_first, count = options.load_count;
+    if (!options.roundrobin)
+      split_range(first, count, options.threads, thread_id, first, count);
+
+    for (auto &sc : server_conns) {
+      for (unsigned int i = 0; i < sc.size(); i++) {
+        int f, n;
+        split_range(first, count, sc.size(), i, f, n);
+        sc[i]->start_loading(f, n);
+      }
+    }
+
+    double load_start = get_time(), last_report = load_start;
+    struct timeval tick = {1, 0};
 
     // Wait for all Connections to become IDLE.
     while (1) {
       // FIXME: If all connections become ready before event_base_loop
       // is called, this will deadlock.
-    event_base_loopexit(base, &delay);
-      event_base_loop(base, EVLOOP_ONCE );
+      if (!uring) event_base_loopexit(base, &tick);
+      engine_loop(base, uring, wheel, thread->keygen, EVLOOP_ONCE);
 
       bool restart = false;
-         vector<Connection*>::iterator conn;
-    for (conn= connections.begin(); conn!=connections.end(); conn++ )
-      if ((*conn)->read_state != Connection::IDLE) {
-        restart = true;
-
-	}
+      for (auto conn : connections)
+        if (conn->read_state != Connection::IDLE) restart = true;
+
+      if (!restart) break;
+
+      double t = get_time();
+      if (master && t - last_report >= 1.0) {
+        uint64_t done = Connection::keys_loaded;
+        uint64_t total = Connection::keys_to_load;
+        V("Loading: %" PRIu64 " / %" PRIu64 " keys (%.0f%%), %.0f keys/s",
+          done, total, total ? 100.0 * done / total : 0.0,
+          done / (t - load_start));
+        last_report = t;
+      }
+    }
 
-      if (restart) continue;
-      else break;
+    pthread_barrier_wait(&barrier);
+    if (master) {
+      double t = get_time() - load_start;
+      uint64_t done = Connection::keys_loaded;
+      I("Loaded %" PRIu64 " keys in %.2fs (%.0f keys/s).", done, t,
+        t > 0 ? done / t : 0.0);
     }
   }
 
   if (options.loadonly) {
+    for (auto conn : connections) delete conn;
+    delete thread;
+    delete uring;
+    delete wheel;
+    event_config_free(config);
     evdns_base_free(evdns, 0);
     event_base_free(base);
     return;
@@ -1540,17 +2183,17 @@ void do_mcperf(const vector<string>& servers, options_t& options,
     //    options.time = 1;
 
     start = get_time();
+    thread->options.time = options.warmup;
          vector<Connection*>::iterator iconn;
     for (iconn= connections.begin(); iconn!=connections.end(); iconn++ ) {
 	Connection *conn=*iconn;
 
       conn->start_time = start;
-      conn->options.time = options.warmup;
       conn->drive_write_machine(); // Kick the Connection into motion.
     }
 
     while (1) {
-      event_base_loop(base, loop_flag);
+      engine_loop(base, uring, wheel, thread->keygen, loop_flag);
 
       //#ifdef USE_CLOCK_GETTIME
       //      now = get_time();
@@ -1587,7 +2230,7 @@ void do_mcperf(const vector<string>& servers, options_t& options,
 		  // become ready before event_base_loop is called, this will
 		  // deadlock.  We should check for IDLE before calling
 		  // event_base_loop.
-			event_base_loop(base, EVLOOP_ONCE); // EVLOOP_NONBLOCK);
+			engine_loop(base, uring, wheel, thread->keygen, EVLOOP_ONCE); // EVLOOP_NONBLOCK);
 
 			bool restart = false;
 			vector<Connection*>::iterator iconn;
@@ -1602,13 +2245,12 @@ void do_mcperf(const vector<string>& servers, options_t& options,
 		}
     }
 
-    //    options.time = old_time;
     for (iconn= connections.begin(); iconn!=connections.end(); iconn++ ) {
         Connection *conn=*iconn;
       conn->reset();
-      //      conn->stats = ConnectionStats();
-      conn->options.time = old_time;
     }
+    thread->stats = ConnectionStats(true, options.n_intervals);
+    thread->options.time = old_time;
 
     if (master) V("Warmup stop.");
   }
@@ -1639,6 +2281,15 @@ void do_mcperf(const vector<string>& servers, options_t& options,
   }
 #endif
 
+  LiveRecorder *live = NULL;
+  if (options.live_ms > 0 || options.control_ms > 0) {
+    live = new LiveRecorder();
+    live_register(live);
+    live->set_baseline(live_totals(thread->stats));
+    thread->stats.live = live;
+    if (master) live_running = true;
+  }
+
   if (master && !args.scan_given && !args.search_given)
     V("started at %f", get_time());
 
@@ -1661,9 +2312,12 @@ void do_mcperf(const vector<string>& servers, options_t& options,
 
   //  V("Start = %f", start);
 
+  double cpu_start = get_thread_cpu_time();
+  uint64_t seen_qps = control_qps_epoch, seen_reset = control_reset_epoch;
+
   // Main event loop.
   while (1) {
-    event_base_loop(base, loop_flag);
+    engine_loop(base, uring, wheel, thread->keygen, loop_flag);
 
     //#if USE_CLOCK_GETTIME
     //    now = get_time();
@@ -1681,10 +2335,44 @@ void do_mcperf(const vector<string>& servers, options_t& options,
         restart = true;
 	}
 
+    if (live && live->epoch_changed()) live->publish(live_totals(thread->stats));
+
+    if (options.control_ms > 0) {
+      // --measure_qps holds the master's rate while agents' change.
+      uint64_t epoch = control_qps_epoch;
+      if (seen_qps != epoch) {
+        seen_qps = epoch;
+        if (!(args.agent_given && args.measure_qps_given)) {
+          double lambda = (double) control_qps / options.lambda_denom *
+            args.lambda_mul_arg;
+          for (auto conn : connections) conn->set_lambda(lambda, now);
+          thread->options.lambda = lambda;
+        }
+      }
+
+      // The final measurement starts from fresh stats.
+      if (seen_reset != control_reset_epoch) {
+        seen_reset = control_reset_epoch;
+        thread->stats = ConnectionStats(true, options.n_intervals);
+        thread->stats.live = live;
+        live->set_baseline(live_totals(thread->stats));
+        start = now;
+        cpu_start = get_thread_cpu_time();
+      }
+
+      if (control_stop) thread->options.time = 0;
+    }
+
     if (restart) continue;
     else break;
   }
 
+  if (live) {
+    if (master) live_running = false;  // Drop the partial last period.
+    live_unregister(live);
+    delete live;
+  }
+
   if (master && !args.scan_given && !args.search_given)
 	if (args.trace_given) { 
 	/* 	To support tracing/simulation, in trace mode, 
@@ -1700,13 +2388,17 @@ void do_mcperf(const vector<string>& servers, options_t& options,
   // Tear-down and accumulate stats.
 	for (iconn= connections.begin(); iconn!=connections.end(); iconn++ ) {
 		Connection *conn=*iconn;
-		stats.accumulate(conn->stats);
 		delete conn;
 	}
+	stats.accumulate(thread->stats);
+	delete thread;
 
 	stats.start = start;
 	stats.stop = now;
+	stats.client_cpu += get_thread_cpu_time() - cpu_start;
 
+	delete uring;
+	delete wheel;
 	event_config_free(config);
 	evdns_base_free(evdns, 0);
 	event_base_free(base);
@@ -1790,6 +2482,7 @@ void args_to_options(options_t* options) {
   parse_profile();
   options->connections = args.connections_arg;
   options->blocking = args.blocking_given;
+  options->timer_spin = args.timer_spin_arg / 1000000.0;
   options->qps = args.qps_arg;
   options->threads = args.threads_arg;
   options->server_given = args.server_given;
@@ -1820,8 +2513,25 @@ void args_to_options(options_t* options) {
 	options->server_given=1;
   options->records = args.records_arg / options->server_given;
 
-  options->binary = args.binary_given;
+  if (!strcmp(args.protocol_arg, "ascii"))
+    options->protocol = PROTOCOL_ASCII;
+  else if (!strcmp(args.protocol_arg, "binary"))
+    options->protocol = PROTOCOL_BINARY;
+  else if (!strcmp(args.protocol_arg, "meta"))
+    options->protocol = PROTOCOL_META;
+  else DIE("--protocol: unknown protocol '%s'", args.protocol_arg);
+
+  if (args.binary_given) {
+    if (args.protocol_given && options->protocol != PROTOCOL_BINARY)
+      DIE("--binary conflicts with --protocol=%s", args.protocol_arg);
+    options->protocol = PROTOCOL_BINARY;
+  }
+
+  options->meta_replies = args.meta_replies_given;
+  options->meta_base64 = args.meta_base64_given;
   options->sasl = args.username_given;
+  if (options->sasl && options->protocol != PROTOCOL_BINARY)
+    DIE("SASL authentication (--username) requires --binary.");
   
   if (args.password_given)
     strcpy(options->password, args.password_arg);
@@ -1836,6 +2546,12 @@ void args_to_options(options_t* options) {
   D("options->records = %d", options->records);
 
   if (!options->records) options->records = 1;
+  options->load_first = 0;
+  options->load_count = options->records;
+  if (strlen(args.keysize_arg) >= sizeof(options->keysize) ||
+      strlen(args.valuesize_arg) >= sizeof(options->valuesize))
+    DIE("--keysize/--valuesize must be shorter than %zu characters",
+        sizeof(options->keysize));
   strcpy(options->keysize, args.keysize_arg);
   strcpy(options->keyorder, args.keyorder_arg);
   strcpy(options->valuesize, args.valuesize_arg);
@@ -1843,17 +2559,67 @@ void args_to_options(options_t* options) {
 
   options->loadonly = args.loadonly_given;
   options->depth = args.depth_arg;
+  options->thread_offset = 0;
+  options->total_threads = options->threads;
+
+  // A replayed trace sets the request rate and warms the cache with its
+  // own sets, and by default runs to its end.
+  if (args.replay_given) {
+    if (strlen(args.replay_arg) >= sizeof(options->replay))
+      DIE("--replay path must be shorter than %zu characters",
+          sizeof(options->replay));
+    if (args.replay_speed_arg <= 0.0) DIE("--replay_speed must be positive.");
+    if (args.qps_given || args.loadonly_given)
+      DIE("--replay cannot be combined with --qps or --loadonly.");
+    strcpy(options->replay, args.replay_arg);
+    options->replay_speed = args.replay_speed_arg;
+    if (replay_trace == NULL) replay_trace = new Trace(options->replay);
+  }
   options->no_nodelay = args.no_nodelay_given;
-  options->noload = args.noload_given;
+
+  if (!strcmp(args.engine_arg, "libevent"))
+    options->engine = ENGINE_LIBEVENT;
+  else if (!strcmp(args.engine_arg, "uring") ||
+           !strcmp(args.engine_arg, "io_uring"))
+    options->engine = ENGINE_URING;
+  else DIE("--engine: unknown engine '%s'", args.engine_arg);
+
+  if (options->engine == ENGINE_URING && !UringEngine::supported())
+    DIE("--engine=uring: io_uring with multishot receive (Linux 6.0+) is "
+        "not available on this system.");
+
+  if (!strcmp(args.clock_arg, "tsc"))
+    options->clock = CLOCK_SOURCE_TSC;
+  else if (!strcmp(args.clock_arg, "monotonic"))
+    options->clock = CLOCK_SOURCE_MONOTONIC;
+  else if (!strcmp(args.clock_arg, "gettimeofday"))
+    options->clock = CLOCK_SOURCE_GETTIMEOFDAY;
+  else DIE("--clock: unknown clock '%s'", args.clock_arg);
+
+  clock_init(options->clock);
+  options->noload = args.noload_given || args.replay_given;
   options->iadist = get_distribution(args.iadist_arg);
   strcpy(options->ia, args.iadist_arg);
   options->warmup = args.warmup_given ? args.warmup_arg : 0;
   options->oob_thread = false;
   options->skip = args.skip_given;
   options->moderate = args.moderate_given;
+  options->cdf_tables = args.cdf_tables_given;
   options->getq_freq = args.getq_freq_given ? args.getq_freq_arg : 0.0;
   options->getq_size = args.getq_size_arg;
 
+  if (args.hdr_digits_arg < 1 || args.hdr_digits_arg > 5)
+    DIE("--hdr_digits must be between 1 and 5.");
+  if (args.hdr_max_arg <= 0.0) DIE("--hdr_max must be positive.");
+  options->hdr_digits = args.hdr_digits_arg;
+  options->hdr_max_us = args.hdr_max_arg * 1000000;
+  HdrHistogramSampler::configure(options->hdr_digits, options->hdr_max_us);
+
+  if (args.live_arg < 0) DIE("--live must be >= 0.");
+  if (strcmp(args.live_format_arg, "csv") && strcmp(args.live_format_arg, "json"))
+    DIE("--live_format: unknown format '%s'", args.live_format_arg);
+  options->live_ms = args.live_arg;
+
   options->dyn_agent = 0;
   options->dyn_en = args.qps_interval_given;
   options->qps_min = args.qps_min_arg;
@@ -1861,14 +2627,43 @@ void args_to_options(options_t* options) {
   options->qps_interval = args.qps_interval_arg;
   options->qps_measure = args.measure_qps_arg;
   options->qps_seed = args.qps_seed_arg;
+  options->seed = (unsigned int) args.seed_arg;
+  options->agent_id = 0;
   options->trace_en = args.qps_target_given > 0;
 
   options->time = (args.qps_target_given > 0) ? (args.qps_target_given * args.qps_interval_arg) : args.time_arg;
+  if (replay_trace && !args.time_given)
+    options->time = (int) ceil(replay_trace->duration / options->replay_speed) + 1;
   assert(options->time >= 1);
 
   options->n_intervals = args.qps_interval_given ? 
                 (args.qps_target_given > 0 ? args.qps_target_given : ((int)(ceil((double)options->time / options->qps_interval)))) : 1;
 
+  if (args.search_window_arg < 0) DIE("--search_window must be >= 0.");
+  options->control_ms = 0;
+  if (args.search_given && args.search_window_arg > 0) {
+    if (args.live_arg > 0 || args.qps_interval_given || args.replay_given)
+      DIE("--search_window cannot be combined with --live, --qps_interval "
+          "or --replay.");
+    options->control_ms = args.search_window_arg;
+    // The search ends the run; -t is the final measurement.
+    options->time = CONTROL_MAX_TIME;
+  }
+
+  if (args.slo_given) {
+    if (args.slo_window_arg <= 0) DIE("--slo_window must be positive.");
+    if (strcmp(args.slo_control_arg, "aimd") &&
+        strcmp(args.slo_control_arg, "pid"))
+      DIE("--slo_control: unknown controller '%s'", args.slo_control_arg);
+    if (args.search_given || args.scan_given || args.live_arg > 0 ||
+        args.qps_interval_given || args.replay_given || args.loadonly_given)
+      DIE("--slo cannot be combined with --search, --scan, --live, "
+          "--qps_interval, --replay or --loadonly.");
+    options->control_ms = args.slo_window_arg;
+    // The controller ends the run after -t, agents included.
+    options->time = CONTROL_MAX_TIME;
+  }
+
 }
 
 void init_random_stuff() {
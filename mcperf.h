@@ -5,11 +5,12 @@
 
 #define USE_CACHED_TIME 0
 #define MINIMUM_KEY_LENGTH 2
-#define MAXIMUM_CONNECTIONS 512
+#define MAXIMUM_CONNECTIONS 262144  // Per server; see ThreadState.
 
 #define MAX_SAMPLES 100000
 
 #define LOADER_CHUNK 1024
+#define LOADER_BATCH 128  // Binary quiet sets per NOOP while loading.
 
 extern char random_char[];
 extern gengetopt_args_info args;
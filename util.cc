@@ -3,13 +3,110 @@
 #include <sys/time.h>
 #include <unistd.h>
 
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#endif
+
+#include "log.h"
 #include "mcperf.h"
 #include "util.h"
 
+clock_source_t tick_source = CLOCK_SOURCE_GETTIMEOFDAY;
+double us_per_tick = 1.0;
+
+#define TSC_CALIBRATION_TIME 0.05
+
+/**
+ * Does the CPU advertise an invariant TSC (constant rate across
+ * P-/C-states, CPUID 0x80000007 EDX bit 8)?
+ */
+bool tsc_invariant() {
+#if defined(__x86_64__) || defined(__i386__)
+  unsigned int eax, ebx, ecx, edx;
+
+  if (__get_cpuid(0x80000000, &eax, &ebx, &ecx, &edx) == 0 ||
+      eax < 0x80000007)
+    return false;
+
+  __get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx);
+  return (edx & (1 << 8)) != 0;
+#else
+  return false;
+#endif
+}
+
+const char *clock_name(clock_source_t source) {
+  switch (source) {
+  case CLOCK_SOURCE_TSC: return "tsc";
+  case CLOCK_SOURCE_MONOTONIC: return "monotonic";
+  default: return "gettimeofday";
+  }
+}
+
+/**
+ * Select the clock behind get_ticks() and calibrate ticks to
+ * microseconds.  The TSC is measured against CLOCK_MONOTONIC; if it is
+ * not invariant we fall back to CLOCK_MONOTONIC.
+ *
+ * @return the clock source actually in use
+ */
+clock_source_t clock_init(clock_source_t source) {
+  if (source == CLOCK_SOURCE_TSC && !tsc_invariant()) {
+    W("TSC is not invariant, using CLOCK_MONOTONIC instead.");
+    source = CLOCK_SOURCE_MONOTONIC;
+  }
+
+  switch (source) {
+  case CLOCK_SOURCE_TSC: {
+    static double tsc_us_per_tick = 0.0;  // Calibrate only once.
+    tick_source = CLOCK_SOURCE_TSC;
+
+    if (tsc_us_per_tick == 0.0) {
+      struct timespec t0, t1;
+
+      clock_gettime(CLOCK_MONOTONIC, &t0);
+      uint64_t c0 = get_ticks();
+      sleep_time(TSC_CALIBRATION_TIME);
+      clock_gettime(CLOCK_MONOTONIC, &t1);
+      uint64_t c1 = get_ticks();
+
+      double us = (t1.tv_sec - t0.tv_sec) * 1000000.0 +
+        (t1.tv_nsec - t0.tv_nsec) / 1000.0;
+      tsc_us_per_tick = us / (c1 - c0);
+    }
+
+    us_per_tick = tsc_us_per_tick;
+    break;
+  }
+  case CLOCK_SOURCE_MONOTONIC:
+    tick_source = CLOCK_SOURCE_MONOTONIC;
+    us_per_tick = 0.001;
+    break;
+  default:
+    tick_source = CLOCK_SOURCE_GETTIMEOFDAY;
+    us_per_tick = 1.0;
+    break;
+  }
+
+  V("Clock: %s, %.4f ns/tick", clock_name(tick_source), us_per_tick * 1000);
+  return tick_source;
+}
+
 void sleep_time(double duration) {
   if (duration > 0) usleep((useconds_t) (duration * 1000000));
 }
 
+size_t get_rss() {
+  FILE *f = fopen("/proc/self/statm", "r");
+  if (f == NULL) return 0;
+
+  unsigned long size, resident;
+  int n = fscanf(f, "%lu %lu", &size, &resident);
+  fclose(f);
+
+  return n == 2 ? resident * sysconf(_SC_PAGESIZE) : 0;
+}
+
 #define FNV_64_PRIME (0x100000001b3ULL)
 #define FNV1_64_INIT (0xcbf29ce484222325ULL)
 uint64_t fnv_64_buf(const void* buf, size_t len) {
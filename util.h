@@ -1,9 +1,14 @@
 #ifndef UTIL_H
 #define UTIL_H
 
+#include <stdint.h>
 #include <sys/time.h>
 #include <time.h>
 
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
 inline double tv_to_double(struct timeval *tv) {
   return tv->tv_sec + (double) tv->tv_usec / 1000000;
 }
@@ -42,8 +47,59 @@ inline double get_time() {
   //#endif
 }
 
+// Clock used to timestamp Operations (--clock).
+enum clock_source_t {
+  CLOCK_SOURCE_TSC, CLOCK_SOURCE_MONOTONIC, CLOCK_SOURCE_GETTIMEOFDAY
+};
+
+extern clock_source_t tick_source;
+extern double us_per_tick;
+
+clock_source_t clock_init(clock_source_t source);
+bool tsc_invariant();
+const char *clock_name(clock_source_t source);
+
+// Timestamp in ticks of the clock chosen by clock_init().  Ticks are
+// only meaningful within one process; convert with ticks_to_us().
+inline uint64_t get_ticks() {
+  switch (tick_source) {
+#if defined(__x86_64__) || defined(__i386__)
+  case CLOCK_SOURCE_TSC:
+    return __rdtsc();
+#endif
+  case CLOCK_SOURCE_MONOTONIC: {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+  }
+  default: {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec * 1000000ULL + tv.tv_usec;
+  }
+  }
+}
+
+inline double ticks_to_us(uint64_t ticks) {
+  return ticks * us_per_tick;
+}
+
+inline uint64_t us_to_ticks(double us) {
+  return (uint64_t) (us / us_per_tick);
+}
+
+// CPU time consumed by the calling thread, in seconds.
+inline double get_thread_cpu_time() {
+  struct timespec ts;
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+  return ts.tv_sec + (double) ts.tv_nsec / 1000000000;
+}
+
 void sleep_time(double duration);
 
+// Resident set size of this process in bytes, 0 if unknown.
+size_t get_rss();
+
 uint64_t fnv_64_buf(const void* buf, size_t len);
 inline uint64_t fnv_64(uint64_t in) { return fnv_64_buf(&in, sizeof(in)); }
 